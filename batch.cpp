@@ -0,0 +1,347 @@
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QRunnable>
+#include <string.h>
+#include "batch.h"
+
+/* Bytes an ASCII facet takes at the very least, so the facet count of
+   an ASCII file is never underestimated: one-digit numbers and a single
+   separator throughout,
+     "facet normal 0 0 0\n" (19) "outer loop\n" (11)
+     3 x "vertex 0 0 0\n" (39) "endloop\n" (8) "endfacet\n" (9). */
+#define STL_BATCH_MIN_ASCII_FACET 86
+
+/* How many edges were open before any repair, which stats_out() and
+   report() print as the original state. */
+static void stl_batch_count_bad_edges(stl &mesh)
+{
+    mesh.stats.facets_w_1_bad_edge = mesh.stats.connected_facets_2_edge
+                                     - mesh.stats.connected_facets_3_edge;
+    mesh.stats.facets_w_2_bad_edge = mesh.stats.connected_facets_1_edge
+                                     - mesh.stats.connected_facets_2_edge;
+    mesh.stats.facets_w_3_bad_edge = mesh.stats.number_of_facets
+                                     - mesh.stats.connected_facets_1_edge;
+}
+
+static stl_status stl_batch_repair_mesh(stl &mesh,
+                                        const stl_batch_repair &repair)
+{
+    float tolerance = repair.nearby_tolerance;
+    float increment = repair.nearby_increment;
+    int   i;
+
+    stl_batch_count_bad_edges(mesh);
+    if(repair.nearby)
+      {
+        if(tolerance <= 0.0)
+            tolerance = mesh.stats.shortest_edge;
+        if(increment <= 0.0)
+            increment = mesh.stats.bounding_diameter / 10000.0;
+        for(i = 0; i < repair.nearby_iterations
+                   && mesh.stats.connected_facets_3_edge
+                      < mesh.stats.number_of_facets; i++)
+          {
+            mesh.check_facets_nearby(tolerance);
+            tolerance += increment;
+          }
+      }
+    if(repair.remove_unconnected)
+        mesh.remove_unconnected_facets();
+    if(repair.fill_holes)
+        mesh.fill_holes();
+    if(repair.normal_directions)
+        mesh.fix_normal_directions();
+    if(repair.normal_values)
+        mesh.fix_normal_values();
+    mesh.calculate_volume();
+
+    if(mesh.v_shared == NULL)
+        return mesh.generate_shared_vertices(NULL, NULL);
+    return STL_OK;
+}
+
+class stl_batch::job : public QRunnable
+{
+public:
+    job(stl_batch *batch, int index) : batch(batch), index(index) {}
+
+    void run()
+    {
+        stl_batch_result result = batch->results[index];
+        QElapsedTimer    timer;
+        stl              mesh;
+        FILE            *out;
+
+        timer.start();
+        result.status = mesh.load((char *) result.input.c_str(), NULL, NULL);
+        if(result.status == STL_OK)
+            result.status = stl_batch_repair_mesh(mesh, batch->repair);
+        if(result.status == STL_OK)
+          {
+            result.stats = mesh.stats;
+
+            if(!result.stats_output.empty())
+              {
+                out = fopen(result.stats_output.c_str(), "w");
+                if(out == NULL)
+                  {
+                    result.status = STL_ERR_WRITE;
+                  }
+                else
+                  {
+                    mesh.stats_out(out, (char *) result.input.c_str());
+                    fclose(out);
+                  }
+              }
+
+            /* write_binary() exits if it can't open its file, which
+               would take the whole batch down; find out first. */
+            if(result.status == STL_OK && !result.output.empty())
+              {
+                out = fopen(result.output.c_str(), "wb");
+                if(out == NULL)
+                  {
+                    result.status = STL_ERR_WRITE;
+                  }
+                else
+                  {
+                    fclose(out);
+                    mesh.write_binary((char *) result.output.c_str(),
+                                      mesh.stats.header);
+                  }
+              }
+          }
+        mesh.close();
+        result.seconds = timer.elapsed() / 1000.0;
+        batch->finish(index, result);
+    }
+
+private:
+    stl_batch *batch;
+    int        index;
+};
+
+stl_batch::stl_batch(int threads, size_t memory_budget)
+    : memory_budget(memory_budget), memory_in_use(0), running(0), finished(0)
+{
+    if(threads < 1)
+        threads = QThread::idealThreadCount();
+    pool.setMaxThreadCount(threads);
+    memset(&repair, 0, sizeof(repair));
+}
+
+stl_batch::~stl_batch()
+{
+    pool.waitForDone();
+}
+
+void stl_batch::add(const char *input, const char *output,
+                    const char *stats_output)
+{
+    stl_batch_result result;
+
+    result.input = input;
+    if(output != NULL)
+        result.output = output;
+    if(stats_output != NULL)
+        result.stats_output = stats_output;
+    result.status = STL_CANCELLED;
+    memset(&result.stats, 0, sizeof(result.stats));
+    result.estimated_bytes = estimate_bytes(input);
+    result.seconds = 0.0;
+    results.push_back(result);
+}
+
+size_t stl_batch::estimate_bytes(const char *file)
+{
+    FILE          *fp;
+    stl_off_t      file_size;
+    unsigned char  chtest[128];
+    size_t         facets;
+    size_t         i;
+    int            binary_file = 0;
+
+    fp = fopen(file, "rb");
+    if(fp == NULL)
+        return 0;
+    stl_fseek(fp, 0, SEEK_END);
+    file_size = stl_ftell(fp);
+
+    /* The same test stl::open() uses to tell binary from ASCII. */
+    stl_fseek(fp, HEADER_SIZE, SEEK_SET);
+    memset(chtest, 0, sizeof(chtest));
+    if(fread(chtest, 1, sizeof(chtest), fp) > 0)
+      {
+        for(i = 0; i < sizeof(chtest); i++)
+          {
+            if(chtest[i] > 127)
+              {
+                binary_file = 1;
+                break;
+              }
+          }
+      }
+    fclose(fp);
+
+    if(file_size < HEADER_SIZE)
+        return 0;
+    if(binary_file)
+        facets = (file_size - HEADER_SIZE) / SIZEOF_STL_FACET;
+    else
+        facets = file_size / STL_BATCH_MIN_ASCII_FACET;
+    return facets * STL_BATCH_BYTES_PER_FACET;
+}
+
+void stl_batch::finish(int index, const stl_batch_result &result)
+{
+    QMutexLocker locker(&mutex);
+
+    results[index] = result;
+    memory_in_use -= result.estimated_bytes;
+    running--;
+    finished++;
+    changed.wakeAll();
+}
+
+void stl_batch::run(stl_progress_fn progress, void *user_data)
+{
+    int    count = (int) results.size();
+    int    next = 0;
+    int    reported = -1;
+    bool   cancelled = false;
+
+    mutex.lock();
+    memory_in_use = 0;
+    running = 0;
+    finished = 0;
+    while(finished < next || (next < count && !cancelled))
+      {
+        if(progress != NULL && reported != finished)
+          {
+            reported = finished;
+            mutex.unlock();
+            if(!progress((float) reported / count, user_data))
+                cancelled = true;
+            mutex.lock();
+          }
+
+        /* Admit as many jobs as the budget holds; an oversized job waits
+           for an idle pool and then runs alone. */
+        while(!cancelled && next < count
+              && (running == 0
+                  || memory_in_use + results[next].estimated_bytes
+                     <= memory_budget))
+          {
+            memory_in_use += results[next].estimated_bytes;
+            running++;
+            pool.start(new job(this, next));
+            next++;
+          }
+        if(finished < next)
+            changed.wait(&mutex);
+      }
+    mutex.unlock();
+    pool.waitForDone();
+
+    if(progress != NULL && !cancelled)
+        progress(1.0, user_data);
+}
+
+void stl_batch::report(FILE *file)
+{
+    stl_stats total;
+    size_t    i;
+    int       failed = 0;
+    int       cancelled = 0;
+    double    seconds = 0.0;
+
+    memset(&total, 0, sizeof(total));
+    fprintf(file, "%-40s %-10s %10s %10s %10s %8s\n", "File", "Status",
+            "Facets", "Vertices", "Open", "Seconds");
+    for(i = 0; i < results.size(); i++)
+      {
+        const stl_batch_result &result = results[i];
+        const stl_stats        &stats = result.stats;
+        static const char      *names[] =
+          {"ok", "open", "size", "memory", "read", "write", "cancelled"};
+
+        fprintf(file, "%-40s %-10s %10d %10d %10d %8.2f\n",
+                result.input.c_str(), names[result.status],
+                stats.number_of_facets, stats.shared_vertices,
+                stats.number_of_facets - stats.connected_facets_3_edge,
+                result.seconds);
+        if(result.status == STL_CANCELLED)
+          {
+            cancelled++;
+            continue;
+          }
+        if(result.status != STL_OK)
+          {
+            failed++;
+            continue;
+          }
+        seconds += result.seconds;
+        total.number_of_facets += stats.number_of_facets;
+        total.original_num_facets += stats.original_num_facets;
+        total.shared_vertices += stats.shared_vertices;
+        total.connected_edges += stats.connected_edges;
+        total.connected_facets_1_edge += stats.connected_facets_1_edge;
+        total.connected_facets_2_edge += stats.connected_facets_2_edge;
+        total.connected_facets_3_edge += stats.connected_facets_3_edge;
+        total.facets_w_1_bad_edge += stats.facets_w_1_bad_edge;
+        total.facets_w_2_bad_edge += stats.facets_w_2_bad_edge;
+        total.facets_w_3_bad_edge += stats.facets_w_3_bad_edge;
+        total.degenerate_facets += stats.degenerate_facets;
+        total.edges_fixed += stats.edges_fixed;
+        total.facets_removed += stats.facets_removed;
+        total.facets_added += stats.facets_added;
+        total.facets_reversed += stats.facets_reversed;
+        total.backwards_edges += stats.backwards_edges;
+        total.normals_fixed += stats.normals_fixed;
+      }
+
+    fprintf(file, "\n\
+================= Batch totals ===========================================\n");
+    fprintf(file, "\
+Files              : %5d  (%d failed, %d cancelled)\n",
+            (int) results.size(), failed, cancelled);
+    fprintf(file, "\
+Job time           : %.2f s\n", seconds);
+    fprintf(file, "\
+========= Facet Status ========== Original ============ Final ====\n");
+    fprintf(file, "\
+Number of facets                 : %5d               %5d\n",
+            total.original_num_facets, total.number_of_facets);
+    fprintf(file, "\
+Facets with 1 disconnected edge  : %5d               %5d\n",
+            total.facets_w_1_bad_edge, total.connected_facets_2_edge -
+            total.connected_facets_3_edge);
+    fprintf(file, "\
+Facets with 2 disconnected edges : %5d               %5d\n",
+            total.facets_w_2_bad_edge, total.connected_facets_1_edge -
+            total.connected_facets_2_edge);
+    fprintf(file, "\
+Facets with 3 disconnected edges : %5d               %5d\n",
+            total.facets_w_3_bad_edge, total.number_of_facets -
+            total.connected_facets_1_edge);
+    fprintf(file, "\
+Total disconnected facets        : %5d               %5d\n",
+            total.facets_w_1_bad_edge + total.facets_w_2_bad_edge +
+            total.facets_w_3_bad_edge, total.number_of_facets -
+            total.connected_facets_3_edge);
+    fprintf(file, "\
+=== Processing Statistics ===\n");
+    fprintf(file, "\
+Degenerate facets     : %5d\n", total.degenerate_facets);
+    fprintf(file, "\
+Edges fixed           : %5d\n", total.edges_fixed);
+    fprintf(file, "\
+Facets removed        : %5d\n", total.facets_removed);
+    fprintf(file, "\
+Facets added          : %5d\n", total.facets_added);
+    fprintf(file, "\
+Facets reversed       : %5d\n", total.facets_reversed);
+    fprintf(file, "\
+Backwards edges       : %5d\n", total.backwards_edges);
+    fprintf(file, "\
+Normals fixed         : %5d\n", total.normals_fixed);
+}
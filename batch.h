@@ -0,0 +1,97 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <QtCore/QMutex>
+#include <QtCore/QThreadPool>
+#include <QtCore/QWaitCondition>
+#include "stl.h"
+
+/* Rough peak heap use per facet of stl::load(): the facet, neighbor and
+ * index records, the shared vertices (about half a vertex per facet) and
+ * the edge hash, which holds up to two unmatched edges per facet while
+ * check_facets_exact() runs.
+ */
+#define STL_BATCH_BYTES_PER_FACET                                       \
+    (sizeof(stl_facet) + sizeof(stl_neighbors) + sizeof(v_indices_struct) \
+     + sizeof(stl_vertex) / 2 + 2 * sizeof(stl_hash_edge))
+
+/* Repairs run on every file after it loads, in this order (see stl.h).
+ * check_facets_nearby() runs up to nearby_iterations times while edges
+ * stay open, from nearby_tolerance (0: the shortest edge) up by
+ * nearby_increment (0: a ten thousandth of the bounding diameter) each
+ * time, as ADMesh does.  All off by default.
+ */
+struct stl_batch_repair
+{
+    bool  nearby;
+    float nearby_tolerance;
+    float nearby_increment;
+    int   nearby_iterations;
+    bool  remove_unconnected;
+    bool  fill_holes;
+    bool  normal_directions;
+    bool  normal_values;
+};
+
+struct stl_batch_result
+{
+    std::string input;
+    std::string output;
+    std::string stats_output;
+    stl_status  status;
+    stl_stats   stats;
+    size_t      estimated_bytes;
+    double      seconds;
+};
+
+/* Loads, repairs as set in repair and optionally rewrites as binary STL
+ * many files at once on a private thread pool.  A file given a stats
+ * output also gets stats_out() written there after its repairs.  A job is only started while the estimated memory
+ * of the running jobs, file facets times STL_BATCH_BYTES_PER_FACET, stays
+ * within the budget; a single job bigger than the whole budget runs on
+ * its own.  Jobs start in the order they were added.
+ *
+ * run() blocks until every job has finished and fills results in that
+ * order.  Its progress callback sees the fraction of finished jobs on the
+ * calling thread; returning 0 stops admitting new jobs, lets the running
+ * ones finish and marks the rest STL_CANCELLED.
+ */
+class stl_batch
+{
+public:
+    stl_batch(int threads, size_t memory_budget);
+    ~stl_batch();
+
+    void add(const char *input, const char *output,
+             const char *stats_output = NULL);
+    void run(stl_progress_fn progress, void *user_data);
+    void report(FILE *file);
+
+    static size_t estimate_bytes(const char *file);
+
+    stl_batch_repair              repair;
+    std::vector<stl_batch_result> results;
+
+private:
+    class job;
+    friend class job;
+
+    void finish(int index, const stl_batch_result &result);
+
+    QThreadPool      pool;
+    size_t           memory_budget;
+
+    QMutex           mutex;
+    QWaitCondition   changed;
+    size_t           memory_in_use;
+    int              running;
+    int              finished;
+
+    stl_batch(const stl_batch &);
+    stl_batch &operator=(const stl_batch &);
+};
+
+#endif // BATCH_H
@@ -0,0 +1,24 @@
+#-------------------------------------------------
+#
+# Benchmark driver for libsliceomatic.  Build the library first, then
+# this project from a sibling build directory, e.g.
+#
+#   qmake ../libsliceomatic && make
+#   mkdir bench && cd bench && qmake ../../libsliceomatic/bench && make
+#
+#-------------------------------------------------
+
+QT       -= gui
+
+TARGET = bench
+CONFIG   += console
+CONFIG   -= app_bundle
+TEMPLATE = app
+
+INCLUDEPATH += ..
+LIBS += -L$$OUT_PWD/.. -llibsliceomatic
+
+SOURCES += main.cpp \
+    meshgen.cpp
+
+HEADERS += meshgen.h
@@ -0,0 +1,280 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include <QtCore/QElapsedTimer>
+#include "meshgen.h"
+
+using namespace std;
+
+/* Benchmark driver.  For every requested shape and size a synthetic mesh
+ * is generated, written with the library writers, read back and pushed
+ * through the topology and export paths.  Each operation prints one line
+ * with its wall time and its throughput in facets and bytes per second.
+ *
+ *   bench [--sizes 1K,10K,...] [--shapes sphere,torus,lattice]
+ *         [--formats binary,ascii] [--dir /tmp] [--full]
+ *
+ * --full runs the whole 1K .. 50M range; the default stops at 1M so that
+ * a run finishes in a couple of minutes.
+ */
+
+typedef struct
+{
+  vector<int>           sizes;
+  vector<meshgen_shape> shapes;
+  bool                  binary_format;
+  bool                  ascii_format;
+  string                dir;
+}bench_options;
+
+static QElapsedTimer bench_timer;
+
+static long bench_file_size(const char *file)
+{
+  struct stat st;
+
+  if(stat(file, &st) != 0)
+    {
+      return 0;
+    }
+  return (long) st.st_size;
+}
+
+static void bench_start()
+{
+  bench_timer.start();
+}
+
+static void bench_report(const char *shape, const char *format, int facets,
+                         const char *op, double bytes)
+{
+  double seconds = bench_timer.nsecsElapsed() / 1e9;
+
+  if(seconds <= 0.0) seconds = 1e-9;
+  printf("%-8s %-6s %10d  %-26s %10.2f ms %10.3f Mfacet/s %10.2f MB/s\n",
+         shape, format, facets, op, seconds * 1000.0,
+         facets / seconds / 1e6, bytes / seconds / (1024.0 * 1024.0));
+  fflush(stdout);
+}
+
+static int bench_parse_count(const char *text)
+{
+  char  *end;
+  double value = strtod(text, &end);
+
+  if(*end == 'k' || *end == 'K') value *= 1000.0;
+  else if(*end == 'm' || *end == 'M') value *= 1000000.0;
+  return (int) value;
+}
+
+static void bench_parse_list(const char *text, vector<string> &items)
+{
+  string s(text);
+  size_t start = 0;
+  size_t comma;
+
+  items.clear();
+  while((comma = s.find(',', start)) != string::npos)
+    {
+      items.push_back(s.substr(start, comma - start));
+      start = comma + 1;
+    }
+  items.push_back(s.substr(start));
+}
+
+static void bench_parse_options(int argc, char **argv, bench_options *opts)
+{
+  vector<string> items;
+  int            i;
+  size_t         j;
+
+  static const int default_sizes[] = {1000, 10000, 100000, 1000000};
+  static const int full_sizes[] = {1000, 10000, 100000, 1000000,
+                                   10000000, 50000000};
+
+  opts->sizes.assign(default_sizes, default_sizes + 4);
+  opts->shapes.clear();
+  opts->shapes.push_back(meshgen_sphere);
+  opts->shapes.push_back(meshgen_torus);
+  opts->shapes.push_back(meshgen_lattice);
+  opts->binary_format = true;
+  opts->ascii_format = true;
+  opts->dir = "/tmp";
+
+  for(i = 1; i < argc; i++)
+    {
+      if(!strcmp(argv[i], "--full"))
+        {
+          opts->sizes.assign(full_sizes, full_sizes + 6);
+        }
+      else if(!strcmp(argv[i], "--sizes") && i + 1 < argc)
+        {
+          bench_parse_list(argv[++i], items);
+          opts->sizes.clear();
+          for(j = 0; j < items.size(); j++)
+            opts->sizes.push_back(bench_parse_count(items[j].c_str()));
+        }
+      else if(!strcmp(argv[i], "--shapes") && i + 1 < argc)
+        {
+          bench_parse_list(argv[++i], items);
+          opts->shapes.clear();
+          for(j = 0; j < items.size(); j++)
+            {
+              if(items[j] == "sphere") opts->shapes.push_back(meshgen_sphere);
+              else if(items[j] == "torus") opts->shapes.push_back(meshgen_torus);
+              else if(items[j] == "lattice") opts->shapes.push_back(meshgen_lattice);
+              else fprintf(stderr, "bench: unknown shape %s\n", items[j].c_str());
+            }
+        }
+      else if(!strcmp(argv[i], "--formats") && i + 1 < argc)
+        {
+          bench_parse_list(argv[++i], items);
+          opts->binary_format = false;
+          opts->ascii_format = false;
+          for(j = 0; j < items.size(); j++)
+            {
+              if(items[j] == "binary") opts->binary_format = true;
+              else if(items[j] == "ascii") opts->ascii_format = true;
+              else fprintf(stderr, "bench: unknown format %s\n", items[j].c_str());
+            }
+        }
+      else if(!strcmp(argv[i], "--dir") && i + 1 < argc)
+        {
+          opts->dir = argv[++i];
+        }
+      else
+        {
+          fprintf(stderr, "usage: %s [--sizes 1K,10K,...] "
+                  "[--shapes sphere,torus,lattice] [--formats binary,ascii] "
+                  "[--dir path] [--full]\n", argv[0]);
+          exit(1);
+        }
+    }
+}
+
+/* Read one file back and time everything downstream of stl_read. */
+static void bench_loaded(const char *shape, const char *format, char *file,
+                         const string &dir, bool exports)
+{
+  stl     mesh;
+  double  file_bytes = bench_file_size(file);
+  double  mem_bytes;
+  int     facets;
+  string  out;
+
+  bench_start();
+  mesh.open(file);
+  facets = mesh.stats.number_of_facets;
+  bench_report(shape, format, facets, "open", file_bytes);
+  mem_bytes = (double) facets * SIZEOF_STL_FACET;
+
+  bench_start();
+  mesh.check_facets_exact();
+  bench_report(shape, format, facets, "check_facets_exact", mem_bytes);
+
+  bench_start();
+  mesh.generate_shared_vertices();
+  bench_report(shape, format, facets, "generate_shared_vertices", mem_bytes);
+
+  if(exports)
+    {
+      out = dir + "/sliceomatic_bench.off";
+      bench_start();
+      mesh.write_off((char *) out.c_str());
+      bench_report(shape, format, facets, "write_off",
+                   bench_file_size(out.c_str()));
+      remove(out.c_str());
+
+      out = dir + "/sliceomatic_bench.wrl";
+      bench_start();
+      mesh.write_vrml((char *) out.c_str());
+      bench_report(shape, format, facets, "write_vrml",
+                   bench_file_size(out.c_str()));
+      remove(out.c_str());
+
+      out = dir + "/sliceomatic_bench.dxf";
+      bench_start();
+      mesh.write_dxf((char *) out.c_str(), (char *) "bench");
+      bench_report(shape, format, facets, "write_dxf",
+                   bench_file_size(out.c_str()));
+      remove(out.c_str());
+
+      out = dir + "/sliceomatic_bench.quad";
+      bench_start();
+      mesh.write_quad_object((char *) out.c_str());
+      bench_report(shape, format, facets, "write_quad_object",
+                   bench_file_size(out.c_str()));
+      remove(out.c_str());
+
+      bench_start();
+      Polyhedron p = mesh.to_polyhedron();
+      bench_report(shape, format, facets, "to_polyhedron", mem_bytes);
+      if(p.size_of_facets() != (size_t) facets)
+        {
+          fprintf(stderr, "bench: to_polyhedron lost facets\n");
+        }
+    }
+
+  mesh.close();
+}
+
+int main(int argc, char **argv)
+{
+  bench_options opts;
+  size_t        s;
+  size_t        n;
+
+  bench_parse_options(argc, argv, &opts);
+
+  printf("%-8s %-6s %10s  %-26s %13s %19s %15s\n", "shape", "format",
+         "facets", "operation", "time", "facets", "bytes");
+
+  for(s = 0; s < opts.shapes.size(); s++)
+    {
+      for(n = 0; n < opts.sizes.size(); n++)
+        {
+          const char *shape = meshgen_shape_name(opts.shapes[s]);
+          string      bin_file = opts.dir + "/sliceomatic_bench_bin.stl";
+          string      ascii_file = opts.dir + "/sliceomatic_bench_ascii.stl";
+          stl         mesh;
+          int         facets;
+
+          meshgen_generate(&mesh, opts.shapes[s], opts.sizes[n]);
+          facets = mesh.stats.number_of_facets;
+
+          if(opts.binary_format)
+            {
+              bench_start();
+              mesh.write_binary((char *) bin_file.c_str(), mesh.stats.header);
+              bench_report(shape, "binary", facets, "write_binary",
+                           bench_file_size(bin_file.c_str()));
+            }
+          if(opts.ascii_format)
+            {
+              bench_start();
+              mesh.write_ascii((char *) ascii_file.c_str(), mesh.stats.header);
+              bench_report(shape, "ascii", facets, "write_ascii",
+                           bench_file_size(ascii_file.c_str()));
+            }
+          mesh.close();
+
+          if(opts.binary_format)
+            {
+              bench_loaded(shape, "binary", (char *) bin_file.c_str(),
+                           opts.dir, true);
+              remove(bin_file.c_str());
+            }
+          if(opts.ascii_format)
+            {
+              bench_loaded(shape, "ascii", (char *) ascii_file.c_str(),
+                           opts.dir, !opts.binary_format);
+              remove(ascii_file.c_str());
+            }
+        }
+    }
+
+  return 0;
+}
@@ -0,0 +1,241 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include "meshgen.h"
+
+using namespace std;
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+static void meshgen_begin(stl *mesh, int num_facets, const char *name);
+static void meshgen_add_facet(stl *mesh, const stl_vertex &a,
+                              const stl_vertex &b, const stl_vertex &c);
+static void meshgen_add_quad(stl *mesh, const stl_vertex &a, const stl_vertex &b,
+                             const stl_vertex &c, const stl_vertex &d);
+static void meshgen_sphere_facets(stl *mesh, int target_facets);
+static void meshgen_torus_facets(stl *mesh, int target_facets);
+static void meshgen_lattice_facets(stl *mesh, int target_facets);
+
+const char *meshgen_shape_name(meshgen_shape shape)
+{
+  switch(shape)
+    {
+    case meshgen_sphere:  return "sphere";
+    case meshgen_torus:   return "torus";
+    case meshgen_lattice: return "lattice";
+    }
+  return "unknown";
+}
+
+void meshgen_generate(stl *mesh, meshgen_shape shape, int target_facets)
+{
+  switch(shape)
+    {
+    case meshgen_sphere:
+      meshgen_sphere_facets(mesh, target_facets);
+      break;
+    case meshgen_torus:
+      meshgen_torus_facets(mesh, target_facets);
+      break;
+    case meshgen_lattice:
+      meshgen_lattice_facets(mesh, target_facets);
+      break;
+    }
+}
+
+static void meshgen_begin(stl *mesh, int num_facets, const char *name)
+{
+  memset(&mesh->stats, 0, sizeof(stl_stats));
+  snprintf(mesh->stats.header, sizeof(mesh->stats.header),
+           "libsliceomatic benchmark %s", name);
+  mesh->stats.type = binary;
+  mesh->stats.volume = -1.0;
+  mesh->fp = NULL;
+  mesh->v_indices = NULL;
+  mesh->v_shared = NULL;
+  mesh->neighbors_start = NULL;
+  mesh->facet_start = (stl_facet*) calloc(num_facets, sizeof(stl_facet));
+  if(mesh->facet_start == NULL) perror("meshgen_begin");
+  mesh->stats.facets_malloced = num_facets;
+}
+
+static void meshgen_add_facet(stl *mesh, const stl_vertex &a,
+                              const stl_vertex &b, const stl_vertex &c)
+{
+  stl_facet *facet;
+  float      u[3];
+  float      v[3];
+  float      n[3];
+  float      length;
+
+  facet = &mesh->facet_start[mesh->stats.number_of_facets++];
+  facet->vertex[0] = a;
+  facet->vertex[1] = b;
+  facet->vertex[2] = c;
+
+  u[0] = b.x - a.x; u[1] = b.y - a.y; u[2] = b.z - a.z;
+  v[0] = c.x - a.x; v[1] = c.y - a.y; v[2] = c.z - a.z;
+  n[0] = u[1] * v[2] - u[2] * v[1];
+  n[1] = u[2] * v[0] - u[0] * v[2];
+  n[2] = u[0] * v[1] - u[1] * v[0];
+  length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+  if(length > 0.0)
+    {
+      n[0] /= length; n[1] /= length; n[2] /= length;
+    }
+  facet->normal.x = n[0];
+  facet->normal.y = n[1];
+  facet->normal.z = n[2];
+}
+
+static void meshgen_add_quad(stl *mesh, const stl_vertex &a, const stl_vertex &b,
+                             const stl_vertex &c, const stl_vertex &d)
+{
+  meshgen_add_facet(mesh, a, b, c);
+  meshgen_add_facet(mesh, a, c, d);
+}
+
+/* UV sphere with twice as many slices as stacks: 4 * stacks^2 - 2 * slices
+ * facets.  Grid vertices are computed once so that shared corners are
+ * bit-identical and weld exactly.
+ */
+static void meshgen_sphere_facets(stl *mesh, int target_facets)
+{
+  int stacks;
+  int slices;
+  int i;
+  int j;
+  vector<stl_vertex> grid;
+  stl_vertex north;
+  stl_vertex south;
+  float radius = 50.0;
+
+  stacks = (int) sqrt(target_facets / 4.0);
+  if(stacks < 2) stacks = 2;
+  slices = 2 * stacks;
+
+  grid.resize((stacks - 1) * slices);
+  for(i = 1; i < stacks; i++)
+    {
+      double phi = M_PI * i / stacks;
+      for(j = 0; j < slices; j++)
+        {
+          double theta = 2.0 * M_PI * j / slices;
+          stl_vertex &p = grid[(i - 1) * slices + j];
+          p.x = radius * sin(phi) * cos(theta);
+          p.y = radius * sin(phi) * sin(theta);
+          p.z = radius * cos(phi);
+        }
+    }
+  north.x = 0.0; north.y = 0.0; north.z = radius;
+  south.x = 0.0; south.y = 0.0; south.z = -radius;
+
+  meshgen_begin(mesh, 2 * slices * (stacks - 1), "sphere");
+
+  for(j = 0; j < slices; j++)
+    {
+      int next = (j + 1) % slices;
+      meshgen_add_facet(mesh, north, grid[j], grid[next]);
+      meshgen_add_facet(mesh, south, grid[(stacks - 2) * slices + next],
+                        grid[(stacks - 2) * slices + j]);
+    }
+  for(i = 0; i < stacks - 2; i++)
+    {
+      for(j = 0; j < slices; j++)
+        {
+          int next = (j + 1) % slices;
+          meshgen_add_quad(mesh, grid[i * slices + j],
+                           grid[(i + 1) * slices + j],
+                           grid[(i + 1) * slices + next],
+                           grid[i * slices + next]);
+        }
+    }
+}
+
+/* Torus with a 2:1 ring/tube resolution: 4 * tube^2 facets. */
+static void meshgen_torus_facets(stl *mesh, int target_facets)
+{
+  int ring;
+  int tube;
+  int i;
+  int j;
+  vector<stl_vertex> grid;
+  float major = 40.0;
+  float minor = 12.0;
+
+  tube = (int) sqrt(target_facets / 4.0);
+  if(tube < 3) tube = 3;
+  ring = 2 * tube;
+
+  grid.resize(ring * tube);
+  for(i = 0; i < ring; i++)
+    {
+      double u = 2.0 * M_PI * i / ring;
+      for(j = 0; j < tube; j++)
+        {
+          double v = 2.0 * M_PI * j / tube;
+          stl_vertex &p = grid[i * tube + j];
+          p.x = (major + minor * cos(v)) * cos(u);
+          p.y = (major + minor * cos(v)) * sin(u);
+          p.z = minor * sin(v);
+        }
+    }
+
+  meshgen_begin(mesh, 2 * ring * tube, "torus");
+
+  for(i = 0; i < ring; i++)
+    {
+      int next_i = (i + 1) % ring;
+      for(j = 0; j < tube; j++)
+        {
+          int next_j = (j + 1) % tube;
+          meshgen_add_quad(mesh, grid[i * tube + j],
+                           grid[next_i * tube + j],
+                           grid[next_i * tube + next_j],
+                           grid[i * tube + next_j]);
+        }
+    }
+}
+
+/* A cubic lattice of separate boxes, 12 facets each.  This stresses the
+ * many-small-parts case (lots of shells, short edges) rather than one
+ * large smooth surface.
+ */
+static void meshgen_lattice_facets(stl *mesh, int target_facets)
+{
+  int cells;
+  int i;
+  int j;
+  int k;
+  float pitch = 2.0;
+  float side = 1.5;
+
+  cells = (int) cbrt(target_facets / 12.0);
+  if(cells < 1) cells = 1;
+
+  meshgen_begin(mesh, 12 * cells * cells * cells, "lattice");
+
+  for(i = 0; i < cells; i++)
+    for(j = 0; j < cells; j++)
+      for(k = 0; k < cells; k++)
+        {
+          stl_vertex c[8];
+          int        n;
+
+          for(n = 0; n < 8; n++)
+            {
+              c[n].x = i * pitch + ((n & 1) ? side : 0.0);
+              c[n].y = j * pitch + ((n & 2) ? side : 0.0);
+              c[n].z = k * pitch + ((n & 4) ? side : 0.0);
+            }
+          meshgen_add_quad(mesh, c[0], c[2], c[3], c[1]); /* -z */
+          meshgen_add_quad(mesh, c[4], c[5], c[7], c[6]); /* +z */
+          meshgen_add_quad(mesh, c[0], c[1], c[5], c[4]); /* -y */
+          meshgen_add_quad(mesh, c[2], c[6], c[7], c[3]); /* +y */
+          meshgen_add_quad(mesh, c[0], c[4], c[6], c[2]); /* -x */
+          meshgen_add_quad(mesh, c[1], c[3], c[7], c[5]); /* +x */
+        }
+}
@@ -0,0 +1,18 @@
+#ifndef MESHGEN_H
+#define MESHGEN_H
+
+#include "stl.h"
+
+/* Deterministic synthetic meshes for the benchmark.  Each generator fills
+ * facet_start with a closed, exactly welded surface of roughly
+ * target_facets facets, so the result can be written out and read back
+ * through the normal library paths.  The mesh must be released with
+ * stl::close().
+ */
+
+typedef enum {meshgen_sphere, meshgen_torus, meshgen_lattice} meshgen_shape;
+
+void meshgen_generate(stl *mesh, meshgen_shape shape, int target_facets);
+const char *meshgen_shape_name(meshgen_shape shape);
+
+#endif // MESHGEN_H
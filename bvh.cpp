@@ -0,0 +1,904 @@
+#include <math.h>
+#include <float.h>
+#include <string.h>
+#include <algorithm>
+#include "bvh.h"
+#include "parallel.h"
+
+using namespace std;
+
+#define BVH_BINS          16
+#define BVH_MAX_LEAF      4
+#define BVH_STACK         128
+/* Below this depth splits are plain medians, which bounds the depth (and
+   the traversal stack) whatever the input looks like. */
+#define BVH_SAH_DEPTH     48
+/* Subtrees smaller than this are not worth a task of their own. */
+#define BVH_TASK_MIN      4096
+/* Widens the far end of the slab test by 1 + 2 gamma(3) so rounding
+   never culls a box the ray only grazes (Ize, Robust BVH Ray
+   Traversal). */
+#define BVH_ROBUST_SLACK  1.00000036f
+
+typedef struct
+{
+  float min[3];
+  float max[3];
+}stl_bvh_bounds;
+
+/* Per-facet data used while building. */
+typedef struct
+{
+  vector<stl_bvh_bounds> bounds;
+  vector<float>          centroid;   /* 3 per facet */
+}stl_bvh_input;
+
+typedef struct
+{
+  int begin;
+  int end;
+  int depth;
+}stl_bvh_task;
+
+static void stl_bvh_bounds_empty(stl_bvh_bounds *b);
+static void stl_bvh_bounds_grow(stl_bvh_bounds *b, const stl_bvh_bounds *o);
+static float stl_bvh_bounds_area(const stl_bvh_bounds *b);
+static int stl_bvh_split(const stl_bvh_input &input, int *order, int begin,
+                         int end, int median, stl_bvh_bounds *bounds);
+static void stl_bvh_build(const stl_bvh_input &input, int *order, int begin,
+                          int end, int depth, vector<stl_bvh_node> &nodes);
+static void stl_bvh_build_top(const stl_bvh_input &input, int *order,
+                              int begin, int end, int depth, int tasks_wanted,
+                              vector<stl_bvh_node> &nodes,
+                              vector<stl_bvh_task> &tasks);
+static void stl_bvh_flatten(const vector<stl_bvh_node> &top, int node,
+                            const vector<vector<stl_bvh_node> > &subtrees,
+                            vector<stl_bvh_node> &out);
+static float stl_bvh_box_distance2(const stl_bvh_node *node,
+                                   const stl_vertex &p);
+static int stl_bvh_ray_box(const stl_bvh_node *node, const float *origin,
+                           const float *inverse, float t_max, float *t_near);
+static int stl_bvh_ray_triangle(const float *tri, const float *origin,
+                                const float *direction, float *t, float *u,
+                                float *v);
+static void stl_bvh_closest_on_triangle(const float *tri, const float *p,
+                                        float *closest);
+
+static void stl_bvh_bounds_empty(stl_bvh_bounds *b)
+{
+  b->min[0] = b->min[1] = b->min[2] = FLT_MAX;
+  b->max[0] = b->max[1] = b->max[2] = -FLT_MAX;
+}
+
+static void stl_bvh_bounds_grow(stl_bvh_bounds *b, const stl_bvh_bounds *o)
+{
+  int k;
+
+  for(k = 0; k < 3; k++)
+    {
+      b->min[k] = STL_MIN(b->min[k], o->min[k]);
+      b->max[k] = STL_MAX(b->max[k], o->max[k]);
+    }
+}
+
+static float stl_bvh_bounds_area(const stl_bvh_bounds *b)
+{
+  float dx = b->max[0] - b->min[0];
+  float dy = b->max[1] - b->min[1];
+  float dz = b->max[2] - b->min[2];
+
+  if(dx < 0.0 || dy < 0.0 || dz < 0.0)
+    {
+      return 0.0;
+    }
+  return 2.0 * (dx * dy + dy * dz + dz * dx);
+}
+
+/* Picks the cheapest binned SAH split of order[begin, end) and partitions
+ * it.  Returns the split point, or -1 if a leaf is cheaper.
+ */
+static int stl_bvh_split(const stl_bvh_input &input, int *order, int begin,
+                         int end, int median, stl_bvh_bounds *bounds)
+{
+  stl_bvh_bounds centroids;
+  float          best_cost;
+  int            best_axis = -1;
+  int            best_bin = -1;
+  int            count = end - begin;
+  int            axis;
+  int            i;
+
+  stl_bvh_bounds_empty(bounds);
+  stl_bvh_bounds_empty(&centroids);
+  for(i = begin; i < end; i++)
+    {
+      const float   *c = &input.centroid[3 * order[i]];
+      stl_bvh_bounds point = {{c[0], c[1], c[2]}, {c[0], c[1], c[2]}};
+      stl_bvh_bounds_grow(bounds, &input.bounds[order[i]]);
+      stl_bvh_bounds_grow(&centroids, &point);
+    }
+  if(count <= BVH_MAX_LEAF)
+    {
+      return -1;
+    }
+  if(median)
+    {
+      float extent[3] = {centroids.max[0] - centroids.min[0],
+                         centroids.max[1] - centroids.min[1],
+                         centroids.max[2] - centroids.min[2]};
+      axis = extent[0] > extent[1] ? (extent[0] > extent[2] ? 0 : 2)
+                                   : (extent[1] > extent[2] ? 1 : 2);
+      nth_element(order + begin, order + begin + count / 2, order + end,
+                  [&](int a, int b)
+        {
+          return input.centroid[3 * a + axis] < input.centroid[3 * b + axis];
+        });
+      return begin + count / 2;
+    }
+
+  best_cost = stl_bvh_bounds_area(bounds) * count;
+  for(axis = 0; axis < 3; axis++)
+    {
+      float          lo = centroids.min[axis];
+      float          extent = centroids.max[axis] - lo;
+      stl_bvh_bounds bin_bounds[BVH_BINS];
+      int            bin_count[BVH_BINS];
+      float          right_area[BVH_BINS];
+      int            right_count[BVH_BINS];
+      stl_bvh_bounds acc;
+      int            n;
+      int            b;
+
+      if(extent <= 0.0)
+        {
+          continue;
+        }
+      for(b = 0; b < BVH_BINS; b++)
+        {
+          stl_bvh_bounds_empty(&bin_bounds[b]);
+          bin_count[b] = 0;
+        }
+      for(i = begin; i < end; i++)
+        {
+          b = (int) ((input.centroid[3 * order[i] + axis] - lo) / extent
+                     * BVH_BINS);
+          b = STL_MIN(b, BVH_BINS - 1);
+          bin_count[b]++;
+          stl_bvh_bounds_grow(&bin_bounds[b], &input.bounds[order[i]]);
+        }
+
+      stl_bvh_bounds_empty(&acc);
+      n = 0;
+      for(b = BVH_BINS - 1; b > 0; b--)
+        {
+          stl_bvh_bounds_grow(&acc, &bin_bounds[b]);
+          n += bin_count[b];
+          right_area[b] = stl_bvh_bounds_area(&acc);
+          right_count[b] = n;
+        }
+      stl_bvh_bounds_empty(&acc);
+      n = 0;
+      for(b = 0; b < BVH_BINS - 1; b++)
+        {
+          float cost;
+
+          stl_bvh_bounds_grow(&acc, &bin_bounds[b]);
+          n += bin_count[b];
+          if(n == 0 || right_count[b + 1] == 0)
+            {
+              continue;
+            }
+          cost = stl_bvh_bounds_area(&acc) * n
+               + right_area[b + 1] * right_count[b + 1];
+          if(cost < best_cost)
+            {
+              best_cost = cost;
+              best_axis = axis;
+              best_bin = b;
+            }
+        }
+    }
+
+  if(best_axis == -1)
+    {
+      /* No useful split; fall back to halves if the leaf would be big. */
+      if(count <= 4 * BVH_MAX_LEAF)
+        {
+          return -1;
+        }
+      return begin + count / 2;
+    }
+
+  float lo = centroids.min[best_axis];
+  float extent = centroids.max[best_axis] - lo;
+  int  *mid = partition(order + begin, order + end, [&](int facet)
+    {
+      int b = (int) ((input.centroid[3 * facet + best_axis] - lo) / extent
+                     * BVH_BINS);
+      return STL_MIN(b, BVH_BINS - 1) <= best_bin;
+    });
+  return (int) (mid - order);
+}
+
+static void stl_bvh_build(const stl_bvh_input &input, int *order, int begin,
+                          int end, int depth, vector<stl_bvh_node> &nodes)
+{
+  stl_bvh_bounds bounds;
+  int            split;
+  int            index = (int) nodes.size();
+
+  split = stl_bvh_split(input, order, begin, end, depth >= BVH_SAH_DEPTH,
+                        &bounds);
+  nodes.push_back(stl_bvh_node());
+  memcpy(nodes[index].min, bounds.min, sizeof(bounds.min));
+  memcpy(nodes[index].max, bounds.max, sizeof(bounds.max));
+  if(split == -1)
+    {
+      nodes[index].start = begin;
+      nodes[index].count = end - begin;
+      return;
+    }
+  nodes[index].count = 0;
+  stl_bvh_build(input, order, begin, split, depth + 1, nodes);
+  nodes[index].start = (int) nodes.size();
+  stl_bvh_build(input, order, split, end, depth + 1, nodes);
+}
+
+/* Splits serially until there are enough independent subtrees to keep the
+ * pool busy.  A node with count == -1 stands for task number start.
+ */
+static void stl_bvh_build_top(const stl_bvh_input &input, int *order,
+                              int begin, int end, int depth, int tasks_wanted,
+                              vector<stl_bvh_node> &nodes,
+                              vector<stl_bvh_task> &tasks)
+{
+  stl_bvh_bounds bounds;
+  int            split;
+  int            index = (int) nodes.size();
+
+  nodes.push_back(stl_bvh_node());
+  if(tasks_wanted <= 1 || end - begin < 2 * BVH_TASK_MIN)
+    {
+      stl_bvh_task task = {begin, end, depth};
+      nodes[index].start = (int) tasks.size();
+      nodes[index].count = -1;
+      tasks.push_back(task);
+      return;
+    }
+
+  split = stl_bvh_split(input, order, begin, end, 0, &bounds);
+  memcpy(nodes[index].min, bounds.min, sizeof(bounds.min));
+  memcpy(nodes[index].max, bounds.max, sizeof(bounds.max));
+  if(split == -1)
+    {
+      nodes[index].start = begin;
+      nodes[index].count = end - begin;
+      return;
+    }
+  nodes[index].count = 0;
+  stl_bvh_build_top(input, order, begin, split, depth + 1, tasks_wanted / 2,
+                    nodes, tasks);
+  nodes[index].start = (int) nodes.size();
+  stl_bvh_build_top(input, order, split, end, depth + 1,
+                    tasks_wanted - tasks_wanted / 2, nodes, tasks);
+}
+
+/* Lays the top of the tree and the task subtrees out depth first. */
+static void stl_bvh_flatten(const vector<stl_bvh_node> &top, int node,
+                            const vector<vector<stl_bvh_node> > &subtrees,
+                            vector<stl_bvh_node> &out)
+{
+  int index = (int) out.size();
+
+  if(top[node].count == -1)
+    {
+      const vector<stl_bvh_node> &subtree = subtrees[top[node].start];
+      size_t                      i;
+
+      for(i = 0; i < subtree.size(); i++)
+        {
+          out.push_back(subtree[i]);
+          if(subtree[i].count == 0)
+            {
+              out.back().start += index;
+            }
+        }
+      return;
+    }
+  out.push_back(top[node]);
+  if(top[node].count > 0)
+    {
+      return;
+    }
+  stl_bvh_flatten(top, node + 1, subtrees, out);
+  out[index].start = (int) out.size();
+  stl_bvh_flatten(top, top[node].start, subtrees, out);
+}
+
+stl_bvh::stl_bvh(const stl &mesh)
+{
+  stl_bvh_input                  input;
+  vector<stl_bvh_node>           top;
+  vector<stl_bvh_task>           tasks;
+  vector<vector<stl_bvh_node> >  subtrees;
+  int                            n = mesh.stats.number_of_facets;
+  int                            i;
+
+  if(n == 0)
+    {
+      return;
+    }
+
+  input.bounds.resize(n);
+  input.centroid.resize(3 * n);
+  order.resize(n);
+  stl_parallel_for(n, 4096, [&](int begin, int end)
+    {
+      for(int f = begin; f < end; f++)
+        {
+          stl_facet         facet = mesh.get_facet(f);
+          const stl_vertex *v = facet.vertex;
+          stl_bvh_bounds   &b = input.bounds[f];
+          b.min[0] = STL_MIN(v[0].x, STL_MIN(v[1].x, v[2].x));
+          b.min[1] = STL_MIN(v[0].y, STL_MIN(v[1].y, v[2].y));
+          b.min[2] = STL_MIN(v[0].z, STL_MIN(v[1].z, v[2].z));
+          b.max[0] = STL_MAX(v[0].x, STL_MAX(v[1].x, v[2].x));
+          b.max[1] = STL_MAX(v[0].y, STL_MAX(v[1].y, v[2].y));
+          b.max[2] = STL_MAX(v[0].z, STL_MAX(v[1].z, v[2].z));
+          input.centroid[3 * f] = (b.min[0] + b.max[0]) * 0.5;
+          input.centroid[3 * f + 1] = (b.min[1] + b.max[1]) * 0.5;
+          input.centroid[3 * f + 2] = (b.min[2] + b.max[2]) * 0.5;
+          order[f] = f;
+        }
+    });
+
+  stl_bvh_build_top(input, &order[0], 0, n, 0,
+                    4 * QThread::idealThreadCount(), top, tasks);
+  subtrees.resize(tasks.size());
+  stl_parallel_for((int) tasks.size(), 1, [&](int begin, int end)
+    {
+      for(int t = begin; t < end; t++)
+        {
+          stl_bvh_build(input, &order[0], tasks[t].begin, tasks[t].end,
+                        tasks[t].depth, subtrees[t]);
+        }
+    });
+  nodes.reserve(top.size() + 2 * n / BVH_MAX_LEAF);
+  stl_bvh_flatten(top, 0, subtrees, nodes);
+
+  triangles.resize(9 * n);
+  for(i = 0; i < n; i++)
+    {
+      stl_facet facet = mesh.get_facet(order[i]);
+      memcpy(&triangles[9 * i], facet.vertex, 9 * sizeof(float));
+    }
+}
+
+static int stl_bvh_ray_box(const stl_bvh_node *node, const float *origin,
+                           const float *inverse, float t_max, float *t_near)
+{
+  float t0 = 0.0;
+  float t1 = t_max;
+  int   k;
+
+  for(k = 0; k < 3; k++)
+    {
+      float a = (node->min[k] - origin[k]) * inverse[k];
+      float b = (node->max[k] - origin[k]) * inverse[k];
+      if(a > b)
+        {
+          float swap = a;
+          a = b;
+          b = swap;
+        }
+      t0 = a > t0 ? a : t0;
+      t1 = b < t1 ? b : t1;
+      if(t0 > t1)
+        {
+          return 0;
+        }
+    }
+  *t_near = t0;
+  return 1;
+}
+
+/* Moller-Trumbore; hits behind the origin don't count. */
+static int stl_bvh_ray_triangle(const float *tri, const float *origin,
+                                const float *direction, float *t, float *u,
+                                float *v)
+{
+  float e1[3] = {tri[3] - tri[0], tri[4] - tri[1], tri[5] - tri[2]};
+  float e2[3] = {tri[6] - tri[0], tri[7] - tri[1], tri[8] - tri[2]};
+  float p[3] = {direction[1] * e2[2] - direction[2] * e2[1],
+                direction[2] * e2[0] - direction[0] * e2[2],
+                direction[0] * e2[1] - direction[1] * e2[0]};
+  float det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+  float inv;
+  float s[3];
+  float q[3];
+
+  if(det == 0.0)
+    {
+      return 0;
+    }
+  inv = 1.0 / det;
+  s[0] = origin[0] - tri[0];
+  s[1] = origin[1] - tri[1];
+  s[2] = origin[2] - tri[2];
+  *u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inv;
+  if(*u < 0.0 || *u > 1.0)
+    {
+      return 0;
+    }
+  q[0] = s[1] * e1[2] - s[2] * e1[1];
+  q[1] = s[2] * e1[0] - s[0] * e1[2];
+  q[2] = s[0] * e1[1] - s[1] * e1[0];
+  *v = (direction[0] * q[0] + direction[1] * q[1] + direction[2] * q[2]) * inv;
+  if(*v < 0.0 || *u + *v > 1.0)
+    {
+      return 0;
+    }
+  *t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inv;
+  return *t >= 0.0;
+}
+
+stl_ray_hit stl_bvh::ray_cast(const stl_ray &ray) const
+{
+  stl_ray_hit hit;
+  int         stack[BVH_STACK];
+  int         top = 0;
+  float       origin[3] = {ray.origin.x, ray.origin.y, ray.origin.z};
+  float       direction[3] = {ray.direction.x, ray.direction.y,
+                              ray.direction.z};
+  float       inverse[3];
+  float       t_near;
+  int         k;
+
+  hit.facet = -1;
+  hit.t = ray.t_max;
+  hit.u = 0.0;
+  hit.v = 0.0;
+  if(nodes.empty())
+    {
+      return hit;
+    }
+  for(k = 0; k < 3; k++)
+    {
+      inverse[k] = 1.0 / direction[k];
+    }
+
+  stack[top++] = 0;
+  while(top > 0)
+    {
+      const stl_bvh_node *node = &nodes[stack[--top]];
+
+      if(!stl_bvh_ray_box(node, origin, inverse, hit.t, &t_near))
+        {
+          continue;
+        }
+      if(node->count > 0)
+        {
+          int i;
+          for(i = node->start; i < node->start + node->count; i++)
+            {
+              float t;
+              float u;
+              float v;
+              if(stl_bvh_ray_triangle(&triangles[9 * i], origin, direction,
+                                      &t, &u, &v) && t < hit.t)
+                {
+                  hit.facet = order[i];
+                  hit.t = t;
+                  hit.u = u;
+                  hit.v = v;
+                }
+            }
+          continue;
+        }
+
+      /* Visit the nearer child first. */
+      int left = (int) (node - &nodes[0]) + 1;
+      int right = node->start;
+      float t_left;
+      float t_right;
+      int hit_left = stl_bvh_ray_box(&nodes[left], origin, inverse, hit.t,
+                                     &t_left);
+      int hit_right = stl_bvh_ray_box(&nodes[right], origin, inverse, hit.t,
+                                      &t_right);
+      if(hit_left && hit_right)
+        {
+          if(t_left < t_right)
+            {
+              stack[top++] = right;
+              stack[top++] = left;
+            }
+          else
+            {
+              stack[top++] = left;
+              stack[top++] = right;
+            }
+        }
+      else if(hit_left)
+        {
+          stack[top++] = left;
+        }
+      else if(hit_right)
+        {
+          stack[top++] = right;
+        }
+    }
+  return hit;
+}
+
+static float stl_bvh_box_distance2(const stl_bvh_node *node,
+                                   const stl_vertex &p)
+{
+  float c[3] = {p.x, p.y, p.z};
+  float d2 = 0.0;
+  int   k;
+
+  for(k = 0; k < 3; k++)
+    {
+      float d = 0.0;
+      if(c[k] < node->min[k]) d = node->min[k] - c[k];
+      else if(c[k] > node->max[k]) d = c[k] - node->max[k];
+      d2 += d * d;
+    }
+  return d2;
+}
+
+/* Closest point on a triangle (Ericson, Real-Time Collision Detection). */
+static void stl_bvh_closest_on_triangle(const float *tri, const float *p,
+                                        float *closest)
+{
+  const float *a = tri;
+  const float *b = tri + 3;
+  const float *c = tri + 6;
+  float ab[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+  float ac[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+  float ap[3] = {p[0] - a[0], p[1] - a[1], p[2] - a[2]};
+  float bp[3] = {p[0] - b[0], p[1] - b[1], p[2] - b[2]};
+  float cp[3] = {p[0] - c[0], p[1] - c[1], p[2] - c[2]};
+  float d1 = ab[0] * ap[0] + ab[1] * ap[1] + ab[2] * ap[2];
+  float d2 = ac[0] * ap[0] + ac[1] * ap[1] + ac[2] * ap[2];
+  float d3 = ab[0] * bp[0] + ab[1] * bp[1] + ab[2] * bp[2];
+  float d4 = ac[0] * bp[0] + ac[1] * bp[1] + ac[2] * bp[2];
+  float d5 = ab[0] * cp[0] + ab[1] * cp[1] + ab[2] * cp[2];
+  float d6 = ac[0] * cp[0] + ac[1] * cp[1] + ac[2] * cp[2];
+  float va;
+  float vb;
+  float vc;
+  float v;
+  float w;
+  float denom;
+  int   k;
+
+  if(d1 <= 0.0 && d2 <= 0.0)
+    {
+      memcpy(closest, a, 3 * sizeof(float));
+      return;
+    }
+  if(d3 >= 0.0 && d4 <= d3)
+    {
+      memcpy(closest, b, 3 * sizeof(float));
+      return;
+    }
+  vc = d1 * d4 - d3 * d2;
+  if(vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0)
+    {
+      v = d1 / (d1 - d3);
+      for(k = 0; k < 3; k++) closest[k] = a[k] + v * ab[k];
+      return;
+    }
+  if(d6 >= 0.0 && d5 <= d6)
+    {
+      memcpy(closest, c, 3 * sizeof(float));
+      return;
+    }
+  vb = d5 * d2 - d1 * d6;
+  if(vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0)
+    {
+      w = d2 / (d2 - d6);
+      for(k = 0; k < 3; k++) closest[k] = a[k] + w * ac[k];
+      return;
+    }
+  va = d3 * d6 - d5 * d4;
+  if(va <= 0.0 && (d4 - d3) >= 0.0 && (d5 - d6) >= 0.0)
+    {
+      w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+      for(k = 0; k < 3; k++) closest[k] = b[k] + w * (c[k] - b[k]);
+      return;
+    }
+  denom = 1.0 / (va + vb + vc);
+  v = vb * denom;
+  w = vc * denom;
+  for(k = 0; k < 3; k++) closest[k] = a[k] + ab[k] * v + ac[k] * w;
+}
+
+stl_nearest stl_bvh::nearest_point(const stl_vertex &point) const
+{
+  stl_nearest nearest;
+  int         stack[BVH_STACK];
+  int         top = 0;
+  float       best = FLT_MAX;
+  float       p[3] = {point.x, point.y, point.z};
+
+  nearest.facet = -1;
+  nearest.distance = FLT_MAX;
+  nearest.point = point;
+  if(nodes.empty())
+    {
+      return nearest;
+    }
+
+  stack[top++] = 0;
+  while(top > 0)
+    {
+      const stl_bvh_node *node = &nodes[stack[--top]];
+
+      if(stl_bvh_box_distance2(node, point) >= best)
+        {
+          continue;
+        }
+      if(node->count > 0)
+        {
+          int i;
+          for(i = node->start; i < node->start + node->count; i++)
+            {
+              float c[3];
+              float d2;
+              stl_bvh_closest_on_triangle(&triangles[9 * i], p, c);
+              d2 = (c[0] - p[0]) * (c[0] - p[0]) + (c[1] - p[1]) * (c[1] - p[1])
+                 + (c[2] - p[2]) * (c[2] - p[2]);
+              if(d2 < best)
+                {
+                  best = d2;
+                  nearest.facet = order[i];
+                  nearest.point.x = c[0];
+                  nearest.point.y = c[1];
+                  nearest.point.z = c[2];
+                }
+            }
+          continue;
+        }
+
+      int left = (int) (node - &nodes[0]) + 1;
+      int right = node->start;
+      if(stl_bvh_box_distance2(&nodes[left], point)
+         < stl_bvh_box_distance2(&nodes[right], point))
+        {
+          stack[top++] = right;
+          stack[top++] = left;
+        }
+      else
+        {
+          stack[top++] = left;
+          stack[top++] = right;
+        }
+    }
+  nearest.distance = sqrt(best);
+  return nearest;
+}
+
+/* A ray in the sheared frame of Woop, Benthin and Wald's watertight
+ * test: kz is the axis the ray runs along most, and after the shear the
+ * ray is the +z axis through the origin.
+ */
+typedef struct
+{
+  float origin[3];
+  int   kx;
+  int   ky;
+  int   kz;
+  float sx;
+  float sy;
+  float sz;
+}stl_bvh_sheared_ray;
+
+static void stl_bvh_shear_ray(const float *origin, const float *direction,
+                              stl_bvh_sheared_ray *ray)
+{
+  int k;
+
+  for(k = 0; k < 3; k++)
+    {
+      ray->origin[k] = origin[k];
+    }
+  ray->kz = 0;
+  for(k = 1; k < 3; k++)
+    {
+      if(fabs(direction[k]) > fabs(direction[ray->kz]))
+        {
+          ray->kz = k;
+        }
+    }
+  ray->kx = (ray->kz + 1) % 3;
+  ray->ky = (ray->kx + 1) % 3;
+  if(direction[ray->kz] < 0.0)
+    {
+      k = ray->kx;
+      ray->kx = ray->ky;
+      ray->ky = k;
+    }
+  ray->sx = direction[ray->kx] / direction[ray->kz];
+  ray->sy = direction[ray->ky] / direction[ray->kz];
+  ray->sz = 1.0f / direction[ray->kz];
+}
+
+/* Sign of the edge function of p -> q at the ray.  The products of the
+ * float coordinates are exact in double, so the sign is exact and an
+ * edge shared by two facets gets opposite signs in each.  A ray right
+ * on the edge is given to the side the edge's direction picks, which
+ * also flips with the edge, so exactly one of the two facets takes it.
+ */
+static int stl_bvh_edge_sign(const float *p, const float *q)
+{
+  double e = (double) q[0] * p[1] - (double) q[1] * p[0];
+
+  if(e != 0.0)
+    {
+      return e > 0.0 ? 1 : -1;
+    }
+  return q[1] > p[1] || (q[1] == p[1] && q[0] > p[0]) ? 1 : -1;
+}
+
+/* Watertight ray-triangle test: +1 or -1 by the side the ray crosses
+ * from (the sign of direction . normal), 0 for a miss or a hit behind
+ * the origin.  A ray through an edge or vertex shared by a consistently
+ * wound surface counts exactly once; one that grazes a fold counts
+ * once each way, which cancels.
+ */
+static int stl_bvh_ray_crossing(const float *tri,
+                                const stl_bvh_sheared_ray &ray)
+{
+  float  p[3][2];
+  double z[3];
+  double u;
+  double v;
+  double w;
+  double det;
+  double t;
+  int    sign;
+  int    c;
+
+  for(c = 0; c < 3; c++)
+    {
+      float a[3] = {tri[3 * c] - ray.origin[0], tri[3 * c + 1] - ray.origin[1],
+                    tri[3 * c + 2] - ray.origin[2]};
+      p[c][0] = a[ray.kx] - ray.sx * a[ray.kz];
+      p[c][1] = a[ray.ky] - ray.sy * a[ray.kz];
+      z[c] = ray.sz * a[ray.kz];
+    }
+
+  sign = stl_bvh_edge_sign(p[1], p[2]);
+  if(stl_bvh_edge_sign(p[2], p[0]) != sign
+     || stl_bvh_edge_sign(p[0], p[1]) != sign)
+    {
+      return 0;
+    }
+
+  u = (double) p[2][0] * p[1][1] - (double) p[2][1] * p[1][0];
+  v = (double) p[0][0] * p[2][1] - (double) p[0][1] * p[2][0];
+  w = (double) p[1][0] * p[0][1] - (double) p[1][1] * p[0][0];
+  det = u + v + w;
+  t = u * z[0] + v * z[1] + w * z[2];
+  if(det == 0.0 || (det > 0.0 ? t < 0.0 : t > 0.0))
+    {
+      return 0;
+    }
+  return -sign;
+}
+
+static int stl_bvh_ray_box_robust(const stl_bvh_node *node,
+                                  const float *origin, const float *inverse)
+{
+  float t0 = 0.0;
+  float t1 = FLT_MAX;
+  int   k;
+
+  for(k = 0; k < 3; k++)
+    {
+      float a = (node->min[k] - origin[k]) * inverse[k];
+      float b = (node->max[k] - origin[k]) * inverse[k];
+      if(a > b)
+        {
+          float swap = a;
+          a = b;
+          b = swap;
+        }
+      b *= BVH_ROBUST_SLACK;
+      t0 = a > t0 ? a : t0;
+      t1 = b < t1 ? b : t1;
+      if(t0 > t1)
+        {
+          return 0;
+        }
+    }
+  return 1;
+}
+
+/* Counts signed crossings along a ray: +1 where the ray leaves through a
+ * facet, -1 where it enters.  For a closed, outward facing mesh this is 1
+ * inside and 0 outside; nested shells add up.  The crossing test is
+ * watertight, so a ray through an edge or a vertex of the mesh is still
+ * counted once; the direction is skewed only to keep such rays rare.
+ */
+int stl_bvh::winding_number(const stl_vertex &point) const
+{
+  int                 stack[BVH_STACK];
+  int                 top = 0;
+  int                 winding = 0;
+  float               origin[3] = {point.x, point.y, point.z};
+  float               direction[3] = {0.8684735f, 0.3937621f, 0.3011744f};
+  float               inverse[3];
+  stl_bvh_sheared_ray ray;
+  int                 k;
+
+  if(nodes.empty())
+    {
+      return 0;
+    }
+  for(k = 0; k < 3; k++)
+    {
+      inverse[k] = 1.0 / direction[k];
+    }
+  stl_bvh_shear_ray(origin, direction, &ray);
+
+  stack[top++] = 0;
+  while(top > 0)
+    {
+      const stl_bvh_node *node = &nodes[stack[--top]];
+
+      if(!stl_bvh_ray_box_robust(node, origin, inverse))
+        {
+          continue;
+        }
+      if(node->count > 0)
+        {
+          int i;
+          for(i = node->start; i < node->start + node->count; i++)
+            {
+              winding += stl_bvh_ray_crossing(&triangles[9 * i], ray);
+            }
+          continue;
+        }
+      stack[top++] = (int) (node - &nodes[0]) + 1;
+      stack[top++] = node->start;
+    }
+  return winding;
+}
+
+void stl_bvh::ray_cast(const stl_ray *rays, int count, stl_ray_hit *hits) const
+{
+  stl_parallel_for(count, 256, [&](int begin, int end)
+    {
+      for(int i = begin; i < end; i++)
+        {
+          hits[i] = ray_cast(rays[i]);
+        }
+    });
+}
+
+void stl_bvh::nearest_point(const stl_vertex *points, int count,
+                            stl_nearest *nearest) const
+{
+  stl_parallel_for(count, 256, [&](int begin, int end)
+    {
+      for(int i = begin; i < end; i++)
+        {
+          nearest[i] = nearest_point(points[i]);
+        }
+    });
+}
+
+void stl_bvh::winding_number(const stl_vertex *points, int count,
+                             int *winding) const
+{
+  stl_parallel_for(count, 256, [&](int begin, int end)
+    {
+      for(int i = begin; i < end; i++)
+        {
+          winding[i] = winding_number(points[i]);
+        }
+    });
+}
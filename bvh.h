@@ -0,0 +1,69 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <vector>
+#include "stl.h"
+
+/* 32 bytes.  Nodes are stored depth first, so an inner node's left child
+ * is the next node and start holds the index of its right child.  A leaf
+ * has count > 0 and covers order[start .. start + count).
+ */
+typedef struct
+{
+  float min[3];
+  float max[3];
+  int   start;
+  int   count;
+}stl_bvh_node;
+
+typedef struct
+{
+  stl_vertex origin;
+  stl_vertex direction;
+  float      t_max;       /* ignore hits further than this */
+}stl_ray;
+
+typedef struct
+{
+  int   facet;            /* -1 if nothing was hit */
+  float t;
+  float u;                /* barycentric coordinates of the hit */
+  float v;
+}stl_ray_hit;
+
+typedef struct
+{
+  int        facet;
+  float      distance;
+  stl_vertex point;
+}stl_nearest;
+
+/* Bounding volume hierarchy over the facets of a mesh, built with binned
+ * SAH.  Subtrees are built on the thread pool.  The tree copies the
+ * facet geometry into leaf order, so it does not refer back to the mesh.
+ * All queries are const and may run from any number of threads at once;
+ * the batched forms spread themselves over the pool.
+ */
+class stl_bvh
+{
+public:
+    stl_bvh(const stl &mesh);
+
+    std::vector<stl_bvh_node> nodes;
+    std::vector<int>          order;      /* leaf slot -> facet number */
+
+    stl_ray_hit ray_cast(const stl_ray &ray) const;
+    stl_nearest nearest_point(const stl_vertex &point) const;
+    int winding_number(const stl_vertex &point) const;
+
+    void ray_cast(const stl_ray *rays, int count, stl_ray_hit *hits) const;
+    void nearest_point(const stl_vertex *points, int count,
+                       stl_nearest *nearest) const;
+    void winding_number(const stl_vertex *points, int count,
+                        int *winding) const;
+
+private:
+    std::vector<float> triangles;         /* 9 floats per leaf slot */
+};
+
+#endif // BVH_H
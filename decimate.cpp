@@ -0,0 +1,761 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <queue>
+#include <vector>
+#include "decimate.h"
+#include "parallel.h"
+
+using namespace std;
+
+/* Symmetric 4x4 error quadric, upper triangle:
+ *  a2 ab ac ad / b2 bc bd / c2 cd / d2
+ * and the sum of the weights of the planes in it.
+ */
+typedef struct
+{
+  double q[10];
+  double weight;
+}stl_quadric;
+
+/* cost orders the collapses; error is the same divided by the weight,
+   a mean squared distance that the limit is checked against. */
+typedef struct
+{
+  double cost;
+  double error;
+  int    u;
+  int    v;
+  int    version_u;
+  int    version_v;
+  double x;
+  double y;
+  double z;
+}stl_collapse;
+
+struct stl_collapse_greater
+{
+  bool operator()(const stl_collapse &a, const stl_collapse &b) const
+  {
+    return a.cost > b.cost;
+  }
+};
+
+/* One independently decimated piece of the mesh.  Vertex ids are local;
+ * locked vertices never move.
+ */
+class stl_decimator
+{
+public:
+  vector<double>       position;     /* 3 per vertex */
+  vector<char>         locked;
+  vector<int>          face;         /* 3 per facet */
+  vector<stl_quadric>  quadric;      /* 1 per vertex; built from the
+                                        facets by run() unless given */
+  int                  live_faces;
+
+  void run(int target_faces, double max_error2);
+
+private:
+  vector<vector<int> > vertex_faces;
+  vector<int>          version;
+  vector<char>         face_alive;
+  vector<char>         vertex_alive;
+  priority_queue<stl_collapse, vector<stl_collapse>,
+                 stl_collapse_greater> heap;
+
+  void setup();
+  void neighbors(int v, vector<int> &out);
+  void push_edge(int u, int v);
+  bool can_collapse(const stl_collapse &c);
+  void collapse(const stl_collapse &c);
+};
+
+static void stl_quadric_add_plane(stl_quadric *q, double a, double b,
+                                  double c, double d, double weight);
+static double stl_quadric_error(const stl_quadric *q, double x, double y,
+                                double z);
+static void stl_decimate_output(const vector<double> &position,
+                                const vector<int> &face, stl *out);
+
+static void stl_quadric_add_plane(stl_quadric *q, double a, double b,
+                                  double c, double d, double weight)
+{
+  q->q[0] += weight * a * a; q->q[1] += weight * a * b;
+  q->q[2] += weight * a * c; q->q[3] += weight * a * d;
+  q->q[4] += weight * b * b; q->q[5] += weight * b * c;
+  q->q[6] += weight * b * d; q->q[7] += weight * c * c;
+  q->q[8] += weight * c * d; q->q[9] += weight * d * d;
+  q->weight += weight;
+}
+
+static double stl_quadric_error(const stl_quadric *q, double x, double y,
+                                double z)
+{
+  const double *m = q->q;
+
+  return m[0] * x * x + 2 * m[1] * x * y + 2 * m[2] * x * z + 2 * m[3] * x
+       + m[4] * y * y + 2 * m[5] * y * z + 2 * m[6] * y
+       + m[7] * z * z + 2 * m[8] * z
+       + m[9];
+}
+
+void stl_decimator::setup()
+{
+  int nv = (int) position.size() / 3;
+  int nf = (int) face.size() / 3;
+  int f;
+  int j;
+
+  /* Quadrics handed in already hold the original planes; adding the
+     current facets' planes again would measure against these instead. */
+  bool given = quadric.size() == (size_t) nv;
+
+  if(!given)
+    {
+      quadric.assign(nv, stl_quadric());
+      for(j = 0; j < nv; j++)
+        {
+          memset(&quadric[j], 0, sizeof(stl_quadric));
+        }
+    }
+  vertex_faces.assign(nv, vector<int>());
+  version.assign(nv, 0);
+  vertex_alive.assign(nv, 1);
+  face_alive.assign(nf, 1);
+  live_faces = nf;
+
+  for(f = 0; f < nf; f++)
+    {
+      const double *p0 = &position[3 * face[3 * f]];
+      const double *p1 = &position[3 * face[3 * f + 1]];
+      const double *p2 = &position[3 * face[3 * f + 2]];
+      double u[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+      double v[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+      double n[3] = {u[1] * v[2] - u[2] * v[1],
+                     u[2] * v[0] - u[0] * v[2],
+                     u[0] * v[1] - u[1] * v[0]};
+      double length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+      for(j = 0; j < 3; j++)
+        {
+          vertex_faces[face[3 * f + j]].push_back(f);
+        }
+      if(length <= 0.0 || given)
+        {
+          continue;
+        }
+      n[0] /= length; n[1] /= length; n[2] /= length;
+      for(j = 0; j < 3; j++)
+        {
+          stl_quadric_add_plane(&quadric[face[3 * f + j]], n[0], n[1], n[2],
+                                -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]),
+                                length * 0.5);
+        }
+    }
+}
+
+void stl_decimator::neighbors(int v, vector<int> &out)
+{
+  size_t i;
+  int    j;
+
+  out.clear();
+  for(i = 0; i < vertex_faces[v].size(); i++)
+    {
+      int f = vertex_faces[v][i];
+      if(!face_alive[f]) continue;
+      for(j = 0; j < 3; j++)
+        {
+          if(face[3 * f + j] != v) out.push_back(face[3 * f + j]);
+        }
+    }
+  sort(out.begin(), out.end());
+  out.erase(unique(out.begin(), out.end()), out.end());
+}
+
+/* Prices collapsing edge u-v and queues it.  The target is the quadric
+ * minimum when the system is well conditioned, otherwise the better of
+ * the endpoints and the midpoint; a locked end pins the target.
+ */
+void stl_decimator::push_edge(int u, int v)
+{
+  stl_collapse c;
+  stl_quadric  q;
+  const double *pu = &position[3 * u];
+  const double *pv = &position[3 * v];
+  int          k;
+
+  if(locked[u] && locked[v])
+    {
+      return;
+    }
+  if(locked[v])
+    {
+      /* v is the vertex that disappears, so it must be the free one. */
+      int swap = u;
+      u = v;
+      v = swap;
+      pu = &position[3 * u];
+      pv = &position[3 * v];
+    }
+  for(k = 0; k < 10; k++)
+    {
+      q.q[k] = quadric[u].q[k] + quadric[v].q[k];
+    }
+  q.weight = quadric[u].weight + quadric[v].weight;
+
+  c.u = u;
+  c.v = v;
+  c.version_u = version[u];
+  c.version_v = version[v];
+
+  if(locked[u] || locked[v])
+    {
+      const double *p = locked[u] ? pu : pv;
+      c.x = p[0]; c.y = p[1]; c.z = p[2];
+      c.cost = stl_quadric_error(&q, c.x, c.y, c.z);
+    }
+  else
+    {
+      const double *m = q.q;
+      double det = m[0] * (m[4] * m[7] - m[5] * m[5])
+                 - m[1] * (m[1] * m[7] - m[5] * m[2])
+                 + m[2] * (m[1] * m[5] - m[4] * m[2]);
+      double scale = m[0] * m[4] * m[7];
+
+      if(fabs(det) > 1e-9 * fabs(scale) && det != 0.0)
+        {
+          /* Cramer's rule on A p = -b */
+          double b0 = -m[3];
+          double b1 = -m[6];
+          double b2 = -m[8];
+          c.x = (b0 * (m[4] * m[7] - m[5] * m[5])
+               - m[1] * (b1 * m[7] - m[5] * b2)
+               + m[2] * (b1 * m[5] - m[4] * b2)) / det;
+          c.y = (m[0] * (b1 * m[7] - b2 * m[5])
+               - b0 * (m[1] * m[7] - m[5] * m[2])
+               + m[2] * (m[1] * b2 - b1 * m[2])) / det;
+          c.z = (m[0] * (m[4] * b2 - m[5] * b1)
+               - m[1] * (m[1] * b2 - b1 * m[2])
+               + b0 * (m[1] * m[5] - m[4] * m[2])) / det;
+          c.cost = stl_quadric_error(&q, c.x, c.y, c.z);
+        }
+      else
+        {
+          double mid[3] = {(pu[0] + pv[0]) / 2, (pu[1] + pv[1]) / 2,
+                           (pu[2] + pv[2]) / 2};
+          double eu = stl_quadric_error(&q, pu[0], pu[1], pu[2]);
+          double ev = stl_quadric_error(&q, pv[0], pv[1], pv[2]);
+          double em = stl_quadric_error(&q, mid[0], mid[1], mid[2]);
+          const double *best = mid;
+
+          c.cost = em;
+          if(eu < c.cost) { c.cost = eu; best = pu; }
+          if(ev < c.cost) { c.cost = ev; best = pv; }
+          c.x = best[0]; c.y = best[1]; c.z = best[2];
+        }
+    }
+  if(c.cost < 0.0)
+    {
+      c.cost = 0.0;
+    }
+  c.error = q.weight > 0.0 ? c.cost / q.weight : 0.0;
+  heap.push(c);
+}
+
+/* Rejects collapses that would pinch the surface (link condition) or
+ * fold a facet over.
+ */
+bool stl_decimator::can_collapse(const stl_collapse &c)
+{
+  vector<int> nu;
+  vector<int> nv;
+  vector<int> common;
+  int         shared_faces = 0;
+  int         pass;
+  size_t      i;
+
+  neighbors(c.u, nu);
+  neighbors(c.v, nv);
+  set_intersection(nu.begin(), nu.end(), nv.begin(), nv.end(),
+                   back_inserter(common));
+
+  for(i = 0; i < vertex_faces[c.u].size(); i++)
+    {
+      int f = vertex_faces[c.u][i];
+      if(face_alive[f] && (face[3 * f] == c.v || face[3 * f + 1] == c.v
+                           || face[3 * f + 2] == c.v))
+        {
+          shared_faces++;
+        }
+    }
+  if(shared_faces == 0 || (int) common.size() != shared_faces)
+    {
+      return false;
+    }
+
+  for(pass = 0; pass < 2; pass++)
+    {
+      int moved = pass == 0 ? c.u : c.v;
+      int other = pass == 0 ? c.v : c.u;
+
+      for(i = 0; i < vertex_faces[moved].size(); i++)
+        {
+          int    f = vertex_faces[moved][i];
+          double p[3][3];
+          double before[3];
+          double after[3];
+          int    j;
+          int    k;
+
+          if(!face_alive[f]) continue;
+          if(face[3 * f] == other || face[3 * f + 1] == other
+             || face[3 * f + 2] == other)
+            {
+              continue;
+            }
+          for(j = 0; j < 3; j++)
+            {
+              int w = face[3 * f + j];
+              for(k = 0; k < 3; k++)
+                {
+                  p[j][k] = position[3 * w + k];
+                }
+            }
+          for(k = 0; k < 2; k++)
+            {
+              double a[3] = {p[1][0] - p[0][0], p[1][1] - p[0][1],
+                             p[1][2] - p[0][2]};
+              double b[3] = {p[2][0] - p[0][0], p[2][1] - p[0][1],
+                             p[2][2] - p[0][2]};
+              double *n = k == 0 ? before : after;
+              n[0] = a[1] * b[2] - a[2] * b[1];
+              n[1] = a[2] * b[0] - a[0] * b[2];
+              n[2] = a[0] * b[1] - a[1] * b[0];
+              for(j = 0; j < 3; j++)
+                {
+                  if(face[3 * f + j] == moved)
+                    {
+                      p[j][0] = c.x; p[j][1] = c.y; p[j][2] = c.z;
+                    }
+                }
+            }
+          if(before[0] * after[0] + before[1] * after[1]
+             + before[2] * after[2] <= 0.0)
+            {
+              return false;
+            }
+        }
+    }
+  return true;
+}
+
+void stl_decimator::collapse(const stl_collapse &c)
+{
+  vector<int> merged;
+  vector<int> around;
+  size_t      i;
+  int         j;
+
+  for(i = 0; i < vertex_faces[c.v].size(); i++)
+    {
+      int f = vertex_faces[c.v][i];
+      if(!face_alive[f]) continue;
+      if(face[3 * f] == c.u || face[3 * f + 1] == c.u
+         || face[3 * f + 2] == c.u)
+        {
+          face_alive[f] = 0;
+          live_faces--;
+          continue;
+        }
+      for(j = 0; j < 3; j++)
+        {
+          if(face[3 * f + j] == c.v) face[3 * f + j] = c.u;
+        }
+      merged.push_back(f);
+    }
+  for(i = 0; i < vertex_faces[c.u].size(); i++)
+    {
+      if(face_alive[vertex_faces[c.u][i]])
+        merged.push_back(vertex_faces[c.u][i]);
+    }
+  vertex_faces[c.u].swap(merged);
+  vector<int>().swap(vertex_faces[c.v]);
+
+  position[3 * c.u] = c.x;
+  position[3 * c.u + 1] = c.y;
+  position[3 * c.u + 2] = c.z;
+  for(j = 0; j < 10; j++)
+    {
+      quadric[c.u].q[j] += quadric[c.v].q[j];
+    }
+  quadric[c.u].weight += quadric[c.v].weight;
+  vertex_alive[c.v] = 0;
+  version[c.u]++;
+
+  neighbors(c.u, around);
+  for(i = 0; i < around.size(); i++)
+    {
+      push_edge(c.u, around[i]);
+    }
+}
+
+void stl_decimator::run(int target_faces, double max_error2)
+{
+  vector<int> around;
+  int         nv;
+  int         v;
+  size_t      i;
+
+  setup();
+  nv = (int) position.size() / 3;
+  for(v = 0; v < nv; v++)
+    {
+      neighbors(v, around);
+      for(i = 0; i < around.size(); i++)
+        {
+          if(around[i] > v) push_edge(v, around[i]);
+        }
+    }
+
+  while(!heap.empty() && live_faces > target_faces)
+    {
+      stl_collapse c = heap.top();
+      heap.pop();
+
+      if(!vertex_alive[c.u] || !vertex_alive[c.v]
+         || version[c.u] != c.version_u || version[c.v] != c.version_v)
+        {
+          continue;
+        }
+      /* The heap is ordered by the weighted cost, so a collapse over the
+         limit doesn't mean every later one is. */
+      if(max_error2 >= 0.0 && c.error > max_error2)
+        {
+          continue;
+        }
+      if(!can_collapse(c))
+        {
+          continue;
+        }
+      collapse(c);
+    }
+
+  /* Drop dead facets so the caller sees only what is left. */
+  vector<int> kept;
+  kept.reserve(3 * live_faces);
+  for(i = 0; i < face_alive.size(); i++)
+    {
+      if(face_alive[i])
+        {
+          kept.push_back(face[3 * i]);
+          kept.push_back(face[3 * i + 1]);
+          kept.push_back(face[3 * i + 2]);
+        }
+    }
+  face.swap(kept);
+}
+
+/* Locks the vertices of open edges so holes keep their outline. */
+static void stl_lock_boundary(const stl &mesh, vector<char> &locked)
+{
+  int i;
+  int j;
+
+  if(mesh.neighbors_start == NULL)
+    {
+      return;
+    }
+  for(i = 0; i < mesh.stats.number_of_facets; i++)
+    {
+      for(j = 0; j < 3; j++)
+        {
+          if(mesh.neighbors_start[i].neighbor[j] == -1)
+            {
+              locked[mesh.v_indices[i].vertex[j]] = 1;
+              locked[mesh.v_indices[i].vertex[(j + 1) % 3]] = 1;
+            }
+        }
+    }
+}
+
+void stl_decimate(const stl &mesh, const stl_decimate_params &params,
+                  stl *out)
+{
+  int                 nv = mesh.stats.shared_vertices;
+  int                 nf = mesh.stats.number_of_facets;
+  int                 target = params.target_facets > 0
+                        ? params.target_facets : 0;
+  double              max_error2 = params.max_error > 0.0
+                        ? (double) params.max_error * params.max_error : -1.0;
+  vector<double>      position(3 * nv);
+  vector<char>        locked(nv, 0);
+  vector<int>         face(3 * nf);
+  vector<stl_quadric> accumulated;
+  int                 i;
+  int                 j;
+
+  for(i = 0; i < nv; i++)
+    {
+      position[3 * i] = mesh.v_shared[i].x;
+      position[3 * i + 1] = mesh.v_shared[i].y;
+      position[3 * i + 2] = mesh.v_shared[i].z;
+    }
+  for(i = 0; i < nf; i++)
+    {
+      for(j = 0; j < 3; j++)
+        {
+          face[3 * i + j] = mesh.v_indices[i].vertex[j];
+        }
+    }
+  stl_lock_boundary(mesh, locked);
+
+  /* With neither limit set there is nothing to aim for. */
+  if(target == 0 && max_error2 < 0.0)
+    {
+      target = nf;
+    }
+
+  if(params.parallel && nf > 4 * target && nf >= 65536)
+    {
+      /* Grid of roughly four regions per thread, cut by facet centroid. */
+      int   threads = QThread::idealThreadCount();
+      int   cells = 1;
+      float extent[3] = {mesh.stats.max.x - mesh.stats.min.x,
+                         mesh.stats.max.y - mesh.stats.min.y,
+                         mesh.stats.max.z - mesh.stats.min.z};
+      float origin[3] = {mesh.stats.min.x, mesh.stats.min.y,
+                         mesh.stats.min.z};
+      int   regions;
+      vector<int> region_of(nf);
+      vector<int> vertex_region(nv, -1);
+
+      while(cells * cells * cells < 4 * threads)
+        {
+          cells++;
+        }
+      regions = cells * cells * cells;
+      for(i = 0; i < nf; i++)
+        {
+          int cell[3];
+          int k;
+          for(k = 0; k < 3; k++)
+            {
+              double centroid = (position[3 * face[3 * i] + k]
+                                 + position[3 * face[3 * i + 1] + k]
+                                 + position[3 * face[3 * i + 2] + k]) / 3.0;
+              cell[k] = extent[k] > 0.0
+                ? (int) ((centroid - origin[k]) / extent[k] * cells) : 0;
+              cell[k] = STL_MAX(0, STL_MIN(cell[k], cells - 1));
+            }
+          region_of[i] = (cell[2] * cells + cell[1]) * cells + cell[0];
+          for(k = 0; k < 3; k++)
+            {
+              int v = face[3 * i + k];
+              if(vertex_region[v] == -1) vertex_region[v] = region_of[i];
+              else if(vertex_region[v] != region_of[i]) locked[v] = 1;
+            }
+        }
+
+      vector<stl_decimator> pieces(regions);
+      vector<vector<int> >  local_to_global(regions);
+      vector<vector<int> >  region_faces(regions);
+      vector<int>           stamp(nv, -1);
+      vector<int>           local_id(nv);
+      for(i = 0; i < nf; i++)
+        {
+          region_faces[region_of[i]].push_back(i);
+        }
+      for(int r = 0; r < regions; r++)
+        {
+          stl_decimator &piece = pieces[r];
+          vector<int>   &map = local_to_global[r];
+          for(size_t k = 0; k < region_faces[r].size(); k++)
+            {
+              int f = region_faces[r][k];
+              for(j = 0; j < 3; j++)
+                {
+                  int v = face[3 * f + j];
+                  if(stamp[v] != r)
+                    {
+                      stamp[v] = r;
+                      local_id[v] = (int) map.size();
+                      map.push_back(v);
+                      piece.position.push_back(position[3 * v]);
+                      piece.position.push_back(position[3 * v + 1]);
+                      piece.position.push_back(position[3 * v + 2]);
+                      piece.locked.push_back(locked[v]);
+                    }
+                  piece.face.push_back(local_id[v]);
+                }
+            }
+        }
+
+      stl_parallel_for(regions, 1, [&](int begin, int end)
+        {
+          for(int r = begin; r < end; r++)
+            {
+              int size = (int) pieces[r].face.size() / 3;
+              int goal = (int) ((double) target * size / nf);
+              pieces[r].run(goal, max_error2);
+            }
+        });
+
+      /* A seam vertex collects planes in every region it touches; the
+         sums carry the original surface into the seam pass. */
+      accumulated.assign(nv, stl_quadric());
+      memset(&accumulated[0], 0, nv * sizeof(stl_quadric));
+      for(int r = 0; r < regions; r++)
+        {
+          for(size_t local = 0; local < local_to_global[r].size(); local++)
+            {
+              stl_quadric       &sum = accumulated[local_to_global[r][local]];
+              const stl_quadric &part = pieces[r].quadric[local];
+              for(int k = 0; k < 10; k++)
+                {
+                  sum.q[k] += part.q[k];
+                }
+              sum.weight += part.weight;
+            }
+        }
+
+      face.clear();
+      for(int r = 0; r < regions; r++)
+        {
+          for(size_t k = 0; k < pieces[r].face.size(); k++)
+            {
+              int local = pieces[r].face[k];
+              int v = local_to_global[r][local];
+              position[3 * v] = pieces[r].position[3 * local];
+              position[3 * v + 1] = pieces[r].position[3 * local + 1];
+              position[3 * v + 2] = pieces[r].position[3 * local + 2];
+              face.push_back(v);
+            }
+        }
+
+      /* Seam vertices are free again for the serial clean-up pass. */
+      locked.assign(nv, 0);
+      stl_lock_boundary(mesh, locked);
+    }
+
+  /* Serial pass: everything in serial mode, the seams in parallel mode. */
+  stl_decimator whole;
+  vector<int>   renumber(nv, -1);
+  whole.face.reserve(face.size());
+  for(size_t k = 0; k < face.size(); k++)
+    {
+      int v = face[k];
+      if(renumber[v] == -1)
+        {
+          renumber[v] = (int) whole.position.size() / 3;
+          whole.position.push_back(position[3 * v]);
+          whole.position.push_back(position[3 * v + 1]);
+          whole.position.push_back(position[3 * v + 2]);
+          whole.locked.push_back(locked[v]);
+          if(!accumulated.empty())
+            {
+              whole.quadric.push_back(accumulated[v]);
+            }
+        }
+      whole.face.push_back(renumber[v]);
+    }
+  whole.run(target, max_error2);
+
+  stl_decimate_output(whole.position, whole.face, out);
+}
+
+static void stl_decimate_output(const vector<double> &position,
+                                const vector<int> &face, stl *out)
+{
+  int         nf = (int) face.size() / 3;
+  vector<int> renumber(position.size() / 3, -1);
+  int         nv = 0;
+  int         i;
+  int         j;
+  float       normal[3];
+
+  out->close();
+  memset(&out->stats, 0, sizeof(stl_stats));
+  strcpy(out->stats.header, "decimated by libsliceomatic");
+  out->stats.type = binary;
+  out->stats.volume = -1.0;
+  out->fp = NULL;
+  out->stats.number_of_facets = nf;
+  out->stats.original_num_facets = nf;
+  out->stats.facets_malloced = nf;
+
+  out->facet_start = (stl_facet*) calloc(STL_MAX(nf, 1), sizeof(stl_facet));
+  out->neighbors_start =
+    (stl_neighbors*) calloc(STL_MAX(nf, 1), sizeof(stl_neighbors));
+  out->v_indices =
+    (v_indices_struct*) calloc(STL_MAX(nf, 1), sizeof(v_indices_struct));
+  out->v_shared = (stl_vertex*) calloc(STL_MAX(position.size() / 3, (size_t) 1),
+                                       sizeof(stl_vertex));
+  if(out->facet_start == NULL || out->neighbors_start == NULL
+     || out->v_indices == NULL || out->v_shared == NULL)
+    {
+      perror("stl_decimate");
+      exit(1);
+    }
+
+  for(i = 0; i < nf; i++)
+    {
+      for(j = 0; j < 3; j++)
+        {
+          int v = face[3 * i + j];
+          if(renumber[v] == -1)
+            {
+              renumber[v] = nv;
+              out->v_shared[nv].x = position[3 * v];
+              out->v_shared[nv].y = position[3 * v + 1];
+              out->v_shared[nv].z = position[3 * v + 2];
+              nv++;
+            }
+          out->v_indices[i].vertex[j] = renumber[v];
+          out->facet_start[i].vertex[j] = out->v_shared[renumber[v]];
+        }
+      out->calculate_normal(normal, &out->facet_start[i]);
+      out->normalize_vector(normal);
+      out->facet_start[i].normal.x = normal[0];
+      out->facet_start[i].normal.y = normal[1];
+      out->facet_start[i].normal.z = normal[2];
+    }
+  out->stats.shared_vertices = nv;
+  out->stats.shared_malloced = nv;
+
+  for(i = 0; i < nv; i++)
+    {
+      const stl_vertex &p = out->v_shared[i];
+      if(i == 0)
+        {
+          out->stats.min = p;
+          out->stats.max = p;
+        }
+      out->stats.min.x = STL_MIN(out->stats.min.x, p.x);
+      out->stats.min.y = STL_MIN(out->stats.min.y, p.y);
+      out->stats.min.z = STL_MIN(out->stats.min.z, p.z);
+      out->stats.max.x = STL_MAX(out->stats.max.x, p.x);
+      out->stats.max.y = STL_MAX(out->stats.max.y, p.y);
+      out->stats.max.z = STL_MAX(out->stats.max.z, p.z);
+    }
+  out->stats.size.x = out->stats.max.x - out->stats.min.x;
+  out->stats.size.y = out->stats.max.y - out->stats.min.y;
+  out->stats.size.z = out->stats.max.z - out->stats.min.z;
+  out->stats.bounding_diameter =
+    sqrt(out->stats.size.x * out->stats.size.x +
+         out->stats.size.y * out->stats.size.y +
+         out->stats.size.z * out->stats.size.z);
+  out->stats.shortest_edge = out->stats.bounding_diameter;
+
+  out->check_facets_exact();
+}
+
+stl stl_decimate(const stl &mesh, const stl_decimate_params &params)
+{
+  stl out;
+
+  stl_decimate(mesh, params, &out);
+  return out;
+}
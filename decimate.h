@@ -0,0 +1,37 @@
+#ifndef DECIMATE_H
+#define DECIMATE_H
+
+#include "stl.h"
+
+typedef struct
+{
+  int   target_facets;  /* stop once this few facets are left (0: no limit) */
+  float max_error;      /* largest allowed deviation, in model units: the
+                           area-weighted RMS distance of a merged vertex
+                           from the planes of the original facets around
+                           it (0: no limit) */
+  int   parallel;       /* decimate spatial regions on separate threads */
+}stl_decimate_params;
+
+/* Quadric edge-collapse simplification of the indexed mesh.  The input
+ * needs v_shared/v_indices (generate_shared_vertices()) and is not
+ * modified.  out receives a complete, independent mesh: facets with
+ * fresh normals, neighbors and shared vertices, ready for the writers
+ * and for stl::close().
+ *
+ * Open boundaries are kept in place.  In parallel mode the facets are
+ * split into a grid of regions whose seams are frozen while the regions
+ * are decimated concurrently; a final serial pass over the already much
+ * smaller mesh then removes the seams.  That pass starts from the
+ * quadrics the regions built up, so max_error still refers to the
+ * original facets.  Running out of memory for the result exits, like
+ * the other legacy paths.
+ */
+void stl_decimate(const stl &mesh, const stl_decimate_params &params,
+                  stl *out);
+
+/* The same, handing the result back by value so it can be moved straight
+   into the next stage. */
+stl stl_decimate(const stl &mesh, const stl_decimate_params &params);
+
+#endif // DECIMATE_H
@@ -0,0 +1,81 @@
+#include <vector>
+#include "stl.h"
+#include "parallel.h"
+
+using namespace std;
+
+/* Facets flagged per parallel chunk at the least. */
+#define DEGENERATE_GRAIN 16384
+
+/* Flags the facets in [begin, end).  A facet is degenerate when two of
+   its corners are within tolerance of each other, or when its height
+   over the longest edge is, which catches collinear corners.  The test
+   is written without branches so the compiler can vectorize the loop. */
+static void stl_flag_degenerate(const stl_facet *facets, int begin, int end,
+                                float tolerance, unsigned char *flags)
+{
+  float tolerance2 = tolerance * tolerance;
+  int   i;
+
+  for(i = begin; i < end; i++)
+    {
+      const stl_vertex *v = facets[i].vertex;
+      float ax = v[1].x - v[0].x, ay = v[1].y - v[0].y, az = v[1].z - v[0].z;
+      float bx = v[2].x - v[0].x, by = v[2].y - v[0].y, bz = v[2].z - v[0].z;
+      float cx = v[2].x - v[1].x, cy = v[2].y - v[1].y, cz = v[2].z - v[1].z;
+      float la = ax * ax + ay * ay + az * az;
+      float lb = bx * bx + by * by + bz * bz;
+      float lc = cx * cx + cy * cy + cz * cz;
+      float nx = ay * bz - az * by;
+      float ny = az * bx - ax * bz;
+      float nz = ax * by - ay * bx;
+      float shortest = STL_MIN(STL_MIN(la, lb), lc);
+      float longest = STL_MAX(STL_MAX(la, lb), lc);
+
+      /* |n|^2 / longest is the squared height over the longest edge. */
+      flags[i] = (shortest <= tolerance2)
+                 | (nx * nx + ny * ny + nz * nz <= tolerance2 * longest);
+    }
+}
+
+int stl::remove_degenerate_facets(float tolerance)
+{
+  int                   n = stats.number_of_facets;
+  vector<unsigned char> flags(n);
+  int                   kept = 0;
+  int                   i;
+
+  if(facet_start == NULL || n == 0)
+    {
+      return 0;
+    }
+  free_edge_hash();
+  stl_parallel_for(n, DEGENERATE_GRAIN, [&](int begin, int end)
+    {
+      stl_flag_degenerate(facet_start, begin, end, tolerance, &flags[0]);
+    });
+
+  /* One stable pass; v_indices, if present, runs parallel to the facets
+     and is compacted along with them. */
+  for(i = 0; i < n; i++)
+    {
+      if(flags[i])
+        {
+          continue;
+        }
+      if(kept != i)
+        {
+          facet_start[kept] = facet_start[i];
+          if(v_indices != NULL)
+            {
+              v_indices[kept] = v_indices[i];
+            }
+        }
+      kept++;
+    }
+
+  stats.number_of_facets = kept;
+  stats.degenerate_facets += n - kept;
+  stats.facets_removed += n - kept;
+  return n - kept;
+}
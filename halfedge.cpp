@@ -0,0 +1,33 @@
+#include "halfedge.h"
+
+stl_halfedge_mesh::stl_halfedge_mesh(const stl &mesh)
+  : origins(3 * mesh.stats.number_of_facets),
+    twins(3 * mesh.stats.number_of_facets),
+    vertex_halfedges(mesh.stats.shared_vertices, -1)
+{
+  int f;
+  int k;
+
+  for(f = 0; f < mesh.stats.number_of_facets; f++)
+    {
+      const stl_neighbors *neighbors = &mesh.neighbors_start[f];
+
+      for(k = 0; k < 3; k++)
+        {
+          int h = 3 * f + k;
+          int v = mesh.v_indices[f].vertex[k];
+          int other = neighbors->neighbor[k];
+          int vnot = neighbors->which_vertex_not[k];
+
+          /* which_vertex_not is 3 to 5 when the neighbor is wound the
+             other way; such an edge can't be paired. */
+          origins[h] = v;
+          twins[h] = other >= 0 && vnot < 3 ? 3 * other + (vnot + 1) % 3 : -1;
+
+          if(vertex_halfedges[v] < 0 || twins[h] < 0)
+            {
+              vertex_halfedges[v] = h;
+            }
+        }
+    }
+}
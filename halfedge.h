@@ -0,0 +1,94 @@
+#ifndef HALFEDGE_H
+#define HALFEDGE_H
+
+#include <vector>
+#include "stl.h"
+
+/* Index based half-edge view of a mesh, built in one pass over
+ * neighbors_start (check_facets_exact()) and v_indices
+ * (generate_shared_vertices()).
+ *
+ * Half-edge 3 * f + k runs from corner k to corner (k + 1) % 3 of facet
+ * f, which is exactly the edge ADMesh calls edge k, so face, next and
+ * prev are plain arithmetic and only the origin vertex and the twin are
+ * stored.  Edges on a hole, and edges whose neighbor is wound the other
+ * way, have no twin (-1).
+ */
+class stl_halfedge_mesh
+{
+public:
+    stl_halfedge_mesh(const stl &mesh);
+
+    int num_faces() const     { return (int) origins.size() / 3; }
+    int num_halfedges() const { return (int) origins.size(); }
+    int num_vertices() const  { return (int) vertex_halfedges.size(); }
+
+    int face(int h) const     { return h / 3; }
+    int next(int h) const     { return h % 3 == 2 ? h - 2 : h + 1; }
+    int prev(int h) const     { return h % 3 == 0 ? h + 2 : h - 1; }
+    int twin(int h) const     { return twins[h]; }
+    int origin(int h) const   { return origins[h]; }
+    int target(int h) const   { return origins[next(h)]; }
+    bool is_boundary(int h) const { return twins[h] < 0; }
+
+    /* An outgoing half-edge of v, on the boundary if v has one so that
+       a circulator starting there sees the whole fan; -1 if v is unused. */
+    int vertex_halfedge(int v) const { return vertex_halfedges[v]; }
+
+    std::vector<int> origins;
+    std::vector<int> twins;
+    std::vector<int> vertex_halfedges;
+};
+
+/* The three half-edges of a face, in winding order:
+ *
+ *   for(stl_face_circulator c(mesh, f); !c.done(); c.next())
+ *     ... c.halfedge() ...
+ */
+class stl_face_circulator
+{
+public:
+    stl_face_circulator(const stl_halfedge_mesh &mesh, int face)
+        : mesh(mesh), first(3 * face), current(3 * face), started(false) {}
+
+    bool done() const  { return started && current == first; }
+    void next()        { current = mesh.next(current); started = true; }
+    int  halfedge() const { return current; }
+    int  vertex() const   { return mesh.origin(current); }
+
+private:
+    const stl_halfedge_mesh &mesh;
+    int                      first;
+    int                      current;
+    bool                     started;
+};
+
+/* The outgoing half-edges of a vertex, turning counter-clockwise seen
+ * from outside (each step moves to the facet across the previous edge).
+ * Stops after a full turn or at a boundary; at a non-manifold vertex only
+ * the fan holding vertex_halfedge() is visited.
+ */
+class stl_vertex_circulator
+{
+public:
+    stl_vertex_circulator(const stl_halfedge_mesh &mesh, int vertex)
+        : mesh(mesh), first(mesh.vertex_halfedge(vertex)), current(first) {}
+
+    bool done() const  { return current < 0; }
+    void next()
+    {
+        current = mesh.twin(mesh.prev(current));
+        if(current == first)
+            current = -1;
+    }
+    int  halfedge() const { return current; }
+    int  face() const     { return mesh.face(current); }
+    int  neighbor() const { return mesh.target(current); }
+
+private:
+    const stl_halfedge_mesh &mesh;
+    int                      first;
+    int                      current;
+};
+
+#endif // HALFEDGE_H
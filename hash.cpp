@@ -0,0 +1,212 @@
+#include <string.h>
+#include <vector>
+#include "stl.h"
+#include "parallel.h"
+
+using namespace std;
+
+/* Facets per independently hashed block.  The block size, not the thread
+   count, decides how the facets are split, so the result is the same on
+   any machine. */
+#define HASH_BLOCK 4096
+
+/* Lanes of the facet hash: one per 64-bit word of normal and vertices,
+   so a facet feeds six independent chains the compiler can interleave. */
+#define HASH_LANES 6
+
+static const uint64_t HASH_P1 = 11400714785074694791ULL;
+static const uint64_t HASH_P2 = 14029467366897019727ULL;
+static const uint64_t HASH_P3 = 1609587929392839161ULL;
+static const uint64_t HASH_P4 = 9650029242287828579ULL;
+static const uint64_t HASH_P5 = 2870177450012600261ULL;
+
+static inline uint64_t stl_hash_rotl(uint64_t x, int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t stl_hash_round(uint64_t acc, uint64_t input)
+{
+  acc += input * HASH_P2;
+  acc = stl_hash_rotl(acc, 31);
+  return acc * HASH_P1;
+}
+
+static inline uint64_t stl_hash_merge(uint64_t hash, uint64_t value)
+{
+  hash ^= stl_hash_round(0, value);
+  return stl_hash_rotl(hash, 27) * HASH_P1 + HASH_P4;
+}
+
+static inline uint64_t stl_hash_avalanche(uint64_t hash)
+{
+  hash ^= hash >> 33;
+  hash *= HASH_P2;
+  hash ^= hash >> 29;
+  hash *= HASH_P3;
+  hash ^= hash >> 32;
+  return hash;
+}
+
+/* The bits of a float as an integer, so the hashes don't depend on byte
+   order. */
+static inline uint64_t stl_hash_bits(float value)
+{
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+static uint64_t stl_hash_facet_block(const stl_facet *facets, int count,
+                                     uint64_t seed)
+{
+  uint64_t acc[HASH_LANES];
+  float    values[12];
+  int      i;
+  int      k;
+
+  for(k = 0; k < HASH_LANES; k++)
+    {
+      acc[k] = seed + (k + 1) * HASH_P1;
+    }
+  for(i = 0; i < count; i++)
+    {
+      memcpy(values, &facets[i].normal, sizeof(values));
+      for(k = 0; k < HASH_LANES; k++)
+        {
+          acc[k] = stl_hash_round(acc[k], stl_hash_bits(values[2 * k])
+                                  | stl_hash_bits(values[2 * k + 1]) << 32);
+        }
+    }
+
+  uint64_t hash = HASH_P5 + count;
+  for(k = 0; k < HASH_LANES; k++)
+    {
+      hash = stl_hash_merge(hash, acc[k]);
+    }
+  return stl_hash_avalanche(hash);
+}
+
+uint64_t stl::hash_facets() const
+{
+  int              n = stats.number_of_facets;
+  int              blocks = (n + HASH_BLOCK - 1) / HASH_BLOCK;
+  vector<uint64_t> digests(blocks);
+  uint64_t         hash = HASH_P5 + (uint64_t) n;
+  int              b;
+
+  /* An indexed import without facet_start hashes the facets
+     expand_facets() would build, a block at a time. */
+  stl_parallel_for(blocks, 1, [&](int begin, int end)
+    {
+      vector<stl_facet> expanded(facet_start == NULL ? HASH_BLOCK : 1);
+      for(int block = begin; block < end; block++)
+        {
+          int first = block * HASH_BLOCK;
+          int count = STL_MIN(HASH_BLOCK, n - first);
+          const stl_facet *facets = &expanded[0];
+          if(facet_start != NULL)
+            {
+              facets = facet_start + first;
+            }
+          else
+            {
+              for(int i = 0; i < count; i++)
+                {
+                  expanded[i] = get_facet(first + i);
+                }
+            }
+          digests[block] = stl_hash_facet_block(facets, count, block);
+        }
+    });
+  for(b = 0; b < blocks; b++)
+    {
+      hash = stl_hash_merge(hash, digests[b]);
+    }
+  return stl_hash_avalanche(hash);
+}
+
+/* Hashes one facet's corners starting at the rotation whose coordinates
+   sort first, which keeps the winding but drops the starting corner.
+   -0.0 is folded into 0.0 so equal geometry always hashes the same. */
+static uint64_t stl_hash_corners(const stl_vertex *corners[3])
+{
+  float    values[3][3];
+  int      start = 0;
+  int      r;
+  int      k;
+  uint64_t hash = HASH_P5;
+
+  for(k = 0; k < 3; k++)
+    {
+      values[k][0] = corners[k]->x + 0.0f;
+      values[k][1] = corners[k]->y + 0.0f;
+      values[k][2] = corners[k]->z + 0.0f;
+    }
+  for(r = 1; r < 3; r++)
+    {
+      for(k = 0; k < 9; k++)
+        {
+          float a = values[(r + k / 3) % 3][k % 3];
+          float b = values[(start + k / 3) % 3][k % 3];
+          if(a != b)
+            {
+              if(a < b) start = r;
+              break;
+            }
+        }
+    }
+  for(k = 0; k < 9; k++)
+    {
+      hash = stl_hash_round(hash, stl_hash_bits(values[(start + k / 3) % 3][k % 3])
+                            | (uint64_t) k << 32);
+    }
+  return stl_hash_avalanche(hash);
+}
+
+uint64_t stl::hash_canonical() const
+{
+  int              n = stats.number_of_facets;
+  int              blocks = (n + HASH_BLOCK - 1) / HASH_BLOCK;
+  vector<uint64_t> sums(2 * blocks);
+  uint64_t         sum = 0;
+  uint64_t         mixed = 0;
+  int              b;
+
+  /* Facets are combined by two independent sums, which don't care about
+     order but, unlike xor, don't cancel repeated facets. */
+  stl_parallel_for(blocks, 1, [&](int begin, int end)
+    {
+      for(int block = begin; block < end; block++)
+        {
+          int      last = STL_MIN(n, (block + 1) * HASH_BLOCK);
+          uint64_t a = 0;
+          uint64_t c = 0;
+
+          for(int i = block * HASH_BLOCK; i < last; i++)
+            {
+              const stl_vertex *corners[3];
+              uint64_t          hash;
+
+              for(int k = 0; k < 3; k++)
+                {
+                  corners[k] = v_shared != NULL && v_indices != NULL
+                               ? &v_shared[v_indices[i].vertex[k]]
+                               : &facet_start[i].vertex[k];
+                }
+              hash = stl_hash_corners(corners);
+              a += hash;
+              c += stl_hash_avalanche(hash + HASH_P4);
+            }
+          sums[2 * block] = a;
+          sums[2 * block + 1] = c;
+        }
+    });
+  for(b = 0; b < blocks; b++)
+    {
+      sum += sums[2 * b];
+      mixed += sums[2 * b + 1];
+    }
+  return stl_hash_avalanche(stl_hash_merge(stl_hash_merge(HASH_P5 + (uint64_t) n,
+                                                          sum), mixed));
+}
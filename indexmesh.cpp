@@ -0,0 +1,295 @@
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <limits>
+#include "indexmesh.h"
+
+using namespace std;
+
+/* Facets read per fread in read_binary(). */
+#define INDEXMESH_CHUNK 4096
+
+template <typename Index>
+struct stl_corner_less
+{
+  const vector<stl_vertex> *corners;
+
+  bool operator()(Index a, Index b) const
+  {
+    const stl_vertex &p = (*corners)[a];
+    const stl_vertex &q = (*corners)[b];
+
+    if(p.x != q.x) return p.x < q.x;
+    if(p.y != q.y) return p.y < q.y;
+    if(p.z != q.z) return p.z < q.z;
+    return a < b;
+  }
+};
+
+/* An edge as its two vertices, smaller first, and the half-edge
+   (3 * facet + edge) it came from. */
+template <typename Index>
+struct stl_sorted_edge
+{
+  Index v1;
+  Index v2;
+  Index halfedge;
+  bool  reversed;
+
+  bool operator<(const stl_sorted_edge &other) const
+  {
+    if(v1 != other.v1) return v1 < other.v1;
+    if(v2 != other.v2) return v2 < other.v2;
+    return halfedge < other.halfedge;
+  }
+};
+
+static float stl_indexmesh_float(const unsigned char *bytes)
+{
+  uint32_t bits = bytes[0] | bytes[1] << 8 | bytes[2] << 16
+                  | (uint32_t) bytes[3] << 24;
+  float    value;
+
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+template <typename Index>
+stl_status stl_indexed_mesh<Index>::read_binary(char *file,
+                                                stl_progress_fn progress,
+                                                void *user_data)
+{
+  FILE               *fp;
+  stl_off_t           file_size;
+  int64_t             count;
+  int64_t             done;
+  vector<stl_vertex>  corners;
+  unsigned char      *buffer;
+
+  fp = fopen(file, "rb");
+  if(fp == NULL)
+    {
+      return STL_ERR_OPEN;
+    }
+  stl_fseek(fp, 0, SEEK_END);
+  file_size = stl_ftell(fp);
+  if(file_size < STL_MIN_FILE_SIZE
+     || (file_size - HEADER_SIZE) % SIZEOF_STL_FACET != 0)
+    {
+      fclose(fp);
+      return STL_ERR_SIZE;
+    }
+  count = (file_size - HEADER_SIZE) / SIZEOF_STL_FACET;
+
+  /* Every corner needs an index of its own while welding. */
+  if(count > (int64_t) (numeric_limits<Index>::max() / 3))
+    {
+      fclose(fp);
+      return STL_ERR_SIZE;
+    }
+
+  buffer = (unsigned char *) malloc(INDEXMESH_CHUNK * SIZEOF_STL_FACET);
+  if(buffer == NULL)
+    {
+      fclose(fp);
+      return STL_ERR_MEMORY;
+    }
+  corners.resize(3 * count);
+  stl_fseek(fp, HEADER_SIZE, SEEK_SET);
+  for(done = 0; done < count; )
+    {
+      int n = (int) STL_MIN((int64_t) INDEXMESH_CHUNK, count - done);
+      int i;
+      int k;
+
+      if(fread(buffer, SIZEOF_STL_FACET, n, fp) != (size_t) n)
+        {
+          free(buffer);
+          fclose(fp);
+          return STL_ERR_READ;
+        }
+      for(i = 0; i < n; i++)
+        {
+          /* Skip the normal; the welded mesh only keeps positions. */
+          const unsigned char *facet = buffer + i * SIZEOF_STL_FACET + 12;
+          for(k = 0; k < 3; k++)
+            {
+              stl_vertex &corner = corners[3 * (done + i) + k];
+              corner.x = stl_indexmesh_float(facet + 12 * k);
+              corner.y = stl_indexmesh_float(facet + 12 * k + 4);
+              corner.z = stl_indexmesh_float(facet + 12 * k + 8);
+            }
+        }
+      done += n;
+      if(progress != NULL && !progress(0.8 * done / count, user_data))
+        {
+          free(buffer);
+          fclose(fp);
+          return STL_CANCELLED;
+        }
+    }
+  free(buffer);
+  fclose(fp);
+
+  weld(corners);
+  check_facets_exact();
+  if(progress != NULL)
+    {
+      progress(1.0, user_data);
+    }
+  return STL_OK;
+}
+
+template <typename Index>
+void stl_indexed_mesh<Index>::from_stl(const stl &mesh)
+{
+  int i;
+  int k;
+
+  if(mesh.v_shared == NULL || mesh.v_indices == NULL)
+    {
+      vector<stl_vertex> corners(3 * (size_t) mesh.stats.number_of_facets);
+      for(i = 0; i < mesh.stats.number_of_facets; i++)
+        {
+          for(k = 0; k < 3; k++)
+            {
+              corners[3 * i + k] = mesh.facet_start[i].vertex[k];
+            }
+        }
+      weld(corners);
+    }
+  else
+    {
+      vertices.assign(mesh.v_shared, mesh.v_shared + mesh.stats.shared_vertices);
+      indices.resize(mesh.stats.number_of_facets);
+      for(i = 0; i < mesh.stats.number_of_facets; i++)
+        {
+          for(k = 0; k < 3; k++)
+            {
+              indices[i].vertex[k] = mesh.v_indices[i].vertex[k];
+            }
+        }
+    }
+
+  if(mesh.neighbors_start == NULL)
+    {
+      check_facets_exact();
+      return;
+    }
+  neighbors.resize(mesh.stats.number_of_facets);
+  for(i = 0; i < mesh.stats.number_of_facets; i++)
+    {
+      for(k = 0; k < 3; k++)
+        {
+          neighbors[i].neighbor[k] = mesh.neighbors_start[i].neighbor[k];
+          neighbors[i].which_vertex_not[k] =
+            mesh.neighbors_start[i].which_vertex_not[k];
+        }
+    }
+}
+
+/* Numbers the distinct corners in order of first use, the numbering
+   stl::generate_shared_vertices() produces. */
+template <typename Index>
+void stl_indexed_mesh<Index>::weld(const vector<stl_vertex> &corners)
+{
+  Index                 n = (Index) corners.size();
+  vector<Index>         order(n);
+  vector<Index>         first(n);
+  stl_corner_less<Index> less;
+  Index                 i;
+  Index                 run;
+
+  for(i = 0; i < n; i++)
+    {
+      order[i] = i;
+    }
+  less.corners = &corners;
+  sort(order.begin(), order.end(), less);
+
+  /* Sorted runs of equal corners start with their lowest index. */
+  for(i = 0; i < n; i = run)
+    {
+      const stl_vertex &p = corners[order[i]];
+      for(run = i; run < n; run++)
+        {
+          const stl_vertex &q = corners[order[run]];
+          if(q.x != p.x || q.y != p.y || q.z != p.z) break;
+          first[order[run]] = order[i];
+        }
+    }
+
+  /* order is reused as the vertex number of each run's first corner. */
+  vertices.clear();
+  indices.resize(n / 3);
+  for(i = 0; i < n; i++)
+    {
+      Index id;
+      if(first[i] == i)
+        {
+          order[i] = (Index) vertices.size();
+          vertices.push_back(corners[i]);
+        }
+      id = order[first[i]];
+      indices[i / 3].vertex[i % 3] = id;
+    }
+}
+
+template <typename Index>
+void stl_indexed_mesh<Index>::check_facets_exact()
+{
+  Index                          facets = number_of_facets();
+  vector<stl_sorted_edge<Index> > edges(3 * facets);
+  Index                          f;
+  Index                          i;
+  int                            k;
+
+  neighbors.resize(facets);
+  for(f = 0; f < facets; f++)
+    {
+      for(k = 0; k < 3; k++)
+        {
+          Index a = indices[f].vertex[k];
+          Index b = indices[f].vertex[(k + 1) % 3];
+          stl_sorted_edge<Index> &edge = edges[3 * f + k];
+
+          edge.v1 = STL_MIN(a, b);
+          edge.v2 = STL_MAX(a, b);
+          edge.halfedge = 3 * f + k;
+          edge.reversed = a > b;
+          neighbors[f].neighbor[k] = -1;
+          neighbors[f].which_vertex_not[k] = -1;
+        }
+    }
+  sort(edges.begin(), edges.end());
+
+  /* Equal edges are paired off two at a time, like the hash pairs each
+     edge with the first unmatched one it meets.  A degenerate facet can
+     carry the same edge twice; those copies sort next to each other, and
+     the second is left to pair with the next facet instead. */
+  for(i = 0; i + 1 < 3 * facets; i++)
+    {
+      const stl_sorted_edge<Index> &a = edges[i];
+      const stl_sorted_edge<Index> &b = edges[i + 1];
+      Index fa = a.halfedge / 3;
+      Index fb = b.halfedge / 3;
+      int   ka = (int) (a.halfedge % 3);
+      int   kb = (int) (b.halfedge % 3);
+      int   flipped;
+
+      if(a.v1 != b.v1 || a.v2 != b.v2 || a.v1 == a.v2 || fa == fb)
+        {
+          continue;
+        }
+      /* Both running the same way means one facet is wound backwards. */
+      flipped = a.reversed == b.reversed ? 3 : 0;
+      neighbors[fa].neighbor[ka] = fb;
+      neighbors[fa].which_vertex_not[ka] = (kb + 2) % 3 + flipped;
+      neighbors[fb].neighbor[kb] = fa;
+      neighbors[fb].which_vertex_not[kb] = (ka + 2) % 3 + flipped;
+      i++;
+    }
+}
+
+template class stl_indexed_mesh<int>;
+template class stl_indexed_mesh<int64_t>;
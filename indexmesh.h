@@ -0,0 +1,54 @@
+#ifndef INDEXMESH_H
+#define INDEXMESH_H
+
+#include <vector>
+#include "stl.h"
+
+/* A welded mesh whose facet, vertex and neighbor indices are Index wide.
+ * The stl class keeps its compact int layout; stl_indexed_mesh64 takes
+ * the scans that don't fit, up to 2^62 facets, at twice the index memory.
+ * Every loop that touches indices is compiled once per width, so the
+ * 32-bit instantiation is exactly as compact as the stl arrays.
+ *
+ * Only the stages listed here are templated: reading binary STL,
+ * welding and pairing neighbors.  The repairs, slicing, hashing and the
+ * writers all stay on the stl class and its int indices, so a mesh past
+ * 2^31 facets can be loaded and have its topology checked here, but has
+ * to be cut into parts that fit an int before anything else runs on it.
+ *
+ * vertices, indices and neighbors mirror v_shared, v_indices and
+ * neighbors_start, including the ADMesh which_vertex_not convention.
+ */
+template <typename Index>
+class stl_indexed_mesh
+{
+public:
+    Index number_of_facets() const   { return (Index) indices.size(); }
+    Index number_of_vertices() const { return (Index) vertices.size(); }
+
+    /* Streams a binary STL of any size and welds the corners that are
+       bit-identical.  ASCII files that big are not worth supporting. */
+    stl_status read_binary(char *file, stl_progress_fn progress,
+                           void *user_data);
+
+    /* Copies a loaded mesh, welding its facets if it has no shared
+       vertices yet. */
+    void from_stl(const stl &mesh);
+
+    /* Pairs facets sharing an edge by sorting the edges, the same
+       result stl::check_facets_exact() gets from its hash; like the
+       hash, it never pairs two edges of one facet. */
+    void check_facets_exact();
+
+    std::vector<stl_vertex>               vertices;
+    std::vector<v_indices_t<Index> >      indices;
+    std::vector<stl_neighbors_t<Index> >  neighbors;
+
+private:
+    void weld(const std::vector<stl_vertex> &corners);
+};
+
+typedef stl_indexed_mesh<int>     stl_indexed_mesh32;
+typedef stl_indexed_mesh<int64_t> stl_indexed_mesh64;
+
+#endif // INDEXMESH_H
@@ -0,0 +1,586 @@
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <math.h>
+#include <algorithm>
+#include "intersect.h"
+#include "parallel.h"
+
+using namespace std;
+
+/* Most cells per side of the grid. */
+#define INTERSECT_MAX_CELLS 1024
+
+/* Cells per parallel chunk. */
+#define INTERSECT_GRAIN 256
+
+typedef struct
+{
+  double x;
+  double y;
+  double z;
+}stl_point3;
+
+/* A facet's box and the cell range it covers, inclusive. */
+typedef struct
+{
+  float min[3];
+  float max[3];
+  int   lo[3];
+  int   hi[3];
+}stl_cell_range;
+
+static inline stl_point3 stl_intersect_point(const stl_vertex &v)
+{
+  stl_point3 p = {v.x, v.y, v.z};
+  return p;
+}
+
+/* Exact signs of the orientation determinants, after Shewchuk's
+   "Adaptive Precision Floating-Point Arithmetic and Fast Robust
+   Geometric Predicates".  The determinant is first evaluated in double
+   precision; if it is further from zero than its worst-case rounding
+   error its sign is right.  Otherwise it is summed again without error:
+   every point comes from a float, so each product of two coordinates is
+   exact in a double, a third factor leaves a two-term product, and the
+   terms are added into a floating-point expansion. */
+
+/* Most terms an exact sum here can hold: 24 two-term products. */
+#define INTERSECT_EXPANSION 64
+
+static const double stl_epsilon = 1.1102230246251565e-16;   /* 2^-53 */
+static const double stl_splitter = 134217729.0;             /* 2^27 + 1 */
+static const double stl_ccw_bound = (3.0 + 16.0 * stl_epsilon) * stl_epsilon;
+static const double stl_o3d_bound = (7.0 + 56.0 * stl_epsilon) * stl_epsilon;
+
+/* x + y == a + b exactly, x being the rounded sum. */
+static inline void stl_two_sum(double a, double b, double *x, double *y)
+{
+  double bv;
+  double av;
+
+  *x = a + b;
+  bv = *x - a;
+  av = *x - bv;
+  *y = (a - av) + (b - bv);
+}
+
+/* x + y == a * b exactly, x being the rounded product (Dekker). */
+static inline void stl_two_product(double a, double b, double *x, double *y)
+{
+  double c;
+  double a_hi;
+  double a_lo;
+  double b_hi;
+  double b_lo;
+
+  *x = a * b;
+  c = stl_splitter * a;
+  a_hi = c - (c - a);
+  a_lo = a - a_hi;
+  c = stl_splitter * b;
+  b_hi = c - (c - b);
+  b_lo = b - b_hi;
+  *y = a_lo * b_lo - (((*x - a_hi * b_hi) - a_lo * b_hi) - a_hi * b_lo);
+}
+
+/* An exact sum of doubles, kept as nonoverlapping components of
+   increasing magnitude with the zeros dropped. */
+typedef struct
+{
+  double component[INTERSECT_EXPANSION];
+  int    length;
+}stl_expansion;
+
+static inline void stl_expansion_add(stl_expansion *e, double b)
+{
+  double q = b;
+  double sum;
+  double error;
+  int    length = 0;
+  int    i;
+
+  for(i = 0; i < e->length; i++)
+    {
+      stl_two_sum(q, e->component[i], &sum, &error);
+      q = sum;
+      if(error != 0.0)
+        {
+          e->component[length++] = error;
+        }
+    }
+  if(q != 0.0 || length == 0)
+    {
+      e->component[length++] = q;
+    }
+  e->length = length;
+}
+
+/* Adds sign * a * b * c; a * b is exact since all three are floats. */
+static inline void stl_expansion_add_product(stl_expansion *e, double sign,
+                                             double a, double b, double c)
+{
+  double x;
+  double y;
+
+  stl_two_product(a * b, c, &x, &y);
+  stl_expansion_add(e, sign * y);
+  stl_expansion_add(e, sign * x);
+}
+
+static inline int stl_sign(double value)
+{
+  return (value > 0.0) - (value < 0.0);
+}
+
+/* The largest component decides the sign. */
+static inline int stl_expansion_sign(const stl_expansion &e)
+{
+  return stl_sign(e.component[e.length - 1]);
+}
+
+/* Adds sign * det(p, q, r) with p, q, r as rows. */
+static void stl_expansion_add_det3(stl_expansion *e, double sign,
+                                   const stl_point3 &p, const stl_point3 &q,
+                                   const stl_point3 &r)
+{
+  stl_expansion_add_product(e, sign, p.x, q.y, r.z);
+  stl_expansion_add_product(e, -sign, p.x, q.z, r.y);
+  stl_expansion_add_product(e, -sign, p.y, q.x, r.z);
+  stl_expansion_add_product(e, sign, p.y, q.z, r.x);
+  stl_expansion_add_product(e, sign, p.z, q.x, r.y);
+  stl_expansion_add_product(e, -sign, p.z, q.y, r.x);
+}
+
+/* Sign of six times the signed volume of a, b, c, d; zero when they are
+   coplanar. */
+static int stl_orient3d(const stl_point3 &a, const stl_point3 &b,
+                        const stl_point3 &c, const stl_point3 &d)
+{
+  double        ax = a.x - d.x, ay = a.y - d.y, az = a.z - d.z;
+  double        bx = b.x - d.x, by = b.y - d.y, bz = b.z - d.z;
+  double        cx = c.x - d.x, cy = c.y - d.y, cz = c.z - d.z;
+  double        bc = by * cz - bz * cy;
+  double        ca = bx * cz - bz * cx;
+  double        ab = bx * cy - by * cx;
+  double        det = ax * bc - ay * ca + az * ab;
+  double        permanent;
+  stl_expansion exact;
+
+  permanent = fabs(ax) * (fabs(by * cz) + fabs(bz * cy))
+              + fabs(ay) * (fabs(bx * cz) + fabs(bz * cx))
+              + fabs(az) * (fabs(bx * cy) + fabs(by * cx));
+  if(fabs(det) > stl_o3d_bound * permanent)
+    {
+      return stl_sign(det);
+    }
+
+  /* The 4x4 determinant with a column of ones, by its last column. */
+  exact.length = 0;
+  stl_expansion_add_det3(&exact, -1.0, b, c, d);
+  stl_expansion_add_det3(&exact, 1.0, a, c, d);
+  stl_expansion_add_det3(&exact, -1.0, a, b, d);
+  stl_expansion_add_det3(&exact, 1.0, a, b, c);
+  return stl_expansion_sign(exact);
+}
+
+static int stl_orient2d(const double *a, const double *b, const double *c)
+{
+  double        left = (b[0] - a[0]) * (c[1] - a[1]);
+  double        right = (b[1] - a[1]) * (c[0] - a[0]);
+  double        det = left - right;
+  stl_expansion exact;
+
+  if(fabs(det) > stl_ccw_bound * (fabs(left) + fabs(right)))
+    {
+      return stl_sign(det);
+    }
+
+  /* Products of two floats are exact, so six terms do it. */
+  exact.length = 0;
+  stl_expansion_add(&exact, a[0] * b[1]);
+  stl_expansion_add(&exact, -a[1] * b[0]);
+  stl_expansion_add(&exact, b[0] * c[1]);
+  stl_expansion_add(&exact, -b[1] * c[0]);
+  stl_expansion_add(&exact, c[0] * a[1]);
+  stl_expansion_add(&exact, -c[1] * a[0]);
+  return stl_expansion_sign(exact);
+}
+
+static bool stl_segments_touch_2d(const double *p, const double *q,
+                                  const double *a, const double *b)
+{
+  int o1 = stl_orient2d(p, q, a);
+  int o2 = stl_orient2d(p, q, b);
+  int o3 = stl_orient2d(a, b, p);
+  int o4 = stl_orient2d(a, b, q);
+
+  if(o1 * o2 < 0 && o3 * o4 < 0)
+    {
+      return true;
+    }
+  /* Collinear touching: the point must lie within the other's box. */
+  for(int k = 0; k < 4; k++)
+    {
+      const double *s0 = k < 2 ? p : a;
+      const double *s1 = k < 2 ? q : b;
+      const double *t = k == 0 ? a : k == 1 ? b : k == 2 ? p : q;
+      int           o = k == 0 ? o1 : k == 1 ? o2 : k == 2 ? o3 : o4;
+
+      if(o == 0
+         && STL_MIN(s0[0], s1[0]) <= t[0] && t[0] <= STL_MAX(s0[0], s1[0])
+         && STL_MIN(s0[1], s1[1]) <= t[1] && t[1] <= STL_MAX(s0[1], s1[1]))
+        {
+          return true;
+        }
+    }
+  return false;
+}
+
+/* Segment and triangle in one plane: drop the axis the plane faces
+   most and work in 2D. */
+static bool stl_segment_triangle_2d(const stl_point3 &p, const stl_point3 &q,
+                                    const stl_point3 *t)
+{
+  double nx = (t[1].y - t[0].y) * (t[2].z - t[0].z)
+              - (t[1].z - t[0].z) * (t[2].y - t[0].y);
+  double ny = (t[1].z - t[0].z) * (t[2].x - t[0].x)
+              - (t[1].x - t[0].x) * (t[2].z - t[0].z);
+  double nz = (t[1].x - t[0].x) * (t[2].y - t[0].y)
+              - (t[1].y - t[0].y) * (t[2].x - t[0].x);
+  int    u = 0;
+  int    v = 1;
+  double p2[2];
+  double q2[2];
+  double t2[3][2];
+  int    k;
+
+  if(fabs(nx) >= fabs(ny) && fabs(nx) >= fabs(nz))
+    {
+      u = 1;
+      v = 2;
+    }
+  else if(fabs(ny) >= fabs(nz))
+    {
+      u = 2;
+      v = 0;
+    }
+  p2[0] = (&p.x)[u];
+  p2[1] = (&p.x)[v];
+  q2[0] = (&q.x)[u];
+  q2[1] = (&q.x)[v];
+  for(k = 0; k < 3; k++)
+    {
+      t2[k][0] = (&t[k].x)[u];
+      t2[k][1] = (&t[k].x)[v];
+    }
+
+  for(k = 0; k < 3; k++)
+    {
+      if(stl_segments_touch_2d(p2, q2, t2[k], t2[(k + 1) % 3]))
+        {
+          return true;
+        }
+    }
+  /* Otherwise only a segment wholly inside can meet the triangle. */
+  int s0 = stl_orient2d(t2[0], t2[1], p2);
+  int s1 = stl_orient2d(t2[1], t2[2], p2);
+  int s2 = stl_orient2d(t2[2], t2[0], p2);
+  return (s0 >= 0 && s1 >= 0 && s2 >= 0) || (s0 <= 0 && s1 <= 0 && s2 <= 0);
+}
+
+static bool stl_segment_triangle(const stl_point3 &p, const stl_point3 &q,
+                                 const stl_point3 *t)
+{
+  int sp = stl_orient3d(t[0], t[1], t[2], p);
+  int sq = stl_orient3d(t[0], t[1], t[2], q);
+  int s0;
+  int s1;
+  int s2;
+
+  if(sp * sq > 0)
+    {
+      return false;
+    }
+  if(sp == 0 && sq == 0)
+    {
+      return stl_segment_triangle_2d(p, q, t);
+    }
+  /* The segment crosses the plane; it hits the triangle if it passes
+     on the same side of all three edges. */
+  s0 = stl_orient3d(p, q, t[0], t[1]);
+  s1 = stl_orient3d(p, q, t[1], t[2]);
+  s2 = stl_orient3d(p, q, t[2], t[0]);
+  return (s0 >= 0 && s1 >= 0 && s2 >= 0) || (s0 <= 0 && s1 <= 0 && s2 <= 0);
+}
+
+static inline bool stl_same_vertex(const stl_vertex &a, const stl_vertex &b)
+{
+  return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+static bool stl_facets_intersect(const stl &mesh, int fa, int fb)
+{
+  const stl_facet &a = mesh.facet_start[fa];
+  const stl_facet &b = mesh.facet_start[fb];
+  stl_point3       ta[3];
+  stl_point3       tb[3];
+  int              shared = 0;
+  int              shared_a = -1;
+  int              shared_b = -1;
+  int              i;
+  int              j;
+
+  for(i = 0; i < 3; i++)
+    {
+      for(j = 0; j < 3; j++)
+        {
+          if(stl_same_vertex(a.vertex[i], b.vertex[j]))
+            {
+              shared++;
+              shared_a = i;
+              shared_b = j;
+            }
+        }
+      ta[i] = stl_intersect_point(a.vertex[i]);
+      tb[i] = stl_intersect_point(b.vertex[i]);
+    }
+  if(shared >= 2)
+    {
+      return false;
+    }
+  if(shared == 1)
+    {
+      /* Meeting at the common corner is fine; anything more shows up
+         as an opposite edge passing through the other facet. */
+      return stl_segment_triangle(ta[(shared_a + 1) % 3],
+                                  ta[(shared_a + 2) % 3], tb)
+             || stl_segment_triangle(tb[(shared_b + 1) % 3],
+                                     tb[(shared_b + 2) % 3], ta);
+    }
+  for(i = 0; i < 3; i++)
+    {
+      if(stl_segment_triangle(ta[i], ta[(i + 1) % 3], tb)
+         || stl_segment_triangle(tb[i], tb[(i + 1) % 3], ta))
+        {
+          return true;
+        }
+    }
+  return false;
+}
+
+static bool stl_facet_pair_less(const stl_facet_pair &a,
+                                const stl_facet_pair &b)
+{
+  if(a.facet_a != b.facet_a)
+    {
+      return a.facet_a < b.facet_a;
+    }
+  return a.facet_b < b.facet_b;
+}
+
+void stl_find_self_intersections(const stl &mesh,
+                                 vector<stl_facet_pair> &pairs)
+{
+  int                    n = mesh.stats.number_of_facets;
+  vector<stl_cell_range> ranges(n);
+  vector<int>            cell_start;
+  vector<int>            cell_facets;
+  float                  box_min[3];
+  float                  box_max[3];
+  float                  cell_size;
+  int                    side[3];
+  int                    cells;
+  QMutex                 mutex;
+  int                    i;
+  int                    k;
+
+  pairs.clear();
+  if(n < 2 || mesh.facet_start == NULL)
+    {
+      return;
+    }
+
+  for(k = 0; k < 3; k++)
+    {
+      box_min[k] = box_max[k] = (&mesh.facet_start[0].vertex[0].x)[k];
+    }
+  for(i = 0; i < n; i++)
+    {
+      for(int c = 0; c < 3; c++)
+        {
+          for(k = 0; k < 3; k++)
+            {
+              float value = (&mesh.facet_start[i].vertex[c].x)[k];
+              box_min[k] = STL_MIN(box_min[k], value);
+              box_max[k] = STL_MAX(box_max[k], value);
+            }
+        }
+    }
+
+  /* Cubic cells, about as many as there are facets. */
+  double volume = 1.0;
+  double extent = 0.0;
+  for(k = 0; k < 3; k++)
+    {
+      extent = STL_MAX(extent, (double) box_max[k] - box_min[k]);
+    }
+  for(k = 0; k < 3; k++)
+    {
+      volume *= STL_MAX((double) box_max[k] - box_min[k], extent * 1e-3);
+    }
+  cell_size = (float) cbrt(volume / n);
+  if(!(cell_size > 0.0))
+    {
+      cell_size = 1.0;
+    }
+  cells = 1;
+  for(k = 0; k < 3; k++)
+    {
+      side[k] = (int) ((box_max[k] - box_min[k]) / cell_size) + 1;
+      side[k] = STL_MAX(1, STL_MIN(side[k], INTERSECT_MAX_CELLS));
+      cells *= side[k];
+    }
+  while(cells > 2 * n + 1)
+    {
+      cells = 1;
+      for(k = 0; k < 3; k++)
+        {
+          side[k] = STL_MAX(1, side[k] / 2);
+          cells *= side[k];
+        }
+    }
+
+  stl_parallel_for(n, INTERSECT_GRAIN * 16, [&](int begin, int end)
+    {
+      for(int f = begin; f < end; f++)
+        {
+          for(int axis = 0; axis < 3; axis++)
+            {
+              float lo = (&mesh.facet_start[f].vertex[0].x)[axis];
+              float hi = lo;
+              for(int c = 1; c < 3; c++)
+                {
+                  float value = (&mesh.facet_start[f].vertex[c].x)[axis];
+                  lo = STL_MIN(lo, value);
+                  hi = STL_MAX(hi, value);
+                }
+              ranges[f].min[axis] = lo;
+              ranges[f].max[axis] = hi;
+              float scale = side[axis] / STL_MAX(box_max[axis] - box_min[axis],
+                                                 1e-30f);
+              ranges[f].lo[axis] = STL_MIN((int) ((lo - box_min[axis]) * scale),
+                                           side[axis] - 1);
+              ranges[f].hi[axis] = STL_MIN((int) ((hi - box_min[axis]) * scale),
+                                           side[axis] - 1);
+            }
+        }
+    });
+
+  /* Counting sort of the facets into cells. */
+  cell_start.assign(cells + 1, 0);
+  for(int pass = 0; pass < 2; pass++)
+    {
+      for(i = 0; i < n; i++)
+        {
+          const stl_cell_range &r = ranges[i];
+          int                   x;
+          int                   y;
+          int                   z;
+
+          for(z = r.lo[2]; z <= r.hi[2]; z++)
+            {
+              for(y = r.lo[1]; y <= r.hi[1]; y++)
+                {
+                  for(x = r.lo[0]; x <= r.hi[0]; x++)
+                    {
+                      int cell = (z * side[1] + y) * side[0] + x;
+                      if(pass == 0)
+                        {
+                          cell_start[cell + 1]++;
+                        }
+                      else
+                        {
+                          cell_facets[cell_start[cell]++] = i;
+                        }
+                    }
+                }
+            }
+        }
+      if(pass == 0)
+        {
+          for(k = 0; k < cells; k++)
+            {
+              cell_start[k + 1] += cell_start[k];
+            }
+          cell_facets.resize(cell_start[cells]);
+        }
+      else
+        {
+          /* The fill moved every start to the next cell's. */
+          for(k = cells; k > 0; k--)
+            {
+              cell_start[k] = cell_start[k - 1];
+            }
+          cell_start[0] = 0;
+        }
+    }
+
+  stl_parallel_for(cells, INTERSECT_GRAIN, [&](int begin, int end)
+    {
+      vector<stl_facet_pair> found;
+
+      for(int cell = begin; cell < end; cell++)
+        {
+          int x = cell % side[0];
+          int y = cell / side[0] % side[1];
+          int z = cell / (side[0] * side[1]);
+
+          for(int p = cell_start[cell]; p < cell_start[cell + 1]; p++)
+            {
+              int                   fa = cell_facets[p];
+              const stl_cell_range &ra = ranges[fa];
+
+              for(int q = p + 1; q < cell_start[cell + 1]; q++)
+                {
+                  int                   fb = cell_facets[q];
+                  const stl_cell_range &rb = ranges[fb];
+                  bool                  adjacent = false;
+
+                  /* Only the first cell both boxes cover tests the pair. */
+                  if(STL_MAX(ra.lo[0], rb.lo[0]) != x
+                     || STL_MAX(ra.lo[1], rb.lo[1]) != y
+                     || STL_MAX(ra.lo[2], rb.lo[2]) != z
+                     || ra.max[0] < rb.min[0] || rb.max[0] < ra.min[0]
+                     || ra.max[1] < rb.min[1] || rb.max[1] < ra.min[1]
+                     || ra.max[2] < rb.min[2] || rb.max[2] < ra.min[2])
+                    {
+                      continue;
+                    }
+                  if(mesh.neighbors_start != NULL)
+                    {
+                      for(int e = 0; e < 3; e++)
+                        {
+                          adjacent |= mesh.neighbors_start[fa].neighbor[e] == fb;
+                        }
+                    }
+                  if(adjacent || !stl_facets_intersect(mesh, fa, fb))
+                    {
+                      continue;
+                    }
+
+                  stl_facet_pair pair;
+                  pair.facet_a = STL_MIN(fa, fb);
+                  pair.facet_b = STL_MAX(fa, fb);
+                  found.push_back(pair);
+                }
+            }
+        }
+      if(!found.empty())
+        {
+          QMutexLocker locker(&mutex);
+          pairs.insert(pairs.end(), found.begin(), found.end());
+        }
+    });
+
+  sort(pairs.begin(), pairs.end(), stl_facet_pair_less);
+}
@@ -0,0 +1,31 @@
+#ifndef INTERSECT_H
+#define INTERSECT_H
+
+#include <vector>
+#include "stl.h"
+
+/* Two facets that cross or touch, facet_a < facet_b. */
+typedef struct
+{
+  int facet_a;
+  int facet_b;
+}stl_facet_pair;
+
+/* Finds every pair of facets that intersect other than where they are
+ * supposed to meet.  Facets are binned into a uniform grid of about one
+ * cell per facet, and each pair sharing a cell is tested once, in the
+ * first cell their boxes share, with the cells spread over the thread
+ * pool.  Pairs that are neighbors in neighbors_start (if built) or share
+ * two corners are skipped; pairs sharing one corner only count if an
+ * opposite edge of one passes through the other.  The orientation tests
+ * are exact: a double precision estimate is trusted only outside its
+ * error bound, and anything closer is summed again without rounding, so
+ * flat or nearly flat regions such as tessellated CAD faces don't show
+ * up as intersections.
+ *
+ * pairs comes back sorted by facet_a, then facet_b.
+ */
+void stl_find_self_intersections(const stl &mesh,
+                                 std::vector<stl_facet_pair> &pairs);
+
+#endif // INTERSECT_H
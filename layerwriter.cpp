@@ -0,0 +1,375 @@
+#include <QtCore/QMutex>
+#include <QtCore/QRunnable>
+#include <QtCore/QSemaphore>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
+#include <QtCore/QWaitCondition>
+#include <math.h>
+#include "layerwriter.h"
+
+using namespace std;
+
+stl_status stl_layer_sink::begin(const stl_slice_params &, int)
+{
+    return STL_OK;
+}
+
+stl_status stl_layer_sink::end()
+{
+    return STL_OK;
+}
+
+static stl_status stl_sink_close(FILE **fp)
+{
+    int failed;
+
+    if(*fp == NULL)
+        return STL_ERR_WRITE;
+    failed = ferror(*fp);
+    if(fclose(*fp) != 0)
+        failed = 1;
+    *fp = NULL;
+    return failed ? STL_ERR_WRITE : STL_OK;
+}
+
+stl_svg_sink::stl_svg_sink(char *file, float min_x, float min_y,
+                           float max_x, float max_y)
+    : min_x(min_x), min_y(min_y), max_x(max_x), max_y(max_y)
+{
+    fp = fopen(file, "w");
+}
+
+stl_svg_sink::~stl_svg_sink()
+{
+    if(fp != NULL)
+        fclose(fp);
+}
+
+stl_status stl_svg_sink::begin(const stl_slice_params &, int)
+{
+    if(fp == NULL)
+        return STL_ERR_OPEN;
+    fprintf(fp, "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n");
+    fprintf(fp, "<svg width=\"%gmm\" height=\"%gmm\" viewBox=\"0 0 %g %g\" "
+            "xmlns=\"http://www.w3.org/2000/svg\" "
+            "xmlns:slic3r=\"http://slic3r.org/namespaces/slic3r\">\n",
+            max_x - min_x, max_y - min_y, max_x - min_x, max_y - min_y);
+    return ferror(fp) ? STL_ERR_WRITE : STL_OK;
+}
+
+stl_status stl_svg_sink::write_layer(int index, const stl_layer &layer)
+{
+    size_t c;
+    size_t p;
+    int    open_chains = 0;
+
+    fprintf(fp, "  <g id=\"layer%d\" slic3r:z=\"%g\">\n", index, layer.z);
+    fprintf(fp, "    <path fill=\"black\" fill-rule=\"evenodd\" d=\"");
+    for(c = 0; c < layer.contours.size(); c++)
+      {
+        const stl_contour &contour = layer.contours[c];
+        if(!contour.closed)
+          {
+            open_chains++;
+            continue;
+          }
+        for(p = 0; p < contour.points.size(); p++)
+            fprintf(fp, "%c%g %g ", p == 0 ? 'M' : 'L',
+                    contour.points[p].x - min_x, max_y - contour.points[p].y);
+        fprintf(fp, "z ");
+      }
+    fprintf(fp, "\"/>\n");
+    if(open_chains > 0)
+      {
+        fprintf(fp, "    <path fill=\"none\" stroke=\"red\" stroke-width=\"0.1\" d=\"");
+        for(c = 0; c < layer.contours.size(); c++)
+          {
+            const stl_contour &contour = layer.contours[c];
+            if(contour.closed)
+                continue;
+            for(p = 0; p < contour.points.size(); p++)
+                fprintf(fp, "%c%g %g ", p == 0 ? 'M' : 'L',
+                        contour.points[p].x - min_x,
+                        max_y - contour.points[p].y);
+          }
+        fprintf(fp, "\"/>\n");
+      }
+    fprintf(fp, "  </g>\n");
+    return ferror(fp) ? STL_ERR_WRITE : STL_OK;
+}
+
+stl_status stl_svg_sink::end()
+{
+    if(fp != NULL)
+        fprintf(fp, "</svg>\n");
+    return stl_sink_close(&fp);
+}
+
+stl_gcode_sink::stl_gcode_sink(char *file, float feed_rate, float travel_rate,
+                               float extrusion_per_mm)
+    : feed_rate(feed_rate), travel_rate(travel_rate),
+      extrusion_per_mm(extrusion_per_mm), extruded(0.0)
+{
+    fp = fopen(file, "w");
+}
+
+stl_gcode_sink::~stl_gcode_sink()
+{
+    if(fp != NULL)
+        fclose(fp);
+}
+
+stl_status stl_gcode_sink::begin(const stl_slice_params &params, int layer_count)
+{
+    if(fp == NULL)
+        return STL_ERR_OPEN;
+    fprintf(fp, "; %d layers of %g mm\n", layer_count, params.layer_height);
+    fprintf(fp, "G21\nG90\n");
+    if(extrusion_per_mm > 0.0)
+        fprintf(fp, "M82\nG92 E0\n");
+    extruded = 0.0;
+    return ferror(fp) ? STL_ERR_WRITE : STL_OK;
+}
+
+stl_status stl_gcode_sink::write_layer(int index, const stl_layer &layer)
+{
+    size_t c;
+    size_t p;
+
+    fprintf(fp, ";LAYER:%d\n", index);
+    fprintf(fp, "G0 Z%.3f F%g\n", layer.z, travel_rate);
+    for(c = 0; c < layer.contours.size(); c++)
+      {
+        const stl_contour &contour = layer.contours[c];
+        size_t count = contour.points.size();
+        size_t steps = contour.closed ? count : count - 1;
+
+        if(count < 2)
+            continue;
+        fprintf(fp, "G0 X%.3f Y%.3f F%g\n", contour.points[0].x,
+                contour.points[0].y, travel_rate);
+        for(p = 1; p <= steps; p++)
+          {
+            const stl_point2 &a = contour.points[p - 1];
+            const stl_point2 &b = contour.points[p % count];
+
+            if(extrusion_per_mm > 0.0)
+              {
+                extruded += extrusion_per_mm
+                            * sqrt((b.x - a.x) * (b.x - a.x)
+                                   + (b.y - a.y) * (b.y - a.y));
+                fprintf(fp, "G1 X%.3f Y%.3f E%.5f", b.x, b.y, extruded);
+              }
+            else
+              {
+                fprintf(fp, "G1 X%.3f Y%.3f", b.x, b.y);
+              }
+            if(p == 1)
+                fprintf(fp, " F%g", feed_rate);
+            fputc('\n', fp);
+          }
+      }
+    return ferror(fp) ? STL_ERR_WRITE : STL_OK;
+}
+
+stl_status stl_gcode_sink::end()
+{
+    if(fp != NULL)
+        fprintf(fp, "; end\n");
+    return stl_sink_close(&fp);
+}
+
+stl_contour_sink::stl_contour_sink(char *file)
+{
+    fp = fopen(file, "w");
+}
+
+stl_contour_sink::~stl_contour_sink()
+{
+    if(fp != NULL)
+        fclose(fp);
+}
+
+stl_status stl_contour_sink::begin(const stl_slice_params &, int)
+{
+    return fp == NULL ? STL_ERR_OPEN : STL_OK;
+}
+
+stl_status stl_contour_sink::write_layer(int index, const stl_layer &layer)
+{
+    size_t c;
+    size_t p;
+
+    fprintf(fp, "layer %d %g %d\n", index, layer.z, (int) layer.contours.size());
+    for(c = 0; c < layer.contours.size(); c++)
+      {
+        const stl_contour &contour = layer.contours[c];
+        fprintf(fp, "contour %s %d\n", contour.closed ? "closed" : "open",
+                (int) contour.points.size());
+        for(p = 0; p < contour.points.size(); p++)
+            fprintf(fp, "%g %g\n", contour.points[p].x, contour.points[p].y);
+      }
+    return ferror(fp) ? STL_ERR_WRITE : STL_OK;
+}
+
+stl_status stl_contour_sink::end()
+{
+    return stl_sink_close(&fp);
+}
+
+/* Shared between the writer and the slicing helpers; everything below
+ * the slicer is guarded by lock.
+ */
+class stl_slice_pipeline
+{
+public:
+    stl_slice_pipeline(const stl_slicer &slicer, const stl_slice_params &params,
+                       size_t memory_bound)
+        : slicer(slicer), params(params), memory_bound(memory_bound),
+          count(stl_slice_layer_count(&params)), layers(count), ready(count),
+          next_slice(0), next_write(0), queued(0), stop(false) {}
+
+    /* Called with lock held.  Returns the next layer to cut or -1 if the
+       caller has to wait (or stop, when there is nothing left). */
+    int claim(bool writer)
+    {
+        if(stop || next_slice >= count)
+            return -1;
+        if(next_slice != next_write && (writer || queued >= memory_bound))
+            return -1;
+        return next_slice++;
+    }
+
+    /* Called with lock held; drops it while cutting. */
+    void produce(int index)
+    {
+        stl_layer layer;
+
+        lock.unlock();
+        slicer.slice_layer(stl_slice_layer_z(&params, index), layer);
+        lock.lock();
+        layers[index].z = layer.z;
+        layers[index].area = layer.area;
+        layers[index].perimeter = layer.perimeter;
+        layers[index].contours.swap(layer.contours);
+        ready[index] = 1;
+        queued += stl_layer_bytes(layers[index]);
+        changed.wakeAll();
+    }
+
+    const stl_slicer       &slicer;
+    stl_slice_params        params;
+    size_t                  memory_bound;
+    int                     count;
+
+    QMutex                  lock;
+    QWaitCondition          changed;
+    QSemaphore              finished;
+    vector<stl_layer>       layers;
+    vector<char>            ready;
+    int                     next_slice;
+    int                     next_write;
+    size_t                  queued;
+    bool                    stop;
+};
+
+class stl_slice_helper : public QRunnable
+{
+public:
+    stl_slice_helper(stl_slice_pipeline *pipeline) : pipeline(pipeline) {}
+
+    void run()
+    {
+        pipeline->lock.lock();
+        for(;;)
+          {
+            int index = pipeline->claim(false);
+            if(index >= 0)
+                pipeline->produce(index);
+            else if(pipeline->stop || pipeline->next_slice >= pipeline->count)
+                break;
+            else
+                pipeline->changed.wait(&pipeline->lock);
+          }
+        pipeline->lock.unlock();
+        pipeline->finished.release();
+    }
+
+private:
+    stl_slice_pipeline *pipeline;
+};
+
+stl_status stl_slice_to_sink(const stl_slicer &slicer,
+                             const stl_slice_params &params,
+                             stl_layer_sink &sink, size_t memory_bound,
+                             stl_progress_fn progress, void *user_data)
+{
+    stl_slice_pipeline pipeline(slicer, params, memory_bound);
+    stl_status         status;
+    stl_status         closed;
+    int                helpers = QThread::idealThreadCount() - 1;
+    int                started;
+
+    status = sink.begin(params, pipeline.count);
+    if(status != STL_OK)
+      {
+        sink.end();
+        return status;
+      }
+
+    for(started = 0; started < helpers && started < pipeline.count; started++)
+      {
+        stl_slice_helper *helper = new stl_slice_helper(&pipeline);
+        if(!QThreadPool::globalInstance()->tryStart(helper))
+          {
+            delete helper;
+            break;
+          }
+      }
+
+    /* The writer only cuts the layer it is waiting for itself, so it never
+       gets stuck behind a layer it doesn't need yet. */
+    pipeline.lock.lock();
+    while(status == STL_OK && pipeline.next_write < pipeline.count)
+      {
+        int index = pipeline.next_write;
+
+        if(pipeline.ready[index])
+          {
+            stl_layer layer;
+            size_t    bytes;
+
+            layer.z = pipeline.layers[index].z;
+            layer.area = pipeline.layers[index].area;
+            layer.perimeter = pipeline.layers[index].perimeter;
+            layer.contours.swap(pipeline.layers[index].contours);
+            pipeline.ready[index] = 0;
+            bytes = stl_layer_bytes(layer);
+            pipeline.lock.unlock();
+
+            status = sink.write_layer(index, layer);
+            if(status == STL_OK && progress != NULL
+               && !progress((float) (index + 1) / pipeline.count, user_data))
+                status = STL_CANCELLED;
+
+            pipeline.lock.lock();
+            pipeline.queued -= bytes;
+            pipeline.next_write++;
+            pipeline.changed.wakeAll();
+            continue;
+          }
+
+        index = pipeline.claim(true);
+        if(index >= 0)
+            pipeline.produce(index);
+        else
+            pipeline.changed.wait(&pipeline.lock);
+      }
+    pipeline.stop = true;
+    pipeline.changed.wakeAll();
+    pipeline.lock.unlock();
+    pipeline.finished.acquire(started);
+
+    closed = sink.end();
+    return status != STL_OK ? status : closed;
+}
@@ -0,0 +1,111 @@
+#ifndef LAYERWRITER_H
+#define LAYERWRITER_H
+
+#include <stdio.h>
+#include "slice.h"
+
+/* A destination for finished layers.  write_layer() is called from a
+ * single thread, strictly in layer order, so sinks need no locking.  The
+ * file sinks open their file on construction and report a failure to do
+ * so from begin().
+ */
+class stl_layer_sink
+{
+public:
+    virtual ~stl_layer_sink() {}
+
+    virtual stl_status begin(const stl_slice_params &params, int layer_count);
+    virtual stl_status write_layer(int index, const stl_layer &layer) = 0;
+    virtual stl_status end();
+};
+
+/* An SVG layer stack: one <g> per layer with the cut height in a slic3r:z
+ * attribute.  Closed contours of a layer form one even-odd filled path,
+ * open chains are stroked.  The bounds size the canvas; y points up as in
+ * the mesh.
+ */
+class stl_svg_sink : public stl_layer_sink
+{
+public:
+    stl_svg_sink(char *file, float min_x, float min_y, float max_x, float max_y);
+    ~stl_svg_sink();
+
+    stl_status begin(const stl_slice_params &params, int layer_count);
+    stl_status write_layer(int index, const stl_layer &layer);
+    stl_status end();
+
+private:
+    FILE  *fp;
+    float  min_x;
+    float  min_y;
+    float  max_x;
+    float  max_y;
+
+    stl_svg_sink(const stl_svg_sink &);
+    stl_svg_sink &operator=(const stl_svg_sink &);
+};
+
+/* G-code style perimeter toolpaths: every contour is traced once with a
+ * travel move to its start.  extrusion_per_mm of 0 leaves out E words.
+ */
+class stl_gcode_sink : public stl_layer_sink
+{
+public:
+    stl_gcode_sink(char *file, float feed_rate, float travel_rate,
+                   float extrusion_per_mm);
+    ~stl_gcode_sink();
+
+    stl_status begin(const stl_slice_params &params, int layer_count);
+    stl_status write_layer(int index, const stl_layer &layer);
+    stl_status end();
+
+private:
+    FILE   *fp;
+    float   feed_rate;
+    float   travel_rate;
+    float   extrusion_per_mm;
+    double  extruded;
+
+    stl_gcode_sink(const stl_gcode_sink &);
+    stl_gcode_sink &operator=(const stl_gcode_sink &);
+};
+
+/* Plain text dump of the contours, one point per line:
+ *   layer <index> <z> <contours>
+ *   contour <closed|open> <points>
+ *   <x> <y>
+ */
+class stl_contour_sink : public stl_layer_sink
+{
+public:
+    stl_contour_sink(char *file);
+    ~stl_contour_sink();
+
+    stl_status begin(const stl_slice_params &params, int layer_count);
+    stl_status write_layer(int index, const stl_layer &layer);
+    stl_status end();
+
+private:
+    FILE  *fp;
+
+    stl_contour_sink(const stl_contour_sink &);
+    stl_contour_sink &operator=(const stl_contour_sink &);
+};
+
+/* Slices every layer of params and hands the layers to the sink in order
+ * while later layers are still being cut.  Pool threads slice; the
+ * calling thread writes, and slices too whenever the next layer isn't
+ * ready.  No new layer is started while the finished-but-unwritten layers
+ * hold memory_bound bytes or more, except the one the writer needs next,
+ * so the queue stays within the bound plus one layer per slicing thread.
+ *
+ * The progress callback runs on the calling thread after each written
+ * layer.  The first failing sink call or a cancel stops the slicing and
+ * its status is returned.
+ */
+stl_status stl_slice_to_sink(const stl_slicer &slicer,
+                             const stl_slice_params &params,
+                             stl_layer_sink &sink, size_t memory_bound,
+                             stl_progress_fn progress, void *user_data);
+
+#endif // LAYERWRITER_H
@@ -8,18 +8,60 @@ QT       += opengl svg
 
 QT       -= gui
 
+CONFIG   += c++11
+
 TARGET = libsliceomatic
 TEMPLATE = lib
 
 DEFINES += LIBSLICEOMATIC_LIBRARY
 
+# 64-bit file offsets on 32-bit platforms
+DEFINES += _FILE_OFFSET_BITS=64
+
 SOURCES += libsliceomatic.cpp \
-    stl.cpp
+    stl.cpp \
+    loader.cpp \
+    slice.cpp \
+    plate.cpp \
+    decimate.cpp \
+    bvh.cpp \
+    overhang.cpp \
+    layerwriter.cpp \
+    slicecache.cpp \
+    hash.cpp \
+    halfedge.cpp \
+    indexmesh.cpp \
+    meshio.cpp \
+    batch.cpp \
+    snapshot.cpp \
+    degenerate.cpp \
+    raster.cpp \
+    simplify.cpp \
+    reorder.cpp \
+    intersect.cpp \
+    renderbuf.cpp
 
 HEADERS += libsliceomatic.h\
         libsliceomatic_global.h \
     stl.h \
-    cgaldefs.h
+    cgaldefs.h \
+    loader.h \
+    parallel.h \
+    slice.h \
+    plate.h \
+    decimate.h \
+    bvh.h \
+    overhang.h \
+    layerwriter.h \
+    slicecache.h \
+    halfedge.h \
+    indexmesh.h \
+    batch.h \
+    snapshot.h \
+    raster.h \
+    simplify.h \
+    intersect.h \
+    renderbuf.h
 
 symbian {
     #Symbian specific definitions
@@ -0,0 +1,86 @@
+#include <QtCore/QRunnable>
+#include <QtCore/QThreadPool>
+#include "loader.h"
+
+class stl_loader::worker : public QRunnable
+{
+public:
+    worker(stl_loader *loader) : loader(loader) {}
+    void run() { loader->run(); }
+
+private:
+    stl_loader *loader;
+};
+
+stl_loader::stl_loader()
+    : mesh(NULL), progress(NULL), user_data(NULL), cancelled(0),
+      running(false), result(STL_OK)
+{
+}
+
+stl_loader::~stl_loader()
+{
+    cancel();
+    wait();
+}
+
+void stl_loader::start(stl *mesh, char *file, stl_progress_fn progress,
+                       void *user_data)
+{
+    wait();
+
+    this->mesh = mesh;
+    this->file = file;
+    this->progress = progress;
+    this->user_data = user_data;
+    cancelled.store(0);
+
+    mutex.lock();
+    running = true;
+    mutex.unlock();
+
+    QThreadPool::globalInstance()->start(new worker(this));
+}
+
+void stl_loader::cancel()
+{
+    cancelled.store(1);
+}
+
+bool stl_loader::is_finished()
+{
+    QMutexLocker locker(&mutex);
+    return !running;
+}
+
+stl_status stl_loader::wait()
+{
+    QMutexLocker locker(&mutex);
+    while(running)
+        done.wait(&mutex);
+    return result;
+}
+
+int stl_loader::forward_progress(float fraction, void *user_data)
+{
+    stl_loader *loader = (stl_loader *) user_data;
+
+    if(loader->cancelled.load())
+        return 0;
+    if(loader->progress != NULL)
+        return loader->progress(fraction, loader->user_data);
+    return 1;
+}
+
+void stl_loader::run()
+{
+    stl_status status;
+
+    status = mesh->load((char *) file.c_str(), forward_progress, this);
+
+    mutex.lock();
+    result = status;
+    running = false;
+    done.wakeAll();
+    mutex.unlock();
+}
@@ -0,0 +1,54 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <string>
+#include <QtCore/QAtomicInt>
+#include <QtCore/QMutex>
+#include <QtCore/QWaitCondition>
+#include "stl.h"
+
+/* Runs stl::load() on a QThreadPool worker so that a front end can keep
+ * its event loop running while a large file is parsed and its topology
+ * is built.
+ *
+ * The progress callback is invoked on the worker thread; a Qt front end
+ * should forward it to the GUI thread with a queued connection.  cancel()
+ * is cooperative: the load stops at the next progress point, the mesh is
+ * left empty and the result is STL_CANCELLED.  The mesh must not be
+ * touched by the caller until is_finished() is true or wait() returns.
+ */
+class stl_loader
+{
+public:
+    stl_loader();
+    ~stl_loader();
+
+    void start(stl *mesh, char *file, stl_progress_fn progress,
+               void *user_data);
+    void cancel();
+    bool is_finished();
+    stl_status wait();
+
+private:
+    class worker;
+    friend class worker;
+
+    static int forward_progress(float fraction, void *user_data);
+    void run();
+
+    stl             *mesh;
+    std::string      file;
+    stl_progress_fn  progress;
+    void            *user_data;
+
+    QAtomicInt       cancelled;
+    QMutex           mutex;
+    QWaitCondition   done;
+    bool             running;
+    stl_status       result;
+
+    stl_loader(const stl_loader &);
+    stl_loader &operator=(const stl_loader &);
+};
+
+#endif // LOADER_H
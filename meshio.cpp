@@ -0,0 +1,1206 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+#include <vector>
+#include "stl.h"
+
+using namespace std;
+
+/* Bytes parsed between progress reports. */
+#define MESHIO_PROGRESS_STRIDE (1 << 20)
+
+/* Size of the write buffer of the binary exports. */
+#define MESHIO_BUFFER_SIZE (1 << 16)
+
+/* Header of the compact format: magic, version, vertex and facet counts,
+   grid origin and spacing. */
+#define COMPACT_MAGIC       "SOMQ"
+#define COMPACT_VERSION     1
+#define COMPACT_HEADER_SIZE (4 + 1 + 4 + 4 + 12 + 12)
+
+typedef enum
+{
+  ply_char, ply_uchar, ply_short, ply_ushort, ply_int, ply_uint,
+  ply_float, ply_double, ply_invalid
+}stl_ply_type;
+
+typedef struct
+{
+  stl_ply_type type;
+  stl_ply_type count_type;  /* ply_invalid unless this is a list */
+  char         name[32];
+}stl_ply_property;
+
+typedef struct
+{
+  char                     name[32];
+  long                     count;
+  vector<stl_ply_property> properties;
+}stl_ply_element;
+
+typedef enum {ply_ascii, ply_little_endian, ply_big_endian} stl_ply_format;
+
+typedef struct
+{
+  FILE          *fp;
+  size_t         used;
+  unsigned char  data[MESHIO_BUFFER_SIZE];
+}stl_out_buffer;
+
+static stl_status stl_read_whole_file(char *file, char **data, size_t *size);
+static const char *stl_parse_float(const char *p, float *value);
+static const char *stl_parse_long(const char *p, long *value);
+static const char *stl_parse_integer(const char *p, long long *value);
+static const char *stl_skip_blanks(const char *p);
+static const char *stl_skip_space(const char *p);
+static const char *stl_next_line(const char *p, const char *end);
+static stl_status stl_indexed_finish(stl *stl, vector<stl_vertex> &vertices,
+                                     vector<v_indices_struct> &indices,
+                                     stl_type type);
+static int stl_add_polygon(vector<v_indices_struct> &indices,
+                           const vector<int> &polygon);
+static stl_ply_type stl_ply_type_from_name(const char *name);
+static int stl_ply_type_size(stl_ply_type type);
+static double stl_ply_get(const unsigned char *p, stl_ply_type type,
+                          int swap);
+static FILE *stl_open_for_writing(char *file, const char *function);
+static void stl_out_flush(stl_out_buffer *out);
+static void stl_out_bytes(stl_out_buffer *out, const void *bytes, size_t n);
+static void stl_out_uint32(stl_out_buffer *out, uint32_t value);
+static void stl_out_float(stl_out_buffer *out, float value);
+static void stl_out_varint(stl_out_buffer *out, uint64_t value);
+static uint64_t stl_zigzag(int64_t value);
+static int64_t stl_unzigzag(uint64_t value);
+static uint32_t stl_in_uint32(const unsigned char *p);
+static const unsigned char *stl_in_varint(const unsigned char *p,
+                                          const unsigned char *end,
+                                          uint64_t *value);
+
+/* Reads the whole file into one buffer with a terminating NUL, which the
+   text parsers rely on instead of checking the end at every character. */
+static stl_status stl_read_whole_file(char *file, char **data, size_t *size)
+{
+  FILE      *fp;
+  stl_off_t  length;
+
+  fp = fopen(file, "rb");
+  if(fp == NULL)
+    {
+      return STL_ERR_OPEN;
+    }
+  stl_fseek(fp, 0, SEEK_END);
+  length = stl_ftell(fp);
+  stl_fseek(fp, 0, SEEK_SET);
+  if(length < 0 || (unsigned long long) length >= (size_t) -1)
+    {
+      fclose(fp);
+      return STL_ERR_SIZE;
+    }
+  *size = (size_t) length;
+  *data = (char *) malloc(*size + 1);
+  if(*data == NULL)
+    {
+      fclose(fp);
+      return STL_ERR_MEMORY;
+    }
+  if(fread(*data, 1, *size, fp) != *size)
+    {
+      free(*data);
+      *data = NULL;
+      fclose(fp);
+      return STL_ERR_READ;
+    }
+  (*data)[*size] = '\0';
+  fclose(fp);
+  return STL_OK;
+}
+
+/* Decimal to float without strtod's locale handling.  Up to 19
+   significant digits are kept, which is far more than a float holds;
+   anything unusual (inf, nan, hex) is left to strtod. */
+static const char *stl_parse_float(const char *p, float *value)
+{
+  static const double powers[] =
+    {
+      1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+  const char         *start = p;
+  const char         *digits_start;
+  unsigned long long  mantissa = 0;
+  int                 digits = 0;
+  int                 exponent = 0;
+  int                 negative = 0;
+  double              result;
+
+  if(*p == '-' || *p == '+')
+    {
+      negative = *p == '-';
+      p++;
+    }
+  digits_start = p;
+  for(; *p >= '0' && *p <= '9'; p++)
+    {
+      if(digits < 19)
+        {
+          mantissa = mantissa * 10 + (*p - '0');
+          if(mantissa != 0) digits++;
+        }
+      else
+        {
+          exponent++;
+        }
+    }
+  if(*p == '.')
+    {
+      for(p++; *p >= '0' && *p <= '9'; p++)
+        {
+          if(digits < 19)
+            {
+              mantissa = mantissa * 10 + (*p - '0');
+              if(mantissa != 0) digits++;
+              exponent--;
+            }
+        }
+    }
+  if(p == digits_start || (p == digits_start + 1 && *digits_start == '.'))
+    {
+      char *stop;
+      result = strtod(start, &stop);
+      if(stop == start)
+        {
+          return NULL;
+        }
+      *value = result;
+      return stop;
+    }
+  if(*p == 'e' || *p == 'E')
+    {
+      long        power;
+      const char *after = stl_parse_long(p + 1, &power);
+      if(after != NULL)
+        {
+          exponent += (int) STL_MAX(-1000L, STL_MIN(1000L, power));
+          p = after;
+        }
+    }
+
+  result = (double) mantissa;
+  if(mantissa != 0)
+    {
+      for(; exponent > 22; exponent -= 22) result *= 1e22;
+      for(; exponent < -22; exponent += 22) result /= 1e22;
+      result = exponent < 0 ? result / powers[-exponent]
+                            : result * powers[exponent];
+    }
+  *value = negative ? -result : result;
+  return p;
+}
+
+static const char *stl_parse_long(const char *p, long *value)
+{
+  const char *start;
+  long        result = 0;
+  int         negative = 0;
+
+  if(*p == '-' || *p == '+')
+    {
+      negative = *p == '-';
+      p++;
+    }
+  start = p;
+  for(; *p >= '0' && *p <= '9'; p++)
+    {
+      if(result < LONG_MAX / 10)
+        {
+          result = result * 10 + (*p - '0');
+        }
+    }
+  if(p == start)
+    {
+      return NULL;
+    }
+  *value = negative ? -result : result;
+  return p;
+}
+
+/* A decimal integer; NULL if there is none or it doesn't fit. */
+static const char *stl_parse_integer(const char *p, long long *value)
+{
+  char *next;
+
+  errno = 0;
+  *value = strtoll(p, &next, 10);
+  if(next == p || errno == ERANGE)
+    {
+      return NULL;
+    }
+  return next;
+}
+
+static const char *stl_skip_blanks(const char *p)
+{
+  while(*p == ' ' || *p == '\t' || *p == '\r')
+    {
+      p++;
+    }
+  return p;
+}
+
+static const char *stl_skip_space(const char *p)
+{
+  while(*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+    {
+      p++;
+    }
+  return p;
+}
+
+static const char *stl_next_line(const char *p, const char *end)
+{
+  const char *newline = (const char *) memchr(p, '\n', end - p);
+  return newline != NULL ? newline + 1 : end;
+}
+
+/* Splits a polygon into a fan around its first corner.  Returns 0 if it
+   has fewer than three corners. */
+static int stl_add_polygon(vector<v_indices_struct> &indices,
+                           const vector<int> &polygon)
+{
+  size_t k;
+
+  if(polygon.size() < 3)
+    {
+      return 0;
+    }
+  for(k = 1; k + 1 < polygon.size(); k++)
+    {
+      v_indices_struct facet;
+      facet.vertex[0] = polygon[0];
+      facet.vertex[1] = polygon[k];
+      facet.vertex[2] = polygon[k + 1];
+      indices.push_back(facet);
+    }
+  return 1;
+}
+
+/* Moves the parsed arrays into v_shared/v_indices and fills in the
+   statistics open() would have. */
+static stl_status stl_indexed_finish(stl *stl, vector<stl_vertex> &vertices,
+                                     vector<v_indices_struct> &indices,
+                                     stl_type type)
+{
+  size_t i;
+  int    k;
+
+  if(indices.size() > (size_t) INT_MAX || vertices.size() > (size_t) INT_MAX)
+    {
+      return STL_ERR_SIZE;
+    }
+  for(i = 0; i < indices.size(); i++)
+    {
+      for(k = 0; k < 3; k++)
+        {
+          if(indices[i].vertex[k] < 0
+             || indices[i].vertex[k] >= (int) vertices.size())
+            {
+              return STL_ERR_READ;
+            }
+        }
+    }
+
+  stl->v_shared = (stl_vertex *) malloc(STL_MAX(vertices.size(), (size_t) 1)
+                                        * sizeof(stl_vertex));
+  stl->v_indices = (v_indices_struct *)
+    malloc(STL_MAX(indices.size(), (size_t) 1) * sizeof(v_indices_struct));
+  if(stl->v_shared == NULL || stl->v_indices == NULL)
+    {
+      return STL_ERR_MEMORY;
+    }
+  if(!vertices.empty())
+    {
+      memcpy(stl->v_shared, &vertices[0], vertices.size() * sizeof(stl_vertex));
+    }
+  if(!indices.empty())
+    {
+      memcpy(stl->v_indices, &indices[0],
+             indices.size() * sizeof(v_indices_struct));
+    }
+
+  stl->stats.type = type;
+  stl->stats.number_of_facets = (int) indices.size();
+  stl->stats.original_num_facets = stl->stats.number_of_facets;
+  stl->stats.shared_vertices = (int) vertices.size();
+  stl->stats.shared_malloced = stl->stats.shared_vertices;
+  if(!vertices.empty())
+    {
+      stl->stats.min = stl->stats.max = vertices[0];
+    }
+  for(i = 1; i < vertices.size(); i++)
+    {
+      stl->stats.max.x = STL_MAX(stl->stats.max.x, vertices[i].x);
+      stl->stats.min.x = STL_MIN(stl->stats.min.x, vertices[i].x);
+      stl->stats.max.y = STL_MAX(stl->stats.max.y, vertices[i].y);
+      stl->stats.min.y = STL_MIN(stl->stats.min.y, vertices[i].y);
+      stl->stats.max.z = STL_MAX(stl->stats.max.z, vertices[i].z);
+      stl->stats.min.z = STL_MIN(stl->stats.min.z, vertices[i].z);
+    }
+  stl->stats.size.x = stl->stats.max.x - stl->stats.min.x;
+  stl->stats.size.y = stl->stats.max.y - stl->stats.min.y;
+  stl->stats.size.z = stl->stats.max.z - stl->stats.min.z;
+  stl->stats.bounding_diameter =
+    sqrt(stl->stats.size.x * stl->stats.size.x +
+         stl->stats.size.y * stl->stats.size.y +
+         stl->stats.size.z * stl->stats.size.z);
+  return STL_OK;
+}
+
+static void stl_indexed_reset(stl *stl)
+{
+  stl->close();
+  memset(&stl->stats, 0, sizeof(stl->stats));
+  stl->stats.volume = -1.0;
+}
+
+stl_status stl::open_obj(char *file, stl_progress_fn progress, void *user_data)
+{
+  char                     *data;
+  size_t                    size;
+  const char               *p;
+  const char               *end;
+  const char               *reported;
+  vector<stl_vertex>        vertices;
+  vector<v_indices_struct>  indices;
+  vector<int>               polygon;
+  stl_status                status;
+
+  stl_indexed_reset(this);
+  status = stl_read_whole_file(file, &data, &size);
+  if(status != STL_OK)
+    {
+      return status;
+    }
+
+  end = data + size;
+  reported = data;
+  for(p = data; p < end && status == STL_OK; p = stl_next_line(p, end))
+    {
+      if(p - reported >= MESHIO_PROGRESS_STRIDE)
+        {
+          reported = p;
+          if(progress != NULL && !progress((float) (p - data) / size, user_data))
+            {
+              status = STL_CANCELLED;
+              break;
+            }
+        }
+
+      p = stl_skip_blanks(p);
+      if(p[0] == 'v' && (p[1] == ' ' || p[1] == '\t'))
+        {
+          stl_vertex vertex;
+          p = stl_parse_float(stl_skip_blanks(p + 1), &vertex.x);
+          if(p != NULL) p = stl_parse_float(stl_skip_blanks(p), &vertex.y);
+          if(p != NULL) p = stl_parse_float(stl_skip_blanks(p), &vertex.z);
+          if(p == NULL)
+            {
+              status = STL_ERR_READ;
+              break;
+            }
+          vertices.push_back(vertex);
+        }
+      else if(p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+        {
+          /* Corners are v, v/vt, v//vn or v/vt/vn; negative indices
+             count back from the last vertex read. */
+          polygon.clear();
+          for(p = stl_skip_blanks(p + 1); *p != '\n' && *p != '\0';
+              p = stl_skip_blanks(p))
+            {
+              long long index;
+              p = stl_parse_integer(p, &index);
+              /* 1 is the first vertex and -1 the last read; anything
+                 past INT_MAX either way can't be a vertex of ours. */
+              if(p == NULL || index == 0 || index > INT_MAX
+                 || index < -(long long) vertices.size())
+                {
+                  status = STL_ERR_READ;
+                  break;
+                }
+              polygon.push_back(index < 0 ? (int) (vertices.size() + index)
+                                          : (int) (index - 1));
+              while(*p != ' ' && *p != '\t' && *p != '\r' && *p != '\n'
+                    && *p != '\0')
+                {
+                  p++;
+                }
+            }
+          if(status == STL_OK && !stl_add_polygon(indices, polygon))
+            {
+              status = STL_ERR_READ;
+            }
+        }
+      if(p == NULL)
+        {
+          break;
+        }
+    }
+  free(data);
+
+  if(status == STL_OK)
+    {
+      status = stl_indexed_finish(this, vertices, indices, ascii);
+    }
+  if(status != STL_OK)
+    {
+      close();
+      return status;
+    }
+  if(progress != NULL)
+    {
+      progress(1.0, user_data);
+    }
+  return STL_OK;
+}
+
+static stl_ply_type stl_ply_type_from_name(const char *name)
+{
+  static const char *names[][2] =
+    {
+      {"char", "int8"}, {"uchar", "uint8"}, {"short", "int16"},
+      {"ushort", "uint16"}, {"int", "int32"}, {"uint", "uint32"},
+      {"float", "float32"}, {"double", "float64"}
+    };
+  int i;
+
+  for(i = 0; i < ply_invalid; i++)
+    {
+      if(strcmp(name, names[i][0]) == 0 || strcmp(name, names[i][1]) == 0)
+        {
+          return (stl_ply_type) i;
+        }
+    }
+  return ply_invalid;
+}
+
+static int stl_ply_type_size(stl_ply_type type)
+{
+  static const int sizes[] = {1, 1, 2, 2, 4, 4, 4, 8};
+  return sizes[type];
+}
+
+static double stl_ply_get(const unsigned char *p, stl_ply_type type, int swap)
+{
+  unsigned char bytes[8];
+  int           size = stl_ply_type_size(type);
+  int           i;
+
+  for(i = 0; i < size; i++)
+    {
+      bytes[i] = swap ? p[size - 1 - i] : p[i];
+    }
+  switch(type)
+    {
+    case ply_char:   return (signed char) bytes[0];
+    case ply_uchar:  return bytes[0];
+    case ply_short:  { short v; memcpy(&v, bytes, 2); return v; }
+    case ply_ushort: { unsigned short v; memcpy(&v, bytes, 2); return v; }
+    case ply_int:    { int32_t v; memcpy(&v, bytes, 4); return v; }
+    case ply_uint:   { uint32_t v; memcpy(&v, bytes, 4); return v; }
+    case ply_float:  { float v; memcpy(&v, bytes, 4); return v; }
+    case ply_double: { double v; memcpy(&v, bytes, 8); return v; }
+    default:         return 0.0;
+    }
+}
+
+stl_status stl::open_ply(char *file, stl_progress_fn progress, void *user_data)
+{
+  char                     *data;
+  size_t                    size;
+  const char               *p;
+  const char               *end;
+  const char               *body;
+  vector<stl_ply_element>   elements;
+  vector<stl_vertex>        vertices;
+  vector<v_indices_struct>  indices;
+  vector<int>               polygon;
+  stl_ply_format            format = ply_ascii;
+  stl_status                status = STL_OK;
+  const int                 one = 1;
+  int                       swap;
+  size_t                    e;
+
+  stl_indexed_reset(this);
+  status = stl_read_whole_file(file, &data, &size);
+  if(status != STL_OK)
+    {
+      return status;
+    }
+  end = data + size;
+
+  /* The header is plain text up to "end_header". */
+  if(strncmp(data, "ply", 3) != 0)
+    {
+      free(data);
+      close();
+      return STL_ERR_READ;
+    }
+  body = NULL;
+  for(p = stl_next_line(data, end); p < end; p = stl_next_line(p, end))
+    {
+      char word[32];
+      char type[32];
+      char second[32];
+      char name[32];
+
+      if(sscanf(p, "%31s", word) != 1)
+        {
+          continue;
+        }
+      if(strcmp(word, "end_header") == 0)
+        {
+          body = stl_next_line(p, end);
+          break;
+        }
+      if(strcmp(word, "format") == 0 && sscanf(p, "%*s %31s", type) == 1)
+        {
+          if(strcmp(type, "binary_little_endian") == 0)
+            format = ply_little_endian;
+          else if(strcmp(type, "binary_big_endian") == 0)
+            format = ply_big_endian;
+        }
+      else if(strcmp(word, "element") == 0)
+        {
+          stl_ply_element element;
+          if(sscanf(p, "%*s %31s %ld", element.name, &element.count) != 2
+             || element.count < 0)
+            {
+              status = STL_ERR_READ;
+              break;
+            }
+          elements.push_back(element);
+        }
+      else if(strcmp(word, "property") == 0 && !elements.empty())
+        {
+          stl_ply_property property;
+          if(sscanf(p, "%*s %31s", type) != 1)
+            {
+              status = STL_ERR_READ;
+              break;
+            }
+          if(strcmp(type, "list") == 0)
+            {
+              if(sscanf(p, "%*s %*s %31s %31s %31s", second, type, name) != 3)
+                {
+                  status = STL_ERR_READ;
+                  break;
+                }
+              property.count_type = stl_ply_type_from_name(second);
+              if(property.count_type == ply_invalid)
+                {
+                  status = STL_ERR_READ;
+                  break;
+                }
+            }
+          else
+            {
+              if(sscanf(p, "%*s %*s %31s", name) != 1)
+                {
+                  status = STL_ERR_READ;
+                  break;
+                }
+              property.count_type = ply_invalid;
+            }
+          property.type = stl_ply_type_from_name(type);
+          if(property.type == ply_invalid)
+            {
+              status = STL_ERR_READ;
+              break;
+            }
+          strcpy(property.name, name);
+          elements.back().properties.push_back(property);
+        }
+    }
+  if(status == STL_OK && body == NULL)
+    {
+      status = STL_ERR_READ;
+    }
+
+  swap = format != ply_ascii
+         && (format == ply_little_endian) != (*(const char *) &one == 1);
+  p = body;
+  for(e = 0; e < elements.size() && status == STL_OK; e++)
+    {
+      const stl_ply_element &element = elements[e];
+      int  is_vertex = strcmp(element.name, "vertex") == 0;
+      int  is_face = strcmp(element.name, "face") == 0;
+      long item;
+
+      if(is_vertex)
+        {
+          vertices.reserve(element.count);
+        }
+      else if(is_face)
+        {
+          indices.reserve(element.count);
+        }
+      for(item = 0; item < element.count && status == STL_OK; item++)
+        {
+          stl_vertex vertex = {0.0, 0.0, 0.0};
+          size_t     k;
+
+          if(item % 65536 == 0 && progress != NULL
+             && !progress((float) (p - data) / size, user_data))
+            {
+              status = STL_CANCELLED;
+              break;
+            }
+          for(k = 0; k < element.properties.size(); k++)
+            {
+              const stl_ply_property &property = element.properties[k];
+              long count = 1;
+              long c;
+              int  face_list = is_face
+                               && property.count_type != ply_invalid
+                               && (strcmp(property.name, "vertex_indices") == 0
+                                   || strcmp(property.name, "vertex_index") == 0);
+
+              if(property.count_type != ply_invalid)
+                {
+                  if(format == ply_ascii)
+                    {
+                      p = stl_parse_long(stl_skip_space(p), &count);
+                    }
+                  else if(p + stl_ply_type_size(property.count_type) <= end)
+                    {
+                      count = (long) stl_ply_get((const unsigned char *) p,
+                                                 property.count_type, swap);
+                      p += stl_ply_type_size(property.count_type);
+                    }
+                  else
+                    {
+                      p = NULL;
+                    }
+                  if(p == NULL || count < 0)
+                    {
+                      status = STL_ERR_READ;
+                      break;
+                    }
+                }
+              if(face_list)
+                {
+                  polygon.clear();
+                }
+              for(c = 0; c < count; c++)
+                {
+                  double    value;
+                  long long integer = -1;
+
+                  if(format == ply_ascii && property.type < ply_float)
+                    {
+                      /* Integers are read as such; through a float
+                         indices past 2^24 would round to another vertex. */
+                      p = stl_parse_integer(stl_skip_space(p), &integer);
+                      if(p == NULL)
+                        {
+                          status = STL_ERR_READ;
+                          break;
+                        }
+                      value = (double) integer;
+                    }
+                  else if(format == ply_ascii)
+                    {
+                      float parsed;
+                      p = stl_parse_float(stl_skip_space(p), &parsed);
+                      if(p == NULL)
+                        {
+                          status = STL_ERR_READ;
+                          break;
+                        }
+                      value = parsed;
+                    }
+                  else
+                    {
+                      if(p + stl_ply_type_size(property.type) > end)
+                        {
+                          status = STL_ERR_READ;
+                          break;
+                        }
+                      value = stl_ply_get((const unsigned char *) p,
+                                          property.type, swap);
+                      p += stl_ply_type_size(property.type);
+                      if(property.type < ply_float)
+                        {
+                          integer = (long long) value;
+                        }
+                    }
+                  if(face_list)
+                    {
+                      if(property.type >= ply_float && value >= 0.0
+                         && value <= INT_MAX && value == floor(value))
+                        {
+                          integer = (long long) value;
+                        }
+                      if(integer < 0 || integer > INT_MAX)
+                        {
+                          status = STL_ERR_READ;
+                          break;
+                        }
+                      polygon.push_back((int) integer);
+                    }
+                  else if(is_vertex && property.name[1] == '\0')
+                    {
+                      if(property.name[0] == 'x') vertex.x = value;
+                      else if(property.name[0] == 'y') vertex.y = value;
+                      else if(property.name[0] == 'z') vertex.z = value;
+                    }
+                }
+              if(status != STL_OK)
+                {
+                  break;
+                }
+              if(face_list && !stl_add_polygon(indices, polygon))
+                {
+                  status = STL_ERR_READ;
+                  break;
+                }
+            }
+          if(is_vertex)
+            {
+              vertices.push_back(vertex);
+            }
+        }
+    }
+  free(data);
+
+  if(status == STL_OK)
+    {
+      status = stl_indexed_finish(this, vertices, indices,
+                                  format == ply_ascii ? ascii : binary);
+    }
+  if(status != STL_OK)
+    {
+      close();
+      return status;
+    }
+  if(progress != NULL)
+    {
+      progress(1.0, user_data);
+    }
+  return STL_OK;
+}
+
+/* Facet i as facet_start holds it, or as expand_facets() would build
+   it when only the indexed form is there. */
+stl_facet stl::get_facet(int i) const
+{
+  stl_facet facet;
+  float     normal[3];
+  int       k;
+
+  if(facet_start != NULL)
+    {
+      return facet_start[i];
+    }
+  memset(&facet, 0, sizeof(stl_facet));
+  for(k = 0; k < 3; k++)
+    {
+      facet.vertex[k] = v_shared[v_indices[i].vertex[k]];
+    }
+  calculate_normal(normal, &facet);
+  normalize_vector(normal);
+  facet.normal.x = normal[0];
+  facet.normal.y = normal[1];
+  facet.normal.z = normal[2];
+  return facet;
+}
+
+/* Builds facet_start from the indexed form, with normals from the
+   winding, for the passes that rewrite facets in place. */
+stl_status stl::expand_facets()
+{
+  stl_facet     *facets;
+  stl_neighbors *neighbors;
+  int            i;
+
+  if(facet_start != NULL)
+    {
+      return STL_OK;
+    }
+  facets = (stl_facet *) calloc(STL_MAX(stats.number_of_facets, 1),
+                                sizeof(stl_facet));
+  neighbors = neighbors_start;
+  if(neighbors == NULL)
+    {
+      neighbors = (stl_neighbors *)
+        calloc(STL_MAX(stats.number_of_facets, 1), sizeof(stl_neighbors));
+    }
+  if(facets == NULL || neighbors == NULL)
+    {
+      free(facets);
+      if(neighbors != neighbors_start) free(neighbors);
+      return STL_ERR_MEMORY;
+    }
+
+  for(i = 0; i < stats.number_of_facets; i++)
+    {
+      facets[i] = get_facet(i);
+      if(neighbors != neighbors_start)
+        {
+          /* Every edge is open until check_facets_exact() matches it. */
+          neighbors[i].neighbor[0] = -1;
+          neighbors[i].neighbor[1] = -1;
+          neighbors[i].neighbor[2] = -1;
+        }
+    }
+  facet_start = facets;
+  neighbors_start = neighbors;
+  stats.facets_malloced = stats.number_of_facets;
+  return STL_OK;
+}
+
+static FILE *stl_open_for_writing(char *file, const char *function)
+{
+  FILE *fp;
+  char *error_msg;
+
+  fp = fopen(file, "wb");
+  if(fp == NULL)
+    {
+      error_msg =
+        (char *) malloc(81 + strlen(file)); /* Allow 80 chars+file size for message */
+      sprintf(error_msg, "%s: Couldn't open %s for writing", function, file);
+      perror(error_msg);
+      free(error_msg);
+      exit(1);
+    }
+  return fp;
+}
+
+static void stl_out_flush(stl_out_buffer *out)
+{
+  fwrite(out->data, 1, out->used, out->fp);
+  out->used = 0;
+}
+
+static void stl_out_bytes(stl_out_buffer *out, const void *bytes, size_t n)
+{
+  if(out->used + n > MESHIO_BUFFER_SIZE)
+    {
+      stl_out_flush(out);
+    }
+  memcpy(out->data + out->used, bytes, n);
+  out->used += n;
+}
+
+static void stl_out_uint32(stl_out_buffer *out, uint32_t value)
+{
+  unsigned char bytes[4];
+
+  bytes[0] = value & 0xFF;
+  bytes[1] = (value >> 0x08) & 0xFF;
+  bytes[2] = (value >> 0x10) & 0xFF;
+  bytes[3] = (value >> 0x18) & 0xFF;
+  stl_out_bytes(out, bytes, 4);
+}
+
+static void stl_out_float(stl_out_buffer *out, float value)
+{
+  uint32_t bits;
+
+  memcpy(&bits, &value, 4);
+  stl_out_uint32(out, bits);
+}
+
+static void stl_out_varint(stl_out_buffer *out, uint64_t value)
+{
+  unsigned char bytes[10];
+  int           n = 0;
+
+  while(value >= 0x80)
+    {
+      bytes[n++] = (value & 0x7F) | 0x80;
+      value >>= 7;
+    }
+  bytes[n++] = value;
+  stl_out_bytes(out, bytes, n);
+}
+
+static uint64_t stl_zigzag(int64_t value)
+{
+  return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
+
+static int64_t stl_unzigzag(uint64_t value)
+{
+  return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+static uint32_t stl_in_uint32(const unsigned char *p)
+{
+  return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+static const unsigned char *stl_in_varint(const unsigned char *p,
+                                          const unsigned char *end,
+                                          uint64_t *value)
+{
+  int shift;
+
+  *value = 0;
+  for(shift = 0; p < end && shift < 64; shift += 7)
+    {
+      *value |= (uint64_t) (*p & 0x7F) << shift;
+      if((*p++ & 0x80) == 0)
+        {
+          return p;
+        }
+    }
+  return NULL;
+}
+
+void stl::write_ply(char *file, char *label) const
+{
+  stl_out_buffer *out;
+  char            header[512];
+  int             i;
+  int             k;
+
+  out = (stl_out_buffer *) malloc(sizeof(stl_out_buffer));
+  if(out == NULL)
+    {
+      perror("write_ply");
+      exit(1);
+    }
+  out->fp = stl_open_for_writing(file, "write_ply");
+  out->used = 0;
+
+  sprintf(header, "ply\nformat binary_little_endian 1.0\ncomment %.80s\n"
+          "element vertex %d\nproperty float x\nproperty float y\n"
+          "property float z\nelement face %d\n"
+          "property list uchar int vertex_indices\nend_header\n",
+          label, stats.shared_vertices, stats.number_of_facets);
+  stl_out_bytes(out, header, strlen(header));
+  for(i = 0; i < stats.shared_vertices; i++)
+    {
+      stl_out_float(out, v_shared[i].x);
+      stl_out_float(out, v_shared[i].y);
+      stl_out_float(out, v_shared[i].z);
+    }
+  for(i = 0; i < stats.number_of_facets; i++)
+    {
+      unsigned char corners = 3;
+      stl_out_bytes(out, &corners, 1);
+      for(k = 0; k < 3; k++)
+        {
+          stl_out_uint32(out, v_indices[i].vertex[k]);
+        }
+    }
+  stl_out_flush(out);
+  fclose(out->fp);
+  free(out);
+}
+
+void stl::write_compact(char *file, float precision) const
+{
+  stl_out_buffer *out;
+  float           origin[3] = {0.0, 0.0, 0.0};
+  float           top[3] = {0.0, 0.0, 0.0};
+  float           step[3];
+  int64_t         previous[3] = {0, 0, 0};
+  int             previous_first = 0;
+  unsigned char   version = COMPACT_VERSION;
+  int             i;
+  int             k;
+
+  out = (stl_out_buffer *) malloc(sizeof(stl_out_buffer));
+  if(out == NULL)
+    {
+      perror("write_compact");
+      exit(1);
+    }
+  out->fp = stl_open_for_writing(file, "write_compact");
+  out->used = 0;
+
+  /* The grid starts at the low corner of the vertices themselves, which
+     is exact even if stats.min is stale. */
+  if(stats.shared_vertices > 0)
+    {
+      origin[0] = top[0] = v_shared[0].x;
+      origin[1] = top[1] = v_shared[0].y;
+      origin[2] = top[2] = v_shared[0].z;
+    }
+  for(i = 1; i < stats.shared_vertices; i++)
+    {
+      origin[0] = STL_MIN(origin[0], v_shared[i].x);
+      origin[1] = STL_MIN(origin[1], v_shared[i].y);
+      origin[2] = STL_MIN(origin[2], v_shared[i].z);
+      top[0] = STL_MAX(top[0], v_shared[i].x);
+      top[1] = STL_MAX(top[1], v_shared[i].y);
+      top[2] = STL_MAX(top[2], v_shared[i].z);
+    }
+  for(k = 0; k < 3; k++)
+    {
+      step[k] = precision > 0.0 ? precision : (top[k] - origin[k]) / 1048576.0;
+      if(step[k] <= 0.0)
+        {
+          step[k] = 1.0;
+        }
+    }
+
+  stl_out_bytes(out, COMPACT_MAGIC, 4);
+  stl_out_bytes(out, &version, 1);
+  stl_out_uint32(out, stats.shared_vertices);
+  stl_out_uint32(out, stats.number_of_facets);
+  for(k = 0; k < 3; k++)
+    {
+      stl_out_float(out, origin[k]);
+    }
+  for(k = 0; k < 3; k++)
+    {
+      stl_out_float(out, step[k]);
+    }
+
+  /* Vertices are numbered in order of first use, so neighbours in the
+     array are mostly neighbours in space and their deltas stay small. */
+  for(i = 0; i < stats.shared_vertices; i++)
+    {
+      const float *v = &v_shared[i].x;
+      for(k = 0; k < 3; k++)
+        {
+          int64_t q = (int64_t) floor((v[k] - origin[k]) / step[k] + 0.5);
+          stl_out_varint(out, stl_zigzag(q - previous[k]));
+          previous[k] = q;
+        }
+    }
+  for(i = 0; i < stats.number_of_facets; i++)
+    {
+      int first = v_indices[i].vertex[0];
+      stl_out_varint(out, stl_zigzag((int64_t) first - previous_first));
+      stl_out_varint(out, stl_zigzag((int64_t) v_indices[i].vertex[1] - first));
+      stl_out_varint(out, stl_zigzag((int64_t) v_indices[i].vertex[2] - first));
+      previous_first = first;
+    }
+  stl_out_flush(out);
+  fclose(out->fp);
+  free(out);
+}
+
+stl_status stl::open_compact(char *file, stl_progress_fn progress,
+                             void *user_data)
+{
+  char                     *data;
+  size_t                    size;
+  const unsigned char      *p;
+  const unsigned char      *end;
+  vector<stl_vertex>        vertices;
+  vector<v_indices_struct>  indices;
+  float                     origin[3];
+  float                     step[3];
+  int64_t                   previous[3] = {0, 0, 0};
+  int64_t                   previous_first = 0;
+  uint32_t                  num_vertices;
+  uint32_t                  num_facets;
+  stl_status                status = STL_OK;
+  uint32_t                  i;
+  int                       k;
+
+  stl_indexed_reset(this);
+  status = stl_read_whole_file(file, &data, &size);
+  if(status != STL_OK)
+    {
+      return status;
+    }
+  p = (const unsigned char *) data;
+  end = p + size;
+  if(size < COMPACT_HEADER_SIZE || memcmp(p, COMPACT_MAGIC, 4) != 0
+     || p[4] != COMPACT_VERSION)
+    {
+      free(data);
+      close();
+      return STL_ERR_READ;
+    }
+  num_vertices = stl_in_uint32(p + 5);
+  num_facets = stl_in_uint32(p + 9);
+  for(k = 0; k < 3; k++)
+    {
+      uint32_t bits = stl_in_uint32(p + 13 + 4 * k);
+      memcpy(&origin[k], &bits, 4);
+      bits = stl_in_uint32(p + 25 + 4 * k);
+      memcpy(&step[k], &bits, 4);
+    }
+  p += COMPACT_HEADER_SIZE;
+
+  /* Every vertex takes at least three bytes and every facet three, so
+     counts the file can't hold are rejected before allocating. */
+  if(num_vertices > (size_t) (end - p) / 3
+     || num_facets > (size_t) (end - p) / 3)
+    {
+      free(data);
+      close();
+      return STL_ERR_SIZE;
+    }
+  vertices.resize(num_vertices);
+  indices.resize(num_facets);
+
+  for(i = 0; i < num_vertices && p != NULL; i++)
+    {
+      float *v = &vertices[i].x;
+      for(k = 0; k < 3 && p != NULL; k++)
+        {
+          uint64_t delta;
+          p = stl_in_varint(p, end, &delta);
+          previous[k] += stl_unzigzag(delta);
+          v[k] = origin[k] + (double) previous[k] * step[k];
+        }
+      if(i % 65536 == 0 && progress != NULL
+         && !progress(0.5 * i / num_vertices, user_data))
+        {
+          status = STL_CANCELLED;
+          break;
+        }
+    }
+  for(i = 0; i < num_facets && p != NULL && status == STL_OK; i++)
+    {
+      uint64_t delta[3];
+      for(k = 0; k < 3 && p != NULL; k++)
+        {
+          p = stl_in_varint(p, end, &delta[k]);
+        }
+      if(p == NULL)
+        {
+          break;
+        }
+      previous_first += stl_unzigzag(delta[0]);
+      indices[i].vertex[0] = (int) previous_first;
+      indices[i].vertex[1] = (int) (previous_first + stl_unzigzag(delta[1]));
+      indices[i].vertex[2] = (int) (previous_first + stl_unzigzag(delta[2]));
+      if(i % 65536 == 0 && progress != NULL
+         && !progress(0.5 + 0.5 * i / num_facets, user_data))
+        {
+          status = STL_CANCELLED;
+        }
+    }
+  if(p == NULL && status == STL_OK)
+    {
+      status = STL_ERR_READ;
+    }
+  free(data);
+
+  if(status == STL_OK)
+    {
+      status = stl_indexed_finish(this, vertices, indices, binary);
+    }
+  if(status != STL_OK)
+    {
+      close();
+      return status;
+    }
+  if(progress != NULL)
+    {
+      progress(1.0, user_data);
+    }
+  return STL_OK;
+}
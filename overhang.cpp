@@ -0,0 +1,308 @@
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include "overhang.h"
+#include "parallel.h"
+
+using namespace std;
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/* A stored normal this close to unit length is taken as valid. */
+#define OVERHANG_NORMAL_SLACK 0.001
+
+static int stl_union_find(vector<int> &parent, int i);
+static float stl_facet_area(const stl_facet *facet);
+static int stl_clip_to_slab(const stl_facet *facet, float lo, float hi,
+                            float polygon[][3]);
+static void stl_region_measure(const stl &mesh,
+                               const stl_overhang_params &params,
+                               stl_overhang_region &region);
+
+static int stl_union_find(vector<int> &parent, int i)
+{
+  while(parent[i] != i)
+    {
+      parent[i] = parent[parent[i]];
+      i = parent[i];
+    }
+  return i;
+}
+
+static float stl_facet_area(const stl_facet *facet)
+{
+  const stl_vertex *v = facet->vertex;
+  float a[3] = {v[1].x - v[0].x, v[1].y - v[0].y, v[1].z - v[0].z};
+  float b[3] = {v[2].x - v[0].x, v[2].y - v[0].y, v[2].z - v[0].z};
+  float n[3] = {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2],
+                a[0] * b[1] - a[1] * b[0]};
+
+  return 0.5 * sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+}
+
+/* Clips a facet to lo <= z <= hi.  Returns the vertex count of the
+ * resulting polygon, at most 5.
+ */
+static int stl_clip_to_slab(const stl_facet *facet, float lo, float hi,
+                            float polygon[][3])
+{
+  float in[5][3];
+  int   n = 3;
+  int   pass;
+  int   i;
+
+  for(i = 0; i < 3; i++)
+    {
+      polygon[i][0] = facet->vertex[i].x;
+      polygon[i][1] = facet->vertex[i].y;
+      polygon[i][2] = facet->vertex[i].z;
+    }
+  for(pass = 0; pass < 2; pass++)
+    {
+      int m = 0;
+      memcpy(in, polygon, n * sizeof(in[0]));
+      for(i = 0; i < n; i++)
+        {
+          float *a = in[i];
+          float *b = in[(i + 1) % n];
+          float  da = pass == 0 ? a[2] - lo : hi - a[2];
+          float  db = pass == 0 ? b[2] - lo : hi - b[2];
+
+          if(da >= 0.0)
+            {
+              memcpy(polygon[m++], a, sizeof(in[0]));
+            }
+          if((da >= 0.0) != (db >= 0.0))
+            {
+              float t = da / (da - db);
+              polygon[m][0] = a[0] + t * (b[0] - a[0]);
+              polygon[m][1] = a[1] + t * (b[1] - a[1]);
+              polygon[m][2] = a[2] + t * (b[2] - a[2]);
+              m++;
+            }
+        }
+      n = m;
+      if(n == 0)
+        {
+          break;
+        }
+    }
+  return n;
+}
+
+static void stl_region_measure(const stl &mesh,
+                               const stl_overhang_params &params,
+                               stl_overhang_region &region)
+{
+  float  h = params.layers.layer_height;
+  float  highest;
+  size_t i;
+  int    k;
+
+  region.area = 0.0;
+  region.projected_area = 0.0;
+  region.lowest = mesh.get_facet(region.facets[0]).vertex[0];
+  region.footprints.clear();
+  highest = region.lowest.z;
+
+  for(i = 0; i < region.facets.size(); i++)
+    {
+      stl_facet         copy = mesh.get_facet(region.facets[i]);
+      const stl_facet  *facet = &copy;
+      const stl_vertex *v = facet->vertex;
+
+      region.area += stl_facet_area(facet);
+      region.projected_area += 0.5 * fabs((v[1].x - v[0].x) * (v[2].y - v[0].y)
+                                          - (v[2].x - v[0].x) * (v[1].y - v[0].y));
+      for(k = 0; k < 3; k++)
+        {
+          if(v[k].z < region.lowest.z)
+            {
+              region.lowest = v[k];
+            }
+          highest = STL_MAX(highest, v[k].z);
+        }
+    }
+
+  if(h <= 0.0)
+    {
+      return;
+    }
+
+  /* Footprints are accumulated per layer over the facets of the region,
+     in slots for just the layers the region spans; a facet only visits
+     the layers its own z range covers. */
+  int layer_count = stl_slice_layer_count(&params.layers);
+  int first_layer = STL_MAX(0, (int) floor((region.lowest.z
+                                            - params.layers.z_min) / h));
+  int last_layer = STL_MIN(layer_count - 1,
+                           (int) floor((highest - params.layers.z_min) / h));
+
+  if(first_layer > last_layer)
+    {
+      return;
+    }
+  vector<stl_overhang_footprint> by_layer(last_layer - first_layer + 1);
+  for(k = first_layer; k <= last_layer; k++)
+    {
+      stl_overhang_footprint &f = by_layer[k - first_layer];
+      f.layer = k;
+      f.area = 0.0;
+      f.min_x = f.min_y = 1e30;
+      f.max_x = f.max_y = -1e30;
+    }
+
+  for(i = 0; i < region.facets.size(); i++)
+    {
+      stl_facet        copy = mesh.get_facet(region.facets[i]);
+      const stl_facet *facet = &copy;
+      float lo = STL_MIN(facet->vertex[0].z,
+                         STL_MIN(facet->vertex[1].z, facet->vertex[2].z));
+      float hi = STL_MAX(facet->vertex[0].z,
+                         STL_MAX(facet->vertex[1].z, facet->vertex[2].z));
+      int   l0 = STL_MAX(first_layer,
+                         (int) floor((lo - params.layers.z_min) / h));
+      int   l1 = STL_MIN(last_layer,
+                         (int) floor((hi - params.layers.z_min) / h));
+      int   l;
+
+      for(l = l0; l <= l1; l++)
+        {
+          float polygon[5][3];
+          float area = 0.0;
+          int   n = stl_clip_to_slab(facet, params.layers.z_min + l * h,
+                                     params.layers.z_min + (l + 1) * h,
+                                     polygon);
+          int   p;
+
+          if(n < 3)
+            {
+              continue;
+            }
+          stl_overhang_footprint &f = by_layer[l - first_layer];
+          for(p = 0; p < n; p++)
+            {
+              float *a = polygon[p];
+              float *b = polygon[(p + 1) % n];
+              area += a[0] * b[1] - b[0] * a[1];
+              f.min_x = STL_MIN(f.min_x, a[0]);
+              f.min_y = STL_MIN(f.min_y, a[1]);
+              f.max_x = STL_MAX(f.max_x, a[0]);
+              f.max_y = STL_MAX(f.max_y, a[1]);
+            }
+          f.area += 0.5 * fabs(area);
+        }
+    }
+  for(k = 0; k <= last_layer - first_layer; k++)
+    {
+      if(by_layer[k].area > 0.0)
+        {
+          region.footprints.push_back(by_layer[k]);
+        }
+    }
+}
+
+static bool stl_region_larger(const stl_overhang_region &a,
+                              const stl_overhang_region &b)
+{
+  return a.area > b.area;
+}
+
+void stl_detect_overhangs(const stl &mesh, const stl_overhang_params &params,
+                          vector<stl_overhang_region> &regions)
+{
+  int          n = mesh.stats.number_of_facets;
+  float        limit = sin(params.critical_angle * M_PI / 180.0);
+  float        bed = mesh.stats.min.z + params.bed_tolerance;
+  vector<char> flagged(n);
+  vector<int>  parent;
+  vector<int>  region_of;
+  int          i;
+  int          j;
+
+  regions.clear();
+  if(n == 0)
+    {
+      return;
+    }
+
+  /* A facet overhangs when its normal points down by more than the
+     critical angle measured from the horizontal; 90 degrees is a flat
+     ceiling. */
+  stl_parallel_for(n, 8192, [&](int begin, int end)
+    {
+      for(int f = begin; f < end; f++)
+        {
+          stl_facet         copy = mesh.get_facet(f);
+          const stl_facet  *facet = &copy;
+          const stl_vertex *v = facet->vertex;
+          float normal[3] = {facet->normal.x, facet->normal.y,
+                             facet->normal.z};
+          float length = normal[0] * normal[0] + normal[1] * normal[1]
+                       + normal[2] * normal[2];
+
+          if(fabs(length - 1.0) > OVERHANG_NORMAL_SLACK)
+            {
+              float a[3] = {v[1].x - v[0].x, v[1].y - v[0].y, v[1].z - v[0].z};
+              float b[3] = {v[2].x - v[0].x, v[2].y - v[0].y, v[2].z - v[0].z};
+
+              normal[0] = a[1] * b[2] - a[2] * b[1];
+              normal[1] = a[2] * b[0] - a[0] * b[2];
+              normal[2] = a[0] * b[1] - a[1] * b[0];
+              length = sqrt(normal[0] * normal[0] + normal[1] * normal[1]
+                            + normal[2] * normal[2]);
+              normal[2] = length > 0.0 ? normal[2] / length : 0.0;
+            }
+          flagged[f] = -normal[2] > limit
+                       && STL_MAX(v[0].z, STL_MAX(v[1].z, v[2].z)) > bed;
+        }
+    });
+
+  parent.resize(n);
+  for(i = 0; i < n; i++)
+    {
+      parent[i] = i;
+    }
+  if(mesh.neighbors_start != NULL)
+    {
+      for(i = 0; i < n; i++)
+        {
+          if(!flagged[i]) continue;
+          for(j = 0; j < 3; j++)
+            {
+              int other = mesh.neighbors_start[i].neighbor[j];
+              if(other > i && flagged[other])
+                {
+                  int a = stl_union_find(parent, i);
+                  int b = stl_union_find(parent, other);
+                  if(a != b) parent[STL_MAX(a, b)] = STL_MIN(a, b);
+                }
+            }
+        }
+    }
+
+  region_of.assign(n, -1);
+  for(i = 0; i < n; i++)
+    {
+      int root;
+      if(!flagged[i]) continue;
+      root = stl_union_find(parent, i);
+      if(region_of[root] == -1)
+        {
+          region_of[root] = (int) regions.size();
+          regions.push_back(stl_overhang_region());
+        }
+      regions[region_of[root]].facets.push_back(i);
+    }
+
+  stl_parallel_for((int) regions.size(), 1, [&](int begin, int end)
+    {
+      for(int r = begin; r < end; r++)
+        {
+          stl_region_measure(mesh, params, regions[r]);
+        }
+    });
+  stable_sort(regions.begin(), regions.end(), stl_region_larger);
+}
@@ -0,0 +1,47 @@
+#ifndef OVERHANG_H
+#define OVERHANG_H
+
+#include <vector>
+#include "slice.h"
+
+typedef struct
+{
+  float            critical_angle;  /* degrees past vertical that print
+                                       without support, typically 45 */
+  float            bed_tolerance;   /* facets this close to the bottom of
+                                       the part rest on the plate */
+  stl_slice_params layers;          /* footprint layers; a layer_height of
+                                       0 skips the footprints */
+}stl_overhang_params;
+
+/* The part of a region that falls into one layer, seen from below. */
+typedef struct
+{
+  int   layer;
+  float area;
+  float min_x;
+  float min_y;
+  float max_x;
+  float max_y;
+}stl_overhang_footprint;
+
+struct stl_overhang_region
+{
+  std::vector<int>                    facets;
+  float                               area;            /* surface area */
+  float                               projected_area;  /* seen from below */
+  stl_vertex                          lowest;
+  std::vector<stl_overhang_footprint> footprints;
+};
+
+/* Flags every facet that faces down more steeply than the critical angle
+ * and groups the flagged facets into edge-connected regions through
+ * neighbors_start (check_facets_exact()).  Stored normals are trusted when
+ * they are unit length and recomputed otherwise.  Classification and the
+ * per-region measurements run on the thread pool.  Regions come out
+ * largest first.
+ */
+void stl_detect_overhangs(const stl &mesh, const stl_overhang_params &params,
+                          std::vector<stl_overhang_region> &regions);
+
+#endif // OVERHANG_H
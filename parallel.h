@@ -0,0 +1,98 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QRunnable>
+#include <QtCore/QSemaphore>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
+
+/* Runs body(begin, end) over [0, count) in chunks of at least grain
+ * items, spread over the global QThreadPool.  The calling thread works
+ * too, and helpers are only started on threads that are idle right now
+ * (tryStart), so calling this from inside another pool task can't
+ * deadlock; at worst the loop runs on the caller alone.
+ */
+
+template <typename Body>
+class stl_parallel_state
+{
+public:
+    stl_parallel_state(const Body &body, int count, int chunk)
+        : body(body), count(count), chunk(chunk), next(0) {}
+
+    void work()
+    {
+        for(;;)
+          {
+            int begin = next.fetchAndAddOrdered(chunk);
+            if(begin >= count)
+                break;
+            body(begin, begin + chunk < count ? begin + chunk : count);
+          }
+    }
+
+    const Body &body;
+    int         count;
+    int         chunk;
+    QAtomicInt  next;
+    QSemaphore  finished;
+};
+
+template <typename Body>
+class stl_parallel_helper : public QRunnable
+{
+public:
+    stl_parallel_helper(stl_parallel_state<Body> *state) : state(state) {}
+
+    void run()
+    {
+        state->work();
+        state->finished.release();
+    }
+
+private:
+    stl_parallel_state<Body> *state;
+};
+
+template <typename Body>
+void stl_parallel_for(int count, int grain, const Body &body)
+{
+    int threads = QThread::idealThreadCount();
+    int chunk;
+    int helpers;
+    int started;
+
+    if(count <= 0)
+        return;
+    if(grain < 1)
+        grain = 1;
+    if(threads <= 1 || count <= grain)
+      {
+        body(0, count);
+        return;
+      }
+
+    /* A few chunks per thread evens out uneven work. */
+    chunk = count / (threads * 4);
+    if(chunk < grain)
+        chunk = grain;
+    helpers = (count + chunk - 1) / chunk - 1;
+    if(helpers > threads - 1)
+        helpers = threads - 1;
+
+    stl_parallel_state<Body> state(body, count, chunk);
+    for(started = 0; started < helpers; started++)
+      {
+        stl_parallel_helper<Body> *helper = new stl_parallel_helper<Body>(&state);
+        if(!QThreadPool::globalInstance()->tryStart(helper))
+          {
+            delete helper;
+            break;
+          }
+      }
+    state.work();
+    state.finished.acquire(started);
+}
+
+#endif // PARALLEL_H
@@ -0,0 +1,244 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "plate.h"
+
+using namespace std;
+
+/* Facets are streamed out through a buffer this many facets long. */
+#define PLATE_WRITE_BATCH 4096
+
+static int stl_same_orientation(const stl_instance *a, const stl_instance *b);
+static char *stl_pack_little_float(char *out, float value);
+
+void stl_plate::add_instance(const stl *mesh, const stl_transform &transform)
+{
+  stl_instance instance;
+
+  instance.mesh = mesh;
+  instance.transform = transform;
+  instances.push_back(instance);
+}
+
+void stl_plate::add_instance(const stl *mesh, float x, float y)
+{
+  stl_transform transform;
+
+  stl_transform_identity(&transform);
+  stl_transform_translate(&transform, x, y, 0.0);
+  add_instance(mesh, transform);
+}
+
+int stl_plate::number_of_facets() const
+{
+  int    total = 0;
+  size_t i;
+
+  for(i = 0; i < instances.size(); i++)
+    {
+      total += instances[i].mesh->stats.number_of_facets;
+    }
+  return total;
+}
+
+/* Instances that differ only by an XY translation slice identically. */
+static int stl_same_orientation(const stl_instance *a, const stl_instance *b)
+{
+  return a->mesh == b->mesh
+      && !memcmp(a->transform.m, b->transform.m, sizeof(a->transform.m))
+      && a->transform.t[2] == b->transform.t[2];
+}
+
+void stl_plate::slice(const stl_slice_params &params,
+                      vector<stl_layer> &layers) const
+{
+  vector<int> group(instances.size(), -1);
+  size_t      i;
+  size_t      j;
+  int         count = stl_slice_layer_count(&params);
+  int         l;
+
+  layers.resize(count);
+  for(l = 0; l < count; l++)
+    {
+      layers[l].z = stl_slice_layer_z(&params, l);
+      layers[l].area = 0.0;
+      layers[l].perimeter = 0.0;
+      layers[l].contours.clear();
+    }
+
+  for(i = 0; i < instances.size(); i++)
+    {
+      if(group[i] != -1)
+        {
+          continue;
+        }
+      for(j = i; j < instances.size(); j++)
+        {
+          if(group[j] == -1 && stl_same_orientation(&instances[i],
+                                                    &instances[j]))
+            {
+              group[j] = (int) i;
+            }
+        }
+
+      /* Slice the first instance of the group without its XY offset. */
+      stl_transform          orientation = instances[i].transform;
+      vector<stl_layer>      shape;
+
+      orientation.t[0] = 0.0;
+      orientation.t[1] = 0.0;
+      stl_slicer slicer(*instances[i].mesh, orientation);
+      slicer.slice(params, shape);
+
+      for(j = i; j < instances.size(); j++)
+        {
+          float dx;
+          float dy;
+
+          if(group[j] != (int) i)
+            {
+              continue;
+            }
+          dx = instances[j].transform.t[0];
+          dy = instances[j].transform.t[1];
+          for(l = 0; l < count; l++)
+            {
+              size_t c;
+              size_t first = layers[l].contours.size();
+
+              /* A translation changes neither. */
+              layers[l].area += shape[l].area;
+              layers[l].perimeter += shape[l].perimeter;
+              layers[l].contours.insert(layers[l].contours.end(),
+                                        shape[l].contours.begin(),
+                                        shape[l].contours.end());
+              for(c = first; c < layers[l].contours.size(); c++)
+                {
+                  vector<stl_point2> &points = layers[l].contours[c].points;
+                  size_t              p;
+
+                  for(p = 0; p < points.size(); p++)
+                    {
+                      points[p].x += dx;
+                      points[p].y += dy;
+                    }
+                }
+            }
+        }
+    }
+}
+
+static char *stl_pack_little_float(char *out, float value)
+{
+  union
+    {
+      float    float_value;
+      unsigned int_value;
+    } value_in;
+
+  value_in.float_value = value;
+  out[0] = value_in.int_value & 0xFF;
+  out[1] = (value_in.int_value >> 0x08) & 0xFF;
+  out[2] = (value_in.int_value >> 0x10) & 0xFF;
+  out[3] = (value_in.int_value >> 0x18) & 0xFF;
+  return out + 4;
+}
+
+/* Writes every instance as one binary STL without building the merged
+ * mesh.  Normals are recomputed from the placed vertices so that scaled
+ * or mirrored placements stay correct; a mirrored placement also swaps
+ * two corners of every facet, so that the winding still faces out.
+ */
+void stl_plate::write_binary(char *file, char *label) const
+{
+  FILE      *fp;
+  char      *error_msg;
+  char      *buffer;
+  char      *out;
+  char       header[LABEL_SIZE];
+  int        facets = number_of_facets();
+  size_t     i;
+  int        f;
+  int        k;
+
+  fp = fopen(file, "wb");
+  if(fp == NULL)
+    {
+      error_msg =
+        (char *) malloc(81 + strlen(file)); /* Allow 80 chars+file size for message */
+      sprintf(error_msg, "stl_plate_write_binary: Couldn't open %s for writing",
+              file);
+      perror(error_msg);
+      free(error_msg);
+      exit(1);
+    }
+
+  memset(header, 0, LABEL_SIZE);
+  memcpy(header, label, STL_MIN(strlen(label), (size_t) LABEL_SIZE));
+  fwrite(header, LABEL_SIZE, 1, fp);
+  fputc(facets & 0xFF, fp);
+  fputc((facets >> 0x08) & 0xFF, fp);
+  fputc((facets >> 0x10) & 0xFF, fp);
+  fputc((facets >> 0x18) & 0xFF, fp);
+
+  buffer = (char *) malloc(PLATE_WRITE_BATCH * SIZEOF_STL_FACET);
+  if(buffer == NULL) perror("stl_plate_write_binary");
+
+  for(i = 0; i < instances.size(); i++)
+    {
+      const stl     *mesh = instances[i].mesh;
+      stl_transform  xf = instances[i].transform;
+      int            second = stl_transform_is_mirror(&xf) ? 2 : 1;
+
+      out = buffer;
+      for(f = 0; f < mesh->stats.number_of_facets; f++)
+        {
+          stl_facet        copy = mesh->get_facet(f);
+          const stl_facet *facet = &copy;
+          stl_vertex       v[3];
+          float            n[3];
+          float            length;
+
+          stl_transform_apply(&xf, &facet->vertex[0], &v[0]);
+          stl_transform_apply(&xf, &facet->vertex[second], &v[1]);
+          stl_transform_apply(&xf, &facet->vertex[3 - second], &v[2]);
+          n[0] = (v[1].y - v[0].y) * (v[2].z - v[0].z)
+               - (v[1].z - v[0].z) * (v[2].y - v[0].y);
+          n[1] = (v[1].z - v[0].z) * (v[2].x - v[0].x)
+               - (v[1].x - v[0].x) * (v[2].z - v[0].z);
+          n[2] = (v[1].x - v[0].x) * (v[2].y - v[0].y)
+               - (v[1].y - v[0].y) * (v[2].x - v[0].x);
+          length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+          if(length > 0.0)
+            {
+              n[0] /= length; n[1] /= length; n[2] /= length;
+            }
+
+          out = stl_pack_little_float(out, n[0]);
+          out = stl_pack_little_float(out, n[1]);
+          out = stl_pack_little_float(out, n[2]);
+          for(k = 0; k < 3; k++)
+            {
+              out = stl_pack_little_float(out, v[k].x);
+              out = stl_pack_little_float(out, v[k].y);
+              out = stl_pack_little_float(out, v[k].z);
+            }
+          *out++ = facet->extra[0];
+          *out++ = facet->extra[1];
+
+          if(out == buffer + PLATE_WRITE_BATCH * SIZEOF_STL_FACET)
+            {
+              fwrite(buffer, out - buffer, 1, fp);
+              out = buffer;
+            }
+        }
+      if(out != buffer)
+        {
+          fwrite(buffer, out - buffer, 1, fp);
+        }
+    }
+
+  free(buffer);
+  fclose(fp);
+}
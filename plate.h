@@ -0,0 +1,37 @@
+#ifndef PLATE_H
+#define PLATE_H
+
+#include <vector>
+#include "slice.h"
+
+/* One placed copy of a mesh.  Instances only point at their mesh, so
+ * they are cheap to copy and any number of them can share one loaded
+ * part; the mesh must outlive every instance that refers to it.
+ */
+typedef struct
+{
+  const stl     *mesh;
+  stl_transform  transform;
+}stl_instance;
+
+/* A build plate of instanced parts.  Slicing groups the instances by
+ * mesh and orientation (the linear part of the transform and its Z
+ * offset), slices each group once and translates the contours into
+ * place per instance, so slicing cost follows the number of distinct
+ * orientations rather than the number of copies.
+ */
+class stl_plate
+{
+public:
+    std::vector<stl_instance> instances;
+
+    void add_instance(const stl *mesh, const stl_transform &transform);
+    void add_instance(const stl *mesh, float x, float y);
+    int number_of_facets() const;
+
+    void slice(const stl_slice_params &params,
+               std::vector<stl_layer> &layers) const;
+    void write_binary(char *file, char *label) const;
+};
+
+#endif // PLATE_H
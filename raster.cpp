@@ -0,0 +1,430 @@
+#include <QtCore/QByteArray>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QRunnable>
+#include <QtCore/QThread>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include "raster.h"
+
+using namespace std;
+
+/* zlib level for PNG data.  Layer masks are mostly long runs, which the
+   fastest level already packs well; the higher ones cost several times
+   the time for a few percent. */
+#define RASTER_PNG_LEVEL 1
+
+/* An edge in pixel space, top end first: rows grow downwards. */
+struct stl_raster_edge
+{
+    float y_top;
+    float y_bottom;
+    float x_top;
+    float dxdy;
+
+    bool operator<(const stl_raster_edge &other) const
+    {
+        return y_top < other.y_top;
+    }
+};
+
+static void stl_raster_edges(const stl_layer &layer,
+                             const stl_raster_params &params,
+                             vector<stl_raster_edge> &edges)
+{
+    float  top = params.origin_y + params.height * params.pixel_y;
+    size_t c;
+    size_t p;
+
+    edges.clear();
+    for(c = 0; c < layer.contours.size(); c++)
+      {
+        const stl_contour &contour = layer.contours[c];
+        size_t             n = contour.points.size();
+
+        if(!contour.closed || n < 3)
+            continue;
+        for(p = 0; p < n; p++)
+          {
+            const stl_point2 &a = contour.points[p];
+            const stl_point2 &b = contour.points[(p + 1) % n];
+            float ax = (a.x - params.origin_x) / params.pixel_x;
+            float ay = (top - a.y) / params.pixel_y;
+            float bx = (b.x - params.origin_x) / params.pixel_x;
+            float by = (top - b.y) / params.pixel_y;
+            stl_raster_edge edge;
+
+            /* Horizontal edges never cross a scanline. */
+            if(ay == by)
+                continue;
+            if(ay > by)
+              {
+                swap(ax, bx);
+                swap(ay, by);
+              }
+            edge.y_top = ay;
+            edge.y_bottom = by;
+            edge.x_top = ax;
+            edge.dxdy = (bx - ax) / (by - ay);
+            edges.push_back(edge);
+          }
+      }
+    sort(edges.begin(), edges.end());
+}
+
+/* Sets pixels [first, last) of a packed 1-bit row. */
+static void stl_raster_fill_bits(unsigned char *row, int first, int last)
+{
+    int first_byte = first >> 3;
+    int last_byte = last >> 3;
+
+    if(first >= last)
+        return;
+    if(first_byte == last_byte)
+      {
+        row[first_byte] |= (0xff >> (first & 7)) & ~(0xff >> (last & 7));
+        return;
+      }
+    row[first_byte] |= 0xff >> (first & 7);
+    memset(row + first_byte + 1, 0xff, last_byte - first_byte - 1);
+    if(last & 7)
+        row[last_byte] |= ~(0xff >> (last & 7));
+}
+
+/* Adds weight times the part of each pixel that [xa, xb) covers. */
+static void stl_raster_fill_cover(float *cover, int width, float xa, float xb,
+                                  float weight)
+{
+    int first;
+    int last;
+    int i;
+
+    xa = STL_MAX(xa, 0.0f);
+    xb = STL_MIN(xb, (float) width);
+    if(xa >= xb)
+        return;
+    first = (int) xa;
+    last = (int) xb;
+    if(first == last)
+      {
+        cover[first] += (xb - xa) * weight;
+        return;
+      }
+    cover[first] += (first + 1 - xa) * weight;
+    for(i = first + 1; i < last; i++)
+        cover[i] += weight;
+    if(last < width)
+        cover[last] += (xb - last) * weight;
+}
+
+void stl_rasterize_layer(const stl_layer &layer,
+                         const stl_raster_params &params,
+                         stl_raster_image &image)
+{
+    vector<stl_raster_edge> edges;
+    vector<int>             active;
+    vector<float>           crossings;
+    vector<float>           cover;
+    int                     samples = params.antialias > 0 ? params.antialias : 1;
+    size_t                  next = 0;
+    int                     row;
+    int                     s;
+    size_t                  i;
+
+    image.width = params.width;
+    image.height = params.height;
+    image.bits = params.antialias > 0 ? 8 : 1;
+    image.stride = image.bits == 8 ? image.width : (image.width + 7) / 8;
+    image.pixels.assign((size_t) image.stride * image.height, 0);
+    if(image.bits == 8)
+        cover.resize(image.width);
+
+    stl_raster_edges(layer, params, edges);
+    if(edges.empty())
+        return;
+
+    row = STL_MAX(0, (int) floor(edges[0].y_top));
+    for(; row < image.height; row++)
+      {
+        unsigned char *pixels = &image.pixels[(size_t) row * image.stride];
+
+        if(next == edges.size() && active.empty())
+            break;
+        if(image.bits == 8)
+            fill(cover.begin(), cover.end(), 0.0f);
+
+        for(s = 0; s < samples; s++)
+          {
+            float y = row + (s + 0.5f) / samples;
+            size_t kept = 0;
+
+            /* Edges cover [y_top, y_bottom), so a vertex shared by two
+               edges is counted once. */
+            while(next < edges.size() && edges[next].y_top <= y)
+                active.push_back((int) next++);
+            crossings.clear();
+            for(i = 0; i < active.size(); i++)
+              {
+                const stl_raster_edge &edge = edges[active[i]];
+                if(edge.y_bottom <= y)
+                    continue;
+                active[kept++] = active[i];
+                if(edge.y_top <= y)
+                    crossings.push_back(edge.x_top + (y - edge.y_top) * edge.dxdy);
+              }
+            active.resize(kept);
+            sort(crossings.begin(), crossings.end());
+
+            for(i = 0; i + 1 < crossings.size(); i += 2)
+              {
+                if(image.bits == 8)
+                  {
+                    stl_raster_fill_cover(&cover[0], image.width, crossings[i],
+                                          crossings[i + 1], 1.0f / samples);
+                    continue;
+                  }
+                /* Pixel c is inside when its centre c + 0.5 is. */
+                int first = (int) ceil(crossings[i] - 0.5f);
+                int last = (int) ceil(crossings[i + 1] - 0.5f);
+                stl_raster_fill_bits(pixels, STL_MAX(first, 0),
+                                     STL_MIN(last, image.width));
+              }
+          }
+
+        if(image.bits == 8)
+          {
+            for(i = 0; i < (size_t) image.width; i++)
+                pixels[i] = (unsigned char) (STL_MIN(cover[i], 1.0f) * 255.0f + 0.5f);
+          }
+      }
+}
+
+struct stl_crc_table
+{
+    uint32_t entries[256];
+
+    stl_crc_table()
+    {
+        for(uint32_t n = 0; n < 256; n++)
+          {
+            uint32_t c = n;
+            for(int k = 0; k < 8; k++)
+                c = c & 1 ? 0xedb88320U ^ (c >> 1) : c >> 1;
+            entries[n] = c;
+          }
+    }
+};
+
+static uint32_t stl_crc32(uint32_t crc, const unsigned char *data, size_t size)
+{
+    static const stl_crc_table table;
+    size_t i;
+
+    crc = ~crc;
+    for(i = 0; i < size; i++)
+        crc = table.entries[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void stl_raster_put32(vector<unsigned char> &out, uint32_t value,
+                             bool big_endian)
+{
+    for(int k = 0; k < 4; k++)
+        out.push_back((value >> (big_endian ? 24 - 8 * k : 8 * k)) & 0xff);
+}
+
+static void stl_png_chunk(vector<unsigned char> &out, const char *type,
+                          const unsigned char *data, size_t size)
+{
+    size_t start;
+
+    stl_raster_put32(out, (uint32_t) size, true);
+    start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data, data + size);
+    stl_raster_put32(out, stl_crc32(0, &out[start], size + 4), true);
+}
+
+static stl_status stl_raster_write(char *file, const vector<unsigned char> &out)
+{
+    FILE *fp;
+    int   failed;
+
+    fp = fopen(file, "wb");
+    if(fp == NULL)
+        return STL_ERR_OPEN;
+    failed = fwrite(&out[0], 1, out.size(), fp) != out.size();
+    if(fclose(fp) != 0)
+        failed = 1;
+    return failed ? STL_ERR_WRITE : STL_OK;
+}
+
+stl_status stl_raster_write_png(char *file, const stl_raster_image &image)
+{
+    static const unsigned char signature[8] =
+      {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    vector<unsigned char> raw((size_t) (image.stride + 1) * image.height);
+    vector<unsigned char> header;
+    vector<unsigned char> out(signature, signature + 8);
+    QByteArray            compressed;
+    int                   row;
+
+    /* Filter type 0 in front of every row. */
+    for(row = 0; row < image.height; row++)
+      {
+        raw[(size_t) row * (image.stride + 1)] = 0;
+        memcpy(&raw[(size_t) row * (image.stride + 1) + 1],
+               &image.pixels[(size_t) row * image.stride], image.stride);
+      }
+    compressed = qCompress(&raw[0], (int) raw.size(), RASTER_PNG_LEVEL);
+    if(compressed.size() <= 4)
+        return STL_ERR_MEMORY;
+
+    stl_raster_put32(header, image.width, true);
+    stl_raster_put32(header, image.height, true);
+    header.push_back(image.bits);
+    header.push_back(0);   /* greyscale */
+    header.push_back(0);   /* deflate */
+    header.push_back(0);   /* adaptive filtering */
+    header.push_back(0);   /* no interlace */
+    stl_png_chunk(out, "IHDR", &header[0], header.size());
+    /* qCompress() puts the uncompressed size in front of the zlib
+       stream. */
+    stl_png_chunk(out, "IDAT",
+                  (const unsigned char *) compressed.constData() + 4,
+                  compressed.size() - 4);
+    stl_png_chunk(out, "IEND", NULL, 0);
+    return stl_raster_write(file, out);
+}
+
+static inline int stl_raster_pixel(const stl_raster_image &image,
+                                   const unsigned char *row, int x)
+{
+    if(image.bits == 8)
+        return row[x];
+    return (row[x >> 3] >> (7 - (x & 7))) & 1;
+}
+
+stl_status stl_raster_write_rle(char *file, const stl_raster_image &image)
+{
+    vector<unsigned char> out;
+    uint64_t              run = 0;
+    int                   value = -1;
+    int                   row;
+    int                   x;
+
+    out.insert(out.end(), "SRLE", "SRLE" + 4);
+    stl_raster_put32(out, image.width, false);
+    stl_raster_put32(out, image.height, false);
+    stl_raster_put32(out, image.bits, false);
+    for(row = 0; row <= image.height; row++)
+      {
+        const unsigned char *pixels = row < image.height
+                                      ? &image.pixels[(size_t) row * image.stride]
+                                      : NULL;
+        int width = row < image.height ? image.width : 1;
+
+        for(x = 0; x < width; x++)
+          {
+            /* One step past the last row flushes the final run. */
+            int pixel = pixels != NULL ? stl_raster_pixel(image, pixels, x) : -1;
+            if(pixel == value)
+              {
+                run++;
+                continue;
+              }
+            if(run > 0)
+              {
+                out.push_back(value);
+                while(run >= 0x80)
+                  {
+                    out.push_back((run & 0x7f) | 0x80);
+                    run >>= 7;
+                  }
+                out.push_back(run);
+              }
+            value = pixel;
+            run = 1;
+          }
+      }
+    return stl_raster_write(file, out);
+}
+
+class stl_raster_sink::job : public QRunnable
+{
+public:
+    job(stl_raster_sink *sink, int index, const stl_layer &layer)
+        : sink(sink), index(index), layer(layer) {}
+
+    void run()
+    {
+        stl_raster_image image;
+        vector<char>     name(sink->pattern.size() + 32);
+        stl_status       status;
+
+        stl_rasterize_layer(layer, sink->params, image);
+        snprintf(&name[0], name.size(), sink->pattern.c_str(), index);
+        if(sink->format == STL_RASTER_PNG)
+            status = stl_raster_write_png(&name[0], image);
+        else
+            status = stl_raster_write_rle(&name[0], image);
+        sink->finish(status);
+    }
+
+private:
+    stl_raster_sink *sink;
+    int              index;
+    stl_layer        layer;
+};
+
+stl_raster_sink::stl_raster_sink(char *pattern, const stl_raster_params &params,
+                                 stl_raster_format format, int threads)
+    : pattern(pattern), params(params), format(format), status(STL_OK)
+{
+    if(threads < 1)
+        threads = QThread::idealThreadCount();
+    pool.setMaxThreadCount(threads);
+    queue_size = 2 * threads;
+    slots.release(queue_size);
+}
+
+stl_raster_sink::~stl_raster_sink()
+{
+    pool.waitForDone();
+}
+
+stl_status stl_raster_sink::begin(const stl_slice_params &, int)
+{
+    pool.waitForDone();
+    status = STL_OK;
+    return STL_OK;
+}
+
+stl_status stl_raster_sink::write_layer(int index, const stl_layer &layer)
+{
+    {
+        QMutexLocker locker(&mutex);
+        if(status != STL_OK)
+            return status;
+    }
+    slots.acquire();
+    pool.start(new job(this, index, layer));
+    return STL_OK;
+}
+
+stl_status stl_raster_sink::end()
+{
+    pool.waitForDone();
+    return status;
+}
+
+void stl_raster_sink::finish(stl_status result)
+{
+    {
+        QMutexLocker locker(&mutex);
+        if(status == STL_OK)
+            status = result;
+    }
+    slots.release();
+}
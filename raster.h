@@ -0,0 +1,97 @@
+#ifndef RASTER_H
+#define RASTER_H
+
+#include <string>
+#include <vector>
+#include <QtCore/QMutex>
+#include <QtCore/QSemaphore>
+#include <QtCore/QThreadPool>
+#include "layerwriter.h"
+
+/* Where the image lies on the build plate.  Pixel (0, 0) is the top left
+ * one; its lower left corner is at origin_x, origin_y + height * pixel_y,
+ * so x points right and y up as in the mesh.  antialias 0 gives a 1-bit
+ * mask of the pixels whose centre is inside; otherwise each row is
+ * sampled on that many sub-scanlines and every span adds its exact
+ * horizontal coverage to an 8-bit grey level.
+ */
+typedef struct
+{
+  int   width;
+  int   height;
+  float origin_x;
+  float origin_y;
+  float pixel_x;
+  float pixel_y;
+  int   antialias;
+}stl_raster_params;
+
+/* Rows top to bottom, stride bytes apart.  A 1-bit image packs eight
+   pixels per byte, most significant bit first, as PNG and PBM do. */
+struct stl_raster_image
+{
+  int                        width;
+  int                        height;
+  int                        bits;
+  int                        stride;
+  std::vector<unsigned char> pixels;
+};
+
+/* Fills the closed contours of a layer with the even-odd rule using a
+ * sorted edge table and an active edge list.  Open chains enclose
+ * nothing and are left out.  Safe to call from any number of threads.
+ */
+void stl_rasterize_layer(const stl_layer &layer,
+                         const stl_raster_params &params,
+                         stl_raster_image &image);
+
+/* A greyscale PNG of the image, 1 or 8 bits deep. */
+stl_status stl_raster_write_png(char *file, const stl_raster_image &image);
+
+/* A run-length file: "SRLE", then width, height and bits as 32-bit little
+ * endian words, then runs in row order as a pixel value byte followed by
+ * its length as an LEB128 varint.  Runs continue across rows.
+ */
+stl_status stl_raster_write_rle(char *file, const stl_raster_image &image);
+
+typedef enum {STL_RASTER_PNG, STL_RASTER_RLE} stl_raster_format;
+
+/* Writes one image per layer to a file named by the printf pattern and
+ * the layer index, e.g. "out/%05d.png".  Layers are rasterized and
+ * compressed on a private pool of threads (0: one per core) while the
+ * slicer keeps going; write_layer() only blocks once two layers per
+ * thread are queued.  The first failure is returned from the next
+ * write_layer() or from end().
+ */
+class stl_raster_sink : public stl_layer_sink
+{
+public:
+    stl_raster_sink(char *pattern, const stl_raster_params &params,
+                    stl_raster_format format, int threads);
+    ~stl_raster_sink();
+
+    stl_status begin(const stl_slice_params &params, int layer_count);
+    stl_status write_layer(int index, const stl_layer &layer);
+    stl_status end();
+
+private:
+    class job;
+    friend class job;
+
+    void finish(stl_status status);
+
+    std::string        pattern;
+    stl_raster_params  params;
+    stl_raster_format  format;
+
+    QThreadPool        pool;
+    QSemaphore         slots;
+    int                queue_size;
+    QMutex             mutex;
+    stl_status         status;
+
+    stl_raster_sink(const stl_raster_sink &);
+    stl_raster_sink &operator=(const stl_raster_sink &);
+};
+
+#endif // RASTER_H
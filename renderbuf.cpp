@@ -0,0 +1,357 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "renderbuf.h"
+#include "parallel.h"
+
+using namespace std;
+
+/* Facets or vertices per parallel chunk at the least. */
+#define RENDER_GRAIN 16384
+
+/* Largest quantized magnitude; -32768 is left out so that q and -q both
+   fit and normals map symmetrically. */
+#define RENDER_SHORT_MAX 32767
+
+/* write_quad_object()'s colors by number of open edges, as RGBA. */
+static const unsigned char stl_render_colors[4][4] =
+{
+  {0, 0, 255, 255},
+  {0, 255, 0, 255},
+  {255, 255, 255, 255},
+  {255, 0, 0, 255}
+};
+
+static inline int stl_render_open_edges(const stl &mesh, int facet)
+{
+  const stl_neighbors *neighbors;
+
+  if(mesh.neighbors_start == NULL)
+    {
+      return 0;
+    }
+  neighbors = &mesh.neighbors_start[facet];
+  return (neighbors->neighbor[0] == -1) + (neighbors->neighbor[1] == -1)
+         + (neighbors->neighbor[2] == -1);
+}
+
+static inline void stl_render_normalize(float n[3])
+{
+  float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+  float inverse = length > 0.0f ? 1.0f / length : 0.0f;
+
+  n[0] *= inverse;
+  n[1] *= inverse;
+  n[2] *= inverse;
+}
+
+static inline int16_t stl_render_short(float value)
+{
+  long q = lrintf(value);
+  return (int16_t) STL_MAX(-RENDER_SHORT_MAX, STL_MIN(q, RENDER_SHORT_MAX));
+}
+
+/* Writes one vertex; n must be unit length or zero.  inverse_scale is
+   1 / info.scale, only read when quantizing. */
+template <bool Quantized>
+static inline void stl_render_vertex(char *out, const stl_render_info &info,
+                                     const float inverse_scale[3],
+                                     const stl_vertex &p, const float n[3],
+                                     const unsigned char *color)
+{
+  if(Quantized)
+    {
+      int16_t *position = (int16_t *) out;
+      int16_t *normal = (int16_t *) (out + info.normal_offset);
+
+      position[0] = stl_render_short((p.x - info.offset[0]) * inverse_scale[0]);
+      position[1] = stl_render_short((p.y - info.offset[1]) * inverse_scale[1]);
+      position[2] = stl_render_short((p.z - info.offset[2]) * inverse_scale[2]);
+      normal[0] = stl_render_short(n[0] * RENDER_SHORT_MAX);
+      normal[1] = stl_render_short(n[1] * RENDER_SHORT_MAX);
+      normal[2] = stl_render_short(n[2] * RENDER_SHORT_MAX);
+    }
+  else
+    {
+      float *position = (float *) out;
+      float *normal = (float *) (out + info.normal_offset);
+
+      position[0] = p.x;
+      position[1] = p.y;
+      position[2] = p.z;
+      normal[0] = n[0];
+      normal[1] = n[1];
+      normal[2] = n[2];
+    }
+  if(info.color_offset >= 0)
+    {
+      memcpy(out + info.color_offset, color, 4);
+    }
+}
+
+template <bool Quantized>
+static void stl_render_facets(const stl &mesh, const stl_render_info &info,
+                              const float inverse_scale[3], char *vertices)
+{
+  stl_parallel_for(mesh.stats.number_of_facets, RENDER_GRAIN,
+                   [&](int begin, int end)
+    {
+      for(int f = begin; f < end; f++)
+        {
+          const stl_facet &facet = mesh.facet_start[f];
+          const unsigned char *color =
+            stl_render_colors[stl_render_open_edges(mesh, f)];
+          float normal[3] = {facet.normal.x, facet.normal.y, facet.normal.z};
+          char *out = vertices + (size_t) f * 3 * info.stride;
+
+          stl_render_normalize(normal);
+          for(int c = 0; c < 3; c++)
+            {
+              stl_render_vertex<Quantized>(out + c * info.stride, info,
+                                           inverse_scale, facet.vertex[c],
+                                           normal, color);
+            }
+        }
+    });
+}
+
+template <bool Quantized>
+static void stl_render_shared(const stl &mesh, const stl_render_info &info,
+                              const float inverse_scale[3],
+                              const float *normals,
+                              const unsigned char *open_edges, char *vertices)
+{
+  stl_parallel_for(mesh.stats.shared_vertices, RENDER_GRAIN,
+                   [&](int begin, int end)
+    {
+      for(int v = begin; v < end; v++)
+        {
+          float normal[3] = {normals[v * 3], normals[v * 3 + 1],
+                             normals[v * 3 + 2]};
+
+          stl_render_normalize(normal);
+          stl_render_vertex<Quantized>(vertices + (size_t) v * info.stride,
+                                       info, inverse_scale, mesh.v_shared[v],
+                                       normal,
+                                       stl_render_colors[open_edges[v]]);
+        }
+    });
+}
+
+/* Box of the count points handed out by point(i), found chunk by chunk
+   in parallel.  Chunks start at multiples of the grain, so each gets a
+   slot of its own. */
+template <typename Point>
+static void stl_render_bounds(int count, const Point &point, float min[3],
+                              float max[3])
+{
+  int                slots = count / RENDER_GRAIN + 1;
+  vector<stl_vertex> slot_min(slots);
+  vector<stl_vertex> slot_max(slots);
+  vector<char>       used(slots, 0);
+  int                i;
+
+  stl_parallel_for(count, RENDER_GRAIN, [&](int begin, int end)
+    {
+      stl_vertex lo = point(begin);
+      stl_vertex hi = lo;
+      for(int j = begin + 1; j < end; j++)
+        {
+          const stl_vertex &p = point(j);
+          lo.x = STL_MIN(lo.x, p.x);
+          lo.y = STL_MIN(lo.y, p.y);
+          lo.z = STL_MIN(lo.z, p.z);
+          hi.x = STL_MAX(hi.x, p.x);
+          hi.y = STL_MAX(hi.y, p.y);
+          hi.z = STL_MAX(hi.z, p.z);
+        }
+      slot_min[begin / RENDER_GRAIN] = lo;
+      slot_max[begin / RENDER_GRAIN] = hi;
+      used[begin / RENDER_GRAIN] = 1;
+    });
+
+  for(i = 0; i < slots; i++)
+    {
+      if(!used[i])
+        {
+          continue;
+        }
+      min[0] = STL_MIN(min[0], slot_min[i].x);
+      min[1] = STL_MIN(min[1], slot_min[i].y);
+      min[2] = STL_MIN(min[2], slot_min[i].z);
+      max[0] = STL_MAX(max[0], slot_max[i].x);
+      max[1] = STL_MAX(max[1], slot_max[i].y);
+      max[2] = STL_MAX(max[2], slot_max[i].z);
+    }
+}
+
+void stl_render_prepare(const stl &mesh, int flags, stl_render_info *info)
+{
+  bool  indexed = (flags & STL_RENDER_INDEXED) != 0;
+  bool  quantized = (flags & STL_RENDER_QUANTIZED) != 0;
+  float min[3] = {HUGE_VALF, HUGE_VALF, HUGE_VALF};
+  float max[3] = {-HUGE_VALF, -HUGE_VALF, -HUGE_VALF};
+  int   k;
+
+  memset(info, 0, sizeof(stl_render_info));
+  info->flags = flags;
+  info->normal_offset = quantized ? 3 * sizeof(int16_t) : 3 * sizeof(float);
+  info->stride = 2 * info->normal_offset;
+  info->color_offset = -1;
+  if(flags & STL_RENDER_COLORS)
+    {
+      info->color_offset = info->stride;
+      info->stride += 4;
+    }
+  for(k = 0; k < 3; k++)
+    {
+      info->scale[k] = 1.0;
+    }
+
+  if(indexed)
+    {
+      if(mesh.v_shared == NULL || mesh.v_indices == NULL)
+        {
+          return;
+        }
+      info->vertex_count = mesh.stats.shared_vertices;
+      info->index_count = 3 * mesh.stats.number_of_facets;
+    }
+  else
+    {
+      if(mesh.facet_start == NULL)
+        {
+          return;
+        }
+      info->vertex_count = 3 * mesh.stats.number_of_facets;
+    }
+  if(!quantized || info->vertex_count == 0)
+    {
+      return;
+    }
+
+  if(indexed)
+    {
+      stl_render_bounds(mesh.stats.shared_vertices, [&](int i)
+        {
+          return mesh.v_shared[i];
+        }, min, max);
+    }
+  else
+    {
+      stl_render_bounds(info->vertex_count, [&](int i)
+        {
+          return mesh.facet_start[i / 3].vertex[i % 3];
+        }, min, max);
+    }
+  /* Centred on the box so the full signed range is used. */
+  for(k = 0; k < 3; k++)
+    {
+      info->offset[k] = (min[k] + max[k]) / 2;
+      if(max[k] > min[k])
+        {
+          info->scale[k] = (max[k] - min[k]) / 2 / RENDER_SHORT_MAX;
+        }
+    }
+}
+
+stl_status stl_render_fill(const stl &mesh, const stl_render_info &info,
+                           void *vertices, uint32_t *indices)
+{
+  bool           quantized = (info.flags & STL_RENDER_QUANTIZED) != 0;
+  float          inverse_scale[3];
+  float         *normals;
+  unsigned char *open_edges;
+  int            nv = mesh.stats.shared_vertices;
+  int            i;
+  int            k;
+
+  for(k = 0; k < 3; k++)
+    {
+      inverse_scale[k] = 1.0f / info.scale[k];
+    }
+  if(info.vertex_count == 0)
+    {
+      return STL_OK;
+    }
+
+  if(!(info.flags & STL_RENDER_INDEXED))
+    {
+      if(quantized)
+        {
+          stl_render_facets<true>(mesh, info, inverse_scale, (char *) vertices);
+        }
+      else
+        {
+          stl_render_facets<false>(mesh, info, inverse_scale, (char *) vertices);
+        }
+      return STL_OK;
+    }
+
+  /* Facets scatter into their corners, so this part runs on one thread;
+     the cross products are left unnormalized to weight by area. */
+  normals = (float *) calloc(STL_MAX(nv, 1) * 3, sizeof(float));
+  open_edges = (unsigned char *) calloc(STL_MAX(nv, 1), 1);
+  if(normals == NULL || open_edges == NULL)
+    {
+      free(normals);
+      free(open_edges);
+      return STL_ERR_MEMORY;
+    }
+  for(i = 0; i < mesh.stats.number_of_facets; i++)
+    {
+      const int        *corner = mesh.v_indices[i].vertex;
+      const stl_vertex *p[3];
+      int               open = stl_render_open_edges(mesh, i);
+      float             n[3];
+
+      if(corner[0] < 0 || corner[0] >= nv || corner[1] < 0 || corner[1] >= nv
+         || corner[2] < 0 || corner[2] >= nv)
+        {
+          continue;
+        }
+      for(k = 0; k < 3; k++)
+        {
+          p[k] = &mesh.v_shared[corner[k]];
+        }
+      float ax = p[1]->x - p[0]->x, ay = p[1]->y - p[0]->y, az = p[1]->z - p[0]->z;
+      float bx = p[2]->x - p[0]->x, by = p[2]->y - p[0]->y, bz = p[2]->z - p[0]->z;
+      n[0] = ay * bz - az * by;
+      n[1] = az * bx - ax * bz;
+      n[2] = ax * by - ay * bx;
+      for(k = 0; k < 3; k++)
+        {
+          float *sum = &normals[corner[k] * 3];
+          sum[0] += n[0];
+          sum[1] += n[1];
+          sum[2] += n[2];
+          open_edges[corner[k]] = STL_MAX(open_edges[corner[k]], open);
+        }
+    }
+
+  if(quantized)
+    {
+      stl_render_shared<true>(mesh, info, inverse_scale, normals, open_edges,
+                              (char *) vertices);
+    }
+  else
+    {
+      stl_render_shared<false>(mesh, info, inverse_scale, normals, open_edges,
+                               (char *) vertices);
+    }
+  free(normals);
+  free(open_edges);
+
+  stl_parallel_for(mesh.stats.number_of_facets, RENDER_GRAIN,
+                   [&](int begin, int end)
+    {
+      for(int f = begin; f < end; f++)
+        {
+          indices[f * 3] = (uint32_t) mesh.v_indices[f].vertex[0];
+          indices[f * 3 + 1] = (uint32_t) mesh.v_indices[f].vertex[1];
+          indices[f * 3 + 2] = (uint32_t) mesh.v_indices[f].vertex[2];
+        }
+    });
+  return STL_OK;
+}
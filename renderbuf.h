@@ -0,0 +1,60 @@
+#ifndef RENDERBUF_H
+#define RENDERBUF_H
+
+#include <stdint.h>
+#include "stl.h"
+
+/* Vertex buffers for drawing a mesh, written straight into memory the
+ * caller provides (a mapped GL buffer, say), so nothing is built twice.
+ *
+ * Each vertex is a position and a normal, followed by four color bytes
+ * (RGBA) with STL_RENDER_COLORS.  Positions and normals are float[3]
+ * each, or int16[3] each with STL_RENDER_QUANTIZED: positions spread
+ * over the bounding box as offset + q * scale per axis, normals as
+ * signed normalized shorts (q / 32767).
+ *
+ * Without STL_RENDER_INDEXED every facet gets three vertices of its own
+ * from facet_start, all with the facet's normal and the connectivity
+ * color write_quad_object() uses: blue with all three neighbors, green,
+ * white and red with one, two or three edges open.  With it the
+ * vertices come from v_shared and the triangles from v_indices as
+ * 32-bit indices; normals are the area-weighted average of the facets
+ * around each vertex, and each vertex takes the color of the worst
+ * connected of them, so open edges still show.  Facets count as
+ * connected when neighbors_start hasn't been built.
+ */
+typedef enum
+{
+  STL_RENDER_INDEXED   = 1,
+  STL_RENDER_QUANTIZED = 2,
+  STL_RENDER_COLORS    = 4
+}stl_render_flags;
+
+/* Sizes and offsets are in bytes; color_offset is -1 without colors. */
+typedef struct
+{
+  int   flags;
+  int   vertex_count;
+  int   index_count;
+  int   stride;
+  int   normal_offset;
+  int   color_offset;
+  float offset[3];
+  float scale[3];
+}stl_render_info;
+
+/* Fills in info for the given flags: the buffer sizes to allocate and,
+ * for quantized positions, the bounding box they are spread over.
+ * vertex_count is 0 when the mesh lacks the arrays the mode reads.
+ */
+void stl_render_prepare(const stl &mesh, int flags, stl_render_info *info);
+
+/* Writes info->vertex_count vertices of info->stride bytes each, and in
+ * indexed mode info->index_count indices, in one pass spread over the
+ * thread pool.  info must come from stl_render_prepare() on the same
+ * mesh, unchanged since.
+ */
+stl_status stl_render_fill(const stl &mesh, const stl_render_info &info,
+                           void *vertices, uint32_t *indices);
+
+#endif // RENDERBUF_H
@@ -0,0 +1,180 @@
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include "stl.h"
+#include "parallel.h"
+
+using namespace std;
+
+/* Bits per axis of the Morton code; three of them fill 63 bits. */
+#define REORDER_BITS 21
+
+/* Facets per parallel chunk while computing codes. */
+#define REORDER_GRAIN 16384
+
+/* Spreads the low 21 bits of v so that two zero bits follow each. */
+static inline uint64_t stl_morton_spread(uint64_t v)
+{
+  v &= 0x1fffff;
+  v = (v | v << 32) & 0x1f00000000ffffULL;
+  v = (v | v << 16) & 0x1f0000ff0000ffULL;
+  v = (v | v << 8) & 0x100f00f00f00f00fULL;
+  v = (v | v << 4) & 0x10c30c30c30c30c3ULL;
+  v = (v | v << 2) & 0x1249249249249249ULL;
+  return v;
+}
+
+static inline uint64_t stl_morton_axis(float value, float min, float size)
+{
+  float scaled;
+
+  if(size <= 0.0)
+    {
+      return 0;
+    }
+  scaled = (value - min) / size * ((1 << REORDER_BITS) - 1);
+  scaled = STL_MAX(0.0f, STL_MIN(scaled, (float) ((1 << REORDER_BITS) - 1)));
+  return stl_morton_spread((uint64_t) scaled);
+}
+
+template <typename T>
+static void stl_reorder_array(T *array, const vector<int> &order)
+{
+  vector<T> copy(array, array + order.size());
+  size_t    i;
+
+  for(i = 0; i < order.size(); i++)
+    {
+      array[i] = copy[order[i]];
+    }
+}
+
+void stl::reorder_facets()
+{
+  int                             n = stats.number_of_facets;
+  vector<pair<uint64_t, int> >    codes(n);
+  vector<int>                     order(n);
+  vector<int>                     position(n);
+  stl_vertex                      box_min = stats.min;
+  stl_vertex                      box_size = stats.size;
+  int                             i;
+  int                             k;
+
+  if(n < 2 || (facet_start == NULL && (v_shared == NULL || v_indices == NULL)))
+    {
+      return;
+    }
+
+  /* Indexed imports may not have the box yet. */
+  if(facet_start == NULL && stats.shared_vertices > 0)
+    {
+      box_min = v_shared[0];
+      stl_vertex max = v_shared[0];
+      for(i = 1; i < stats.shared_vertices; i++)
+        {
+          box_min.x = STL_MIN(box_min.x, v_shared[i].x);
+          box_min.y = STL_MIN(box_min.y, v_shared[i].y);
+          box_min.z = STL_MIN(box_min.z, v_shared[i].z);
+          max.x = STL_MAX(max.x, v_shared[i].x);
+          max.y = STL_MAX(max.y, v_shared[i].y);
+          max.z = STL_MAX(max.z, v_shared[i].z);
+        }
+      box_size.x = max.x - box_min.x;
+      box_size.y = max.y - box_min.y;
+      box_size.z = max.z - box_min.z;
+    }
+
+  free_edge_hash();
+  stl_parallel_for(n, REORDER_GRAIN, [&](int begin, int end)
+    {
+      for(int f = begin; f < end; f++)
+        {
+          stl_vertex corner[3];
+          for(int c = 0; c < 3; c++)
+            {
+              corner[c] = facet_start != NULL ? facet_start[f].vertex[c]
+                                              : v_shared[v_indices[f].vertex[c]];
+            }
+          float x = (corner[0].x + corner[1].x + corner[2].x) / 3;
+          float y = (corner[0].y + corner[1].y + corner[2].y) / 3;
+          float z = (corner[0].z + corner[1].z + corner[2].z) / 3;
+          codes[f].first = stl_morton_axis(x, box_min.x, box_size.x)
+                           | stl_morton_axis(y, box_min.y, box_size.y) << 1
+                           | stl_morton_axis(z, box_min.z, box_size.z) << 2;
+          codes[f].second = f;
+        }
+    });
+  /* Ties keep file order, so the result doesn't depend on the sort. */
+  sort(codes.begin(), codes.end());
+  for(i = 0; i < n; i++)
+    {
+      order[i] = codes[i].second;
+      position[order[i]] = i;
+    }
+
+  if(facet_start != NULL)
+    {
+      stl_reorder_array(facet_start, order);
+    }
+  if(neighbors_start != NULL)
+    {
+      stl_reorder_array(neighbors_start, order);
+      for(i = 0; i < n; i++)
+        {
+          for(k = 0; k < 3; k++)
+            {
+              int neighbor = neighbors_start[i].neighbor[k];
+              /* Anything else is left over from before
+                 check_facets_exact() and gets overwritten there. */
+              if(neighbor >= 0 && neighbor < n)
+                {
+                  neighbors_start[i].neighbor[k] = position[neighbor];
+                }
+            }
+        }
+    }
+  if(v_indices == NULL)
+    {
+      return;
+    }
+  stl_reorder_array(v_indices, order);
+  if(v_shared == NULL || stats.shared_vertices == 0)
+    {
+      return;
+    }
+
+  /* Number the shared vertices in order of first use, like
+     generate_shared_vertices() does; unused ones go last. */
+  int          nv = stats.shared_vertices;
+  vector<int>  renumber(nv, -1);
+  vector<int>  vertex_order;
+  int          next = 0;
+
+  vertex_order.reserve(nv);
+  for(i = 0; i < n; i++)
+    {
+      for(k = 0; k < 3; k++)
+        {
+          int v = v_indices[i].vertex[k];
+          if(v < 0 || v >= nv)
+            {
+              continue;
+            }
+          if(renumber[v] < 0)
+            {
+              renumber[v] = next++;
+              vertex_order.push_back(v);
+            }
+          v_indices[i].vertex[k] = renumber[v];
+        }
+    }
+  for(i = 0; i < nv; i++)
+    {
+      if(renumber[i] < 0)
+        {
+          renumber[i] = next++;
+          vertex_order.push_back(i);
+        }
+    }
+  stl_reorder_array(v_shared, vertex_order);
+}
@@ -0,0 +1,372 @@
+#include <math.h>
+#include <utility>
+#include "simplify.h"
+#include "parallel.h"
+
+using namespace std;
+
+/* Most cells per side of the grid the intersection check buckets
+   segments in. */
+#define SIMPLIFY_MAX_CELLS 512
+
+/* A simplified segment from point a to point b of a contour.  Indices
+   of a closed contour run up to its size, which stands for point 0
+   again. */
+typedef struct
+{
+  int contour;
+  int a;
+  int b;
+}stl_simplify_segment;
+
+static inline const stl_point2 &stl_simplify_point(const stl_contour &contour,
+                                                   int i)
+{
+  return contour.points[i % contour.points.size()];
+}
+
+/* Squared distance from p to the segment a-b. */
+static double stl_simplify_distance2(const stl_point2 &p, const stl_point2 &a,
+                                     const stl_point2 &b)
+{
+  double dx = b.x - a.x;
+  double dy = b.y - a.y;
+  double px = p.x - a.x;
+  double py = p.y - a.y;
+  double length2 = dx * dx + dy * dy;
+  double t;
+
+  if(length2 > 0.0)
+    {
+      t = (px * dx + py * dy) / length2;
+      t = t < 0.0 ? 0.0 : (t > 1.0 ? 1.0 : t);
+      px -= t * dx;
+      py -= t * dy;
+    }
+  return px * px + py * py;
+}
+
+/* The point strictly between a and b furthest from the segment a-b. */
+static int stl_simplify_furthest(const stl_contour &contour, int a, int b,
+                                 double *distance2)
+{
+  const stl_point2 &pa = stl_simplify_point(contour, a);
+  const stl_point2 &pb = stl_simplify_point(contour, b);
+  int               furthest = -1;
+  int               i;
+
+  *distance2 = -1.0;
+  for(i = a + 1; i < b; i++)
+    {
+      double d = stl_simplify_distance2(stl_simplify_point(contour, i), pa, pb);
+      if(d > *distance2)
+        {
+          *distance2 = d;
+          furthest = i;
+        }
+    }
+  return furthest;
+}
+
+static void stl_douglas_peucker(const stl_contour &contour, int first,
+                                int last, double tolerance2, vector<char> &keep)
+{
+  vector<pair<int, int> > stack;
+
+  stack.push_back(make_pair(first, last));
+  while(!stack.empty())
+    {
+      int    a = stack.back().first;
+      int    b = stack.back().second;
+      int    furthest;
+      double distance2;
+
+      stack.pop_back();
+      if(b - a < 2)
+        {
+          continue;
+        }
+      furthest = stl_simplify_furthest(contour, a, b, &distance2);
+      if(distance2 > tolerance2)
+        {
+          keep[furthest] = 1;
+          stack.push_back(make_pair(a, furthest));
+          stack.push_back(make_pair(furthest, b));
+        }
+    }
+}
+
+static inline double stl_simplify_orient(const stl_point2 &a,
+                                         const stl_point2 &b,
+                                         const stl_point2 &c)
+{
+  return ((double) b.x - a.x) * ((double) c.y - a.y)
+         - ((double) b.y - a.y) * ((double) c.x - a.x);
+}
+
+/* Whether c, known to be collinear with a-b, lies on the segment. */
+static inline bool stl_simplify_on_segment(const stl_point2 &a,
+                                           const stl_point2 &b,
+                                           const stl_point2 &c)
+{
+  return STL_MIN(a.x, b.x) <= c.x && c.x <= STL_MAX(a.x, b.x)
+         && STL_MIN(a.y, b.y) <= c.y && c.y <= STL_MAX(a.y, b.y);
+}
+
+static bool stl_simplify_touch(const stl_point2 &p1, const stl_point2 &p2,
+                               const stl_point2 &q1, const stl_point2 &q2)
+{
+  double o1 = stl_simplify_orient(p1, p2, q1);
+  double o2 = stl_simplify_orient(p1, p2, q2);
+  double o3 = stl_simplify_orient(q1, q2, p1);
+  double o4 = stl_simplify_orient(q1, q2, p2);
+
+  if(((o1 > 0.0 && o2 < 0.0) || (o1 < 0.0 && o2 > 0.0))
+     && ((o3 > 0.0 && o4 < 0.0) || (o3 < 0.0 && o4 > 0.0)))
+    {
+      return true;
+    }
+  return (o1 == 0.0 && stl_simplify_on_segment(p1, p2, q1))
+         || (o2 == 0.0 && stl_simplify_on_segment(p1, p2, q2))
+         || (o3 == 0.0 && stl_simplify_on_segment(q1, q2, p1))
+         || (o4 == 0.0 && stl_simplify_on_segment(q1, q2, p2));
+}
+
+/* Neighbouring segments of a contour always share their common point. */
+static bool stl_simplify_adjacent(const stl_layer &layer,
+                                  const stl_simplify_segment &s,
+                                  const stl_simplify_segment &t)
+{
+  int n;
+
+  if(s.contour != t.contour)
+    {
+      return false;
+    }
+  if(s.b == t.a || t.b == s.a)
+    {
+      return true;
+    }
+  n = (int) layer.contours[s.contour].points.size();
+  return layer.contours[s.contour].closed
+         && ((s.a == 0 && t.b == n) || (t.a == 0 && s.b == n));
+}
+
+/* Flags every segment that touches a non-adjacent one, testing only the
+   pairs that share a grid cell. */
+static void stl_simplify_conflicts(const stl_layer &layer,
+                                   const vector<stl_simplify_segment> &segments,
+                                   vector<char> &conflict)
+{
+  vector<vector<int> > cells;
+  float                min_x = 0.0;
+  float                min_y = 0.0;
+  float                max_x = 0.0;
+  float                max_y = 0.0;
+  float                cell_x;
+  float                cell_y;
+  int                  side;
+  size_t               s;
+  size_t               i;
+  size_t               j;
+
+  conflict.assign(segments.size(), 0);
+  for(s = 0; s < segments.size(); s++)
+    {
+      const stl_contour &contour = layer.contours[segments[s].contour];
+      const stl_point2  &a = stl_simplify_point(contour, segments[s].a);
+      const stl_point2  &b = stl_simplify_point(contour, segments[s].b);
+
+      if(s == 0)
+        {
+          min_x = max_x = a.x;
+          min_y = max_y = a.y;
+        }
+      min_x = STL_MIN(min_x, STL_MIN(a.x, b.x));
+      min_y = STL_MIN(min_y, STL_MIN(a.y, b.y));
+      max_x = STL_MAX(max_x, STL_MAX(a.x, b.x));
+      max_y = STL_MAX(max_y, STL_MAX(a.y, b.y));
+    }
+
+  side = (int) sqrt((double) segments.size());
+  side = STL_MAX(1, STL_MIN(side, SIMPLIFY_MAX_CELLS));
+  cell_x = (max_x - min_x) / side;
+  cell_y = (max_y - min_y) / side;
+  cells.resize(side * side);
+  for(s = 0; s < segments.size(); s++)
+    {
+      const stl_contour &contour = layer.contours[segments[s].contour];
+      const stl_point2  &a = stl_simplify_point(contour, segments[s].a);
+      const stl_point2  &b = stl_simplify_point(contour, segments[s].b);
+      int x0 = cell_x > 0.0 ? (int) ((STL_MIN(a.x, b.x) - min_x) / cell_x) : 0;
+      int x1 = cell_x > 0.0 ? (int) ((STL_MAX(a.x, b.x) - min_x) / cell_x) : 0;
+      int y0 = cell_y > 0.0 ? (int) ((STL_MIN(a.y, b.y) - min_y) / cell_y) : 0;
+      int y1 = cell_y > 0.0 ? (int) ((STL_MAX(a.y, b.y) - min_y) / cell_y) : 0;
+      int x;
+      int y;
+
+      /* Points on the far edge of the box land one past the last cell. */
+      x0 = STL_MIN(x0, side - 1);
+      y0 = STL_MIN(y0, side - 1);
+      for(y = y0; y <= STL_MIN(y1, side - 1); y++)
+        {
+          for(x = x0; x <= STL_MIN(x1, side - 1); x++)
+            {
+              cells[y * side + x].push_back((int) s);
+            }
+        }
+    }
+
+  for(i = 0; i < cells.size(); i++)
+    {
+      const vector<int> &cell = cells[i];
+      for(j = 0; j < cell.size(); j++)
+        {
+          const stl_simplify_segment &s1 = segments[cell[j]];
+          const stl_contour          &c1 = layer.contours[s1.contour];
+          size_t                      k;
+
+          for(k = j + 1; k < cell.size(); k++)
+            {
+              const stl_simplify_segment &s2 = segments[cell[k]];
+              const stl_contour          &c2 = layer.contours[s2.contour];
+
+              if((conflict[cell[j]] && conflict[cell[k]])
+                 || stl_simplify_adjacent(layer, s1, s2))
+                {
+                  continue;
+                }
+              if(stl_simplify_touch(stl_simplify_point(c1, s1.a),
+                                    stl_simplify_point(c1, s1.b),
+                                    stl_simplify_point(c2, s2.a),
+                                    stl_simplify_point(c2, s2.b)))
+                {
+                  conflict[cell[j]] = 1;
+                  conflict[cell[k]] = 1;
+                }
+            }
+        }
+    }
+}
+
+void stl_simplify_layer(stl_layer &layer, float tolerance)
+{
+  double                       tolerance2 = (double) tolerance * tolerance;
+  vector<vector<char> >        keep(layer.contours.size());
+  vector<stl_simplify_segment> segments;
+  vector<char>                 conflict;
+  size_t                       c;
+  size_t                       s;
+  int                          i;
+
+  for(c = 0; c < layer.contours.size(); c++)
+    {
+      const stl_contour &contour = layer.contours[c];
+      int                n = (int) contour.points.size();
+      int                last = contour.closed ? n : n - 1;
+      int                kept = 0;
+
+      if(n < 3)
+        {
+          keep[c].assign(n, 1);
+          continue;
+        }
+      keep[c].assign(last + 1, 0);
+      keep[c][0] = 1;
+      keep[c][last] = 1;
+      if(contour.closed)
+        {
+          /* Split the ring at the point furthest from point 0. */
+          double distance2;
+          int    far = stl_simplify_furthest(contour, 0, n, &distance2);
+          keep[c][far] = 1;
+          stl_douglas_peucker(contour, 0, far, tolerance2, keep[c]);
+          stl_douglas_peucker(contour, far, n, tolerance2, keep[c]);
+        }
+      else
+        {
+          stl_douglas_peucker(contour, 0, last, tolerance2, keep[c]);
+        }
+
+      for(i = 0; i < n; i++)
+        {
+          kept += keep[c][i];
+        }
+      if(contour.closed && kept < 3)
+        {
+          keep[c].assign(last + 1, 1);
+        }
+    }
+
+  /* Put points back into the segments that touch something until none
+     does; segments already down to their original points can't change. */
+  for(;;)
+    {
+      int split = 0;
+
+      segments.clear();
+      for(c = 0; c < layer.contours.size(); c++)
+        {
+          stl_simplify_segment segment;
+          segment.contour = (int) c;
+          segment.a = 0;
+          for(i = 1; i < (int) keep[c].size(); i++)
+            {
+              if(keep[c][i])
+                {
+                  segment.b = i;
+                  segments.push_back(segment);
+                  segment.a = i;
+                }
+            }
+        }
+      stl_simplify_conflicts(layer, segments, conflict);
+      for(s = 0; s < segments.size(); s++)
+        {
+          const stl_simplify_segment &segment = segments[s];
+          double                      distance2;
+          int                         furthest;
+
+          if(!conflict[s] || segment.b - segment.a < 2)
+            {
+              continue;
+            }
+          furthest = stl_simplify_furthest(layer.contours[segment.contour],
+                                           segment.a, segment.b, &distance2);
+          keep[segment.contour][furthest] = 1;
+          split++;
+        }
+      if(split == 0)
+        {
+          break;
+        }
+    }
+
+  for(c = 0; c < layer.contours.size(); c++)
+    {
+      vector<stl_point2> &points = layer.contours[c].points;
+      int                 n = (int) points.size();
+      int                 kept = 0;
+
+      for(i = 0; i < n; i++)
+        {
+          if(keep[c][i])
+            {
+              points[kept++] = points[i];
+            }
+        }
+      points.resize(kept);
+    }
+  stl_layer_measure(layer);
+}
+
+void stl_simplify_layers(vector<stl_layer> &layers, float tolerance)
+{
+  stl_parallel_for((int) layers.size(), 1, [&](int begin, int end)
+    {
+      for(int i = begin; i < end; i++)
+        {
+          stl_simplify_layer(layers[i], tolerance);
+        }
+    });
+}
@@ -0,0 +1,25 @@
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+
+#include <vector>
+#include "slice.h"
+
+/* Douglas-Peucker simplification of sliced contours.  No point of a
+ * contour moves further than tolerance from its simplified outline, so a
+ * tolerance of about half the machine's resolution (nozzle width, pixel
+ * size) loses nothing the printer could reproduce.  Only original points
+ * are kept, open chains keep their ends, and closed contours that would
+ * shrink below three points are left alone.
+ *
+ * A simplified segment that crosses or touches another segment of the
+ * layer, in the same contour or another, gets back the original point
+ * furthest from it until no such contact is left; the result has no
+ * intersections the input didn't already have.  Areas and lengths are
+ * measured again afterwards.
+ */
+void stl_simplify_layer(stl_layer &layer, float tolerance);
+
+/* The same for every layer, spread over the global thread pool. */
+void stl_simplify_layers(std::vector<stl_layer> &layers, float tolerance);
+
+#endif // SIMPLIFY_H
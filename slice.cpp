@@ -0,0 +1,541 @@
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include "slice.h"
+#include "parallel.h"
+
+using namespace std;
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/* A crossing point is named by the mesh edge it lies on. */
+typedef unsigned long long stl_edge_key;
+
+typedef struct
+{
+  stl_edge_key start_key;
+  stl_edge_key end_key;
+  stl_point2   start;
+  stl_point2   end;
+}stl_segment;
+
+static void stl_transform_premultiply(stl_transform *xf, const float r[9]);
+static stl_edge_key stl_crossing(const stl_vertex *vertices, int a, int b,
+                                 float z, stl_point2 *point);
+static void stl_chain_segments(vector<stl_segment> &segments,
+                               vector<stl_contour> &contours);
+static void stl_append_point(stl_contour &contour, const stl_point2 &point);
+
+void stl_transform_identity(stl_transform *xf)
+{
+  memset(xf, 0, sizeof(stl_transform));
+  xf->m[0] = 1.0;
+  xf->m[4] = 1.0;
+  xf->m[8] = 1.0;
+}
+
+void stl_transform_translate(stl_transform *xf, float x, float y, float z)
+{
+  xf->t[0] += x;
+  xf->t[1] += y;
+  xf->t[2] += z;
+}
+
+void stl_transform_rotate_x(stl_transform *xf, float angle)
+{
+  double radian = angle * M_PI / 180.0;
+  float  c = cos(radian);
+  float  s = sin(radian);
+  float  r[9] = {1.0, 0.0, 0.0,
+                 0.0,   c,  -s,
+                 0.0,   s,   c};
+
+  stl_transform_premultiply(xf, r);
+}
+
+void stl_transform_rotate_y(stl_transform *xf, float angle)
+{
+  double radian = angle * M_PI / 180.0;
+  float  c = cos(radian);
+  float  s = sin(radian);
+  float  r[9] = {  c, 0.0,   s,
+                 0.0, 1.0, 0.0,
+                  -s, 0.0,   c};
+
+  stl_transform_premultiply(xf, r);
+}
+
+void stl_transform_rotate_z(stl_transform *xf, float angle)
+{
+  double radian = angle * M_PI / 180.0;
+  float  c = cos(radian);
+  float  s = sin(radian);
+  float  r[9] = {  c,  -s, 0.0,
+                   s,   c, 0.0,
+                 0.0, 0.0, 1.0};
+
+  stl_transform_premultiply(xf, r);
+}
+
+/* Applies r after the existing placement. */
+static void stl_transform_premultiply(stl_transform *xf, const float r[9])
+{
+  stl_transform out;
+  int           i;
+  int           j;
+
+  for(i = 0; i < 3; i++)
+    {
+      for(j = 0; j < 3; j++)
+        {
+          out.m[i * 3 + j] = r[i * 3 + 0] * xf->m[0 * 3 + j]
+                           + r[i * 3 + 1] * xf->m[1 * 3 + j]
+                           + r[i * 3 + 2] * xf->m[2 * 3 + j];
+        }
+      out.t[i] = r[i * 3 + 0] * xf->t[0] + r[i * 3 + 1] * xf->t[1]
+               + r[i * 3 + 2] * xf->t[2];
+    }
+  *xf = out;
+}
+
+void stl_transform_apply(const stl_transform *xf, const stl_vertex *in,
+                         stl_vertex *out)
+{
+  float x = in->x;
+  float y = in->y;
+  float z = in->z;
+
+  out->x = xf->m[0] * x + xf->m[1] * y + xf->m[2] * z + xf->t[0];
+  out->y = xf->m[3] * x + xf->m[4] * y + xf->m[5] * z + xf->t[1];
+  out->z = xf->m[6] * x + xf->m[7] * y + xf->m[8] * z + xf->t[2];
+}
+
+int stl_transform_is_identity(const stl_transform *xf)
+{
+  stl_transform identity;
+
+  stl_transform_identity(&identity);
+  return !memcmp(xf->m, identity.m, sizeof(identity.m))
+      && xf->t[0] == 0.0 && xf->t[1] == 0.0 && xf->t[2] == 0.0;
+}
+
+int stl_transform_is_mirror(const stl_transform *xf)
+{
+  const float *m = xf->m;
+  double       det = (double) m[0] * ((double) m[4] * m[8] - (double) m[5] * m[7])
+                   - (double) m[1] * ((double) m[3] * m[8] - (double) m[5] * m[6])
+                   + (double) m[2] * ((double) m[3] * m[7] - (double) m[4] * m[6]);
+
+  return det < 0.0;
+}
+
+int stl_slice_layer_count(const stl_slice_params *params)
+{
+  if(params->layer_height <= 0.0 || params->z_max <= params->z_min)
+    {
+      return 0;
+    }
+  return (int) floor((params->z_max - params->z_min) / params->layer_height
+                     + 0.5);
+}
+
+float stl_slice_layer_z(const stl_slice_params *params, int layer)
+{
+  return params->z_min + (layer + 0.5) * params->layer_height;
+}
+
+size_t stl_layer_bytes(const stl_layer &layer)
+{
+  size_t bytes = sizeof(stl_layer)
+                 + layer.contours.capacity() * sizeof(stl_contour);
+  size_t i;
+
+  for(i = 0; i < layer.contours.size(); i++)
+    {
+      bytes += layer.contours[i].points.capacity() * sizeof(stl_point2);
+    }
+  return bytes;
+}
+
+void stl_contour_measure(stl_contour &contour)
+{
+  size_t n = contour.points.size();
+  size_t i;
+
+  contour.area = 0.0;
+  contour.length = 0.0;
+  for(i = 1; i <= n; i++)
+    {
+      const stl_point2 &a = contour.points[i - 1];
+      const stl_point2 &b = contour.points[i % n];
+      double            dx = (double) b.x - a.x;
+      double            dy = (double) b.y - a.y;
+
+      if(i == n && !contour.closed)
+        {
+          break;
+        }
+      contour.area += (double) a.x * b.y - (double) b.x * a.y;
+      contour.length += sqrt(dx * dx + dy * dy);
+    }
+  contour.area = contour.closed ? contour.area / 2 : 0.0;
+}
+
+void stl_layer_measure(stl_layer &layer)
+{
+  size_t c;
+
+  layer.area = 0.0;
+  layer.perimeter = 0.0;
+  for(c = 0; c < layer.contours.size(); c++)
+    {
+      stl_contour_measure(layer.contours[c]);
+      layer.area += layer.contours[c].area;
+      layer.perimeter += layer.contours[c].length;
+    }
+}
+
+void stl_slice_stats(const stl_slice_params &params,
+                     const vector<stl_layer> &layers,
+                     vector<stl_layer_stats> &stats,
+                     stl_layer_stats *totals)
+{
+  stl_layer_stats total;
+  size_t          i;
+
+  total.z = params.z_max;
+  total.area = 0.0;
+  total.perimeter = 0.0;
+  total.volume = 0.0;
+  stats.resize(layers.size());
+  for(i = 0; i < layers.size(); i++)
+    {
+      total.area += layers[i].area;
+      total.perimeter += layers[i].perimeter;
+      total.volume += layers[i].area * params.layer_height;
+      stats[i].z = layers[i].z;
+      stats[i].area = layers[i].area;
+      stats[i].perimeter = layers[i].perimeter;
+      stats[i].volume = total.volume;
+    }
+  if(totals != NULL)
+    {
+      *totals = total;
+    }
+}
+
+stl_slicer::stl_slicer(const stl &mesh)
+{
+  build(mesh, NULL);
+}
+
+stl_slicer::stl_slicer(const stl &mesh, const stl_transform &placement)
+{
+  build(mesh, stl_transform_is_identity(&placement) ? NULL : &placement);
+}
+
+void stl_slicer::build(const stl &mesh, const stl_transform *placement)
+{
+  vector<float> facet_lo;
+  vector<float> facet_hi;
+  int           i;
+  int           j;
+  int           b;
+
+  vertices = mesh.v_shared;
+  indices = mesh.v_indices;
+  num_facets = mesh.stats.number_of_facets;
+  mirrored = placement != NULL && stl_transform_is_mirror(placement);
+  zlo = 0.0;
+  zhi = 0.0;
+  bucket_height = 1.0;
+  num_buckets = 0;
+
+  if(indices == NULL || vertices == NULL || num_facets == 0)
+    {
+      if(num_facets > 0)
+        {
+          fprintf(stderr, "stl_slicer: mesh has no shared vertices\n");
+        }
+      num_facets = 0;
+      return;
+    }
+
+  if(placement != NULL)
+    {
+      placed.resize(mesh.stats.shared_vertices);
+      for(i = 0; i < mesh.stats.shared_vertices; i++)
+        {
+          stl_transform_apply(placement, &mesh.v_shared[i], &placed[i]);
+        }
+      vertices = &placed[0];
+    }
+
+  facet_lo.resize(num_facets);
+  facet_hi.resize(num_facets);
+  for(i = 0; i < num_facets; i++)
+    {
+      float z0 = vertices[indices[i].vertex[0]].z;
+      float z1 = vertices[indices[i].vertex[1]].z;
+      float z2 = vertices[indices[i].vertex[2]].z;
+      facet_lo[i] = STL_MIN(z0, STL_MIN(z1, z2));
+      facet_hi[i] = STL_MAX(z0, STL_MAX(z1, z2));
+      if(i == 0 || facet_lo[i] < zlo) zlo = facet_lo[i];
+      if(i == 0 || facet_hi[i] > zhi) zhi = facet_hi[i];
+    }
+
+  /* About sqrt(n) buckets keeps both the per-layer scan and the number
+     of buckets a facet is copied into small. */
+  num_buckets = (int) (2.0 * sqrt((double) num_facets));
+  num_buckets = STL_MAX(1, STL_MIN(num_buckets, 65536));
+  bucket_height = (zhi - zlo) / num_buckets;
+  if(bucket_height <= 0.0)
+    {
+      num_buckets = 1;
+      bucket_height = 1.0;
+    }
+
+  bucket_start.assign(num_buckets + 1, 0);
+  for(i = 0; i < num_facets; i++)
+    {
+      int first = STL_MIN((int) ((facet_lo[i] - zlo) / bucket_height),
+                          num_buckets - 1);
+      int last = STL_MIN((int) ((facet_hi[i] - zlo) / bucket_height),
+                         num_buckets - 1);
+      for(b = first; b <= last; b++)
+        {
+          bucket_start[b + 1]++;
+        }
+    }
+  for(b = 0; b < num_buckets; b++)
+    {
+      bucket_start[b + 1] += bucket_start[b];
+    }
+  bucket_facets.resize(bucket_start[num_buckets]);
+  vector<int> fill(bucket_start.begin(), bucket_start.end() - 1);
+  for(i = 0; i < num_facets; i++)
+    {
+      int first = STL_MIN((int) ((facet_lo[i] - zlo) / bucket_height),
+                          num_buckets - 1);
+      int last = STL_MIN((int) ((facet_hi[i] - zlo) / bucket_height),
+                         num_buckets - 1);
+      for(j = first; j <= last; j++)
+        {
+          bucket_facets[fill[j]++] = i;
+        }
+    }
+}
+
+/* Interpolates from the lower numbered vertex so that both facets on an
+ * edge produce the same bits for the same crossing.
+ */
+static stl_edge_key stl_crossing(const stl_vertex *vertices, int a, int b,
+                                 float z, stl_point2 *point)
+{
+  const stl_vertex *p;
+  const stl_vertex *q;
+  float             t;
+
+  if(a > b)
+    {
+      int swap = a;
+      a = b;
+      b = swap;
+    }
+  p = &vertices[a];
+  q = &vertices[b];
+  t = (z - p->z) / (q->z - p->z);
+  point->x = p->x + t * (q->x - p->x);
+  point->y = p->y + t * (q->y - p->y);
+  return ((stl_edge_key) a << 32) | (stl_edge_key) (unsigned) b;
+}
+
+void stl_slicer::slice_layer(float z, stl_layer &layer) const
+{
+  vector<stl_segment> segments;
+  int                 bucket;
+  int                 k;
+  int                 j;
+
+  layer.z = z;
+  layer.contours.clear();
+  layer.area = 0.0;
+  layer.perimeter = 0.0;
+  if(num_facets == 0 || z < zlo || z > zhi)
+    {
+      return;
+    }
+
+  bucket = STL_MIN((int) ((z - zlo) / bucket_height), num_buckets - 1);
+  for(k = bucket_start[bucket]; k < bucket_start[bucket + 1]; k++)
+    {
+      const int  *v = indices[bucket_facets[k]].vertex;
+      int         above[3];
+      int         down = -1;
+      int         up = -1;
+      stl_segment segment;
+
+      /* A vertex on the plane counts as above it, so every facet is cut
+         along exactly zero or two of its edges. */
+      for(j = 0; j < 3; j++)
+        {
+          above[j] = vertices[v[j]].z >= z;
+        }
+      if(above[0] == above[1] && above[1] == above[2])
+        {
+          continue;
+        }
+      for(j = 0; j < 3; j++)
+        {
+          if(above[j] && !above[(j + 1) % 3]) down = j;
+          if(!above[j] && above[(j + 1) % 3]) up = j;
+        }
+
+      /* Walking from the edge that goes down through the plane to the one
+         that comes back up keeps material on the left.  A mirrored
+         placement turns the facets inside out, so it walks the other
+         way. */
+      if(mirrored)
+        {
+          int swap = down;
+          down = up;
+          up = swap;
+        }
+      segment.start_key = stl_crossing(vertices, v[down], v[(down + 1) % 3],
+                                       z, &segment.start);
+      segment.end_key = stl_crossing(vertices, v[up], v[(up + 1) % 3],
+                                     z, &segment.end);
+      segments.push_back(segment);
+    }
+
+  stl_chain_segments(segments, layer.contours);
+  for(k = 0; k < (int) layer.contours.size(); k++)
+    {
+      layer.area += layer.contours[k].area;
+      layer.perimeter += layer.contours[k].length;
+    }
+}
+
+static bool stl_segment_start_less(const stl_segment &a, const stl_segment &b)
+{
+  return a.start_key < b.start_key;
+}
+
+static void stl_chain_segments(vector<stl_segment> &segments,
+                               vector<stl_contour> &contours)
+{
+  vector<int>  next;
+  vector<char> has_prev;
+  vector<char> used;
+  int          n = (int) segments.size();
+  int          i;
+  int          pass;
+
+  sort(segments.begin(), segments.end(), stl_segment_start_less);
+
+  next.assign(n, -1);
+  has_prev.assign(n, 0);
+  used.assign(n, 0);
+  for(i = 0; i < n; i++)
+    {
+      stl_segment probe;
+      probe.start_key = segments[i].end_key;
+      vector<stl_segment>::iterator it =
+        lower_bound(segments.begin(), segments.end(), probe,
+                    stl_segment_start_less);
+      if(it != segments.end() && it->start_key == segments[i].end_key)
+        {
+          next[i] = (int) (it - segments.begin());
+          has_prev[next[i]] = 1;
+        }
+    }
+
+  /* Chains that start at a hole in the mesh first, then the loops. */
+  for(pass = 0; pass < 2; pass++)
+    {
+      for(i = 0; i < n; i++)
+        {
+          stl_contour contour;
+          int         s;
+          int         last;
+
+          if(used[i] || (pass == 0 && has_prev[i]))
+            {
+              continue;
+            }
+          contour.closed = false;
+          contour.area = 0.0;
+          contour.length = 0.0;
+          last = i;
+          for(s = i; s != -1 && !used[s]; s = next[s])
+            {
+              used[s] = 1;
+              stl_append_point(contour, segments[s].start);
+              last = s;
+            }
+          if(s == i)
+            {
+              contour.closed = true;
+            }
+          else
+            {
+              stl_append_point(contour, segments[last].end);
+            }
+          if(contour.closed && contour.points.size() > 1
+             && contour.points.back().x == contour.points.front().x
+             && contour.points.back().y == contour.points.front().y)
+            {
+              contour.points.pop_back();
+            }
+          else if(contour.closed && contour.points.size() > 1)
+            {
+              /* Close the loop; the repeated end point above already
+                 counted its closing edge. */
+              stl_append_point(contour, contour.points.front());
+              contour.points.pop_back();
+            }
+          contour.area = contour.closed ? contour.area / 2 : 0.0;
+          if(contour.points.size() >= 2)
+            {
+              contours.push_back(contour);
+            }
+        }
+    }
+}
+
+/* Also adds the new edge to the running shoelace sum (twice the area)
+   and length. */
+static void stl_append_point(stl_contour &contour, const stl_point2 &point)
+{
+  if(!contour.points.empty())
+    {
+      const stl_point2 &last = contour.points.back();
+      double            dx = (double) point.x - last.x;
+      double            dy = (double) point.y - last.y;
+
+      if(dx == 0.0 && dy == 0.0)
+        {
+          return;
+        }
+      contour.area += (double) last.x * point.y - (double) point.x * last.y;
+      contour.length += sqrt(dx * dx + dy * dy);
+    }
+  contour.points.push_back(point);
+}
+
+void stl_slicer::slice(const stl_slice_params &params,
+                       vector<stl_layer> &layers) const
+{
+  int count = stl_slice_layer_count(&params);
+
+  layers.resize(count);
+  stl_parallel_for(count, 1, [&](int begin, int end)
+    {
+      for(int i = begin; i < end; i++)
+        {
+          slice_layer(stl_slice_layer_z(&params, i), layers[i]);
+        }
+    });
+}
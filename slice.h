@@ -0,0 +1,138 @@
+#ifndef SLICE_H
+#define SLICE_H
+
+#include <vector>
+#include "stl.h"
+
+/* An affine placement: p' = m * p + t, with m stored row major. */
+typedef struct
+{
+  float m[9];
+  float t[3];
+}stl_transform;
+
+void stl_transform_identity(stl_transform *xf);
+void stl_transform_translate(stl_transform *xf, float x, float y, float z);
+void stl_transform_rotate_x(stl_transform *xf, float angle);
+void stl_transform_rotate_y(stl_transform *xf, float angle);
+void stl_transform_rotate_z(stl_transform *xf, float angle);
+void stl_transform_apply(const stl_transform *xf, const stl_vertex *in,
+                         stl_vertex *out);
+int  stl_transform_is_identity(const stl_transform *xf);
+/* Nonzero if the placement mirrors (its linear part has a negative
+   determinant), which turns every facet's winding inside out. */
+int  stl_transform_is_mirror(const stl_transform *xf);
+
+typedef struct
+{
+  float x;
+  float y;
+}stl_point2;
+
+/* Closed contours run counter-clockwise around material when seen from
+ * above, so holes come out clockwise.  Open chains only appear where the
+ * mesh itself has holes.
+ *
+ * area is the shoelace area, positive for outlines and negative for
+ * holes (0 for open chains), and length the length of the outline; the
+ * slicer sums both while it chains the points.
+ */
+struct stl_contour
+{
+  std::vector<stl_point2> points;
+  bool                    closed;
+  double                  area;
+  double                  length;
+};
+
+/* area is the net cross-section, outlines minus holes, and perimeter the
+   length of all contours. */
+struct stl_layer
+{
+  float                    z;
+  std::vector<stl_contour> contours;
+  double                   area;
+  double                   perimeter;
+};
+
+/* Layer i is cut at z_min + (i + 0.5) * layer_height. */
+typedef struct
+{
+  float z_min;
+  float z_max;
+  float layer_height;
+}stl_slice_params;
+
+int   stl_slice_layer_count(const stl_slice_params *params);
+float stl_slice_layer_z(const stl_slice_params *params, int layer);
+
+/* Heap footprint of a layer, for the memory bounds of its consumers. */
+size_t stl_layer_bytes(const stl_layer &layer);
+
+/* Recomputes area and length of a contour, and area and perimeter of a
+   layer, after its points were changed. */
+void stl_contour_measure(stl_contour &contour);
+void stl_layer_measure(stl_layer &layer);
+
+/* Material accounting for a sliced stack.  volume is the material up to
+ * and including the layer, each layer standing for a slab one layer
+ * height thick; the totals hold the sums and the whole volume, which
+ * should agree with stl::calculate_volume() to within the error of
+ * slicing at that height.
+ */
+typedef struct
+{
+  float  z;
+  double area;
+  double perimeter;
+  double volume;
+}stl_layer_stats;
+
+void stl_slice_stats(const stl_slice_params &params,
+                     const std::vector<stl_layer> &layers,
+                     std::vector<stl_layer_stats> &stats,
+                     stl_layer_stats *totals);
+
+/* Cuts one placement of a mesh into planar contours.  The mesh must have
+ * its shared vertices (generate_shared_vertices()); contours are chained
+ * through v_indices, so matching crossings are bit-identical and chaining
+ * never depends on a tolerance.
+ *
+ * The constructor buckets the facets by height once; after that
+ * slice_layer() may be called from any number of threads.  The mesh must
+ * outlive the slicer.
+ */
+class stl_slicer
+{
+public:
+    stl_slicer(const stl &mesh);
+    stl_slicer(const stl &mesh, const stl_transform &placement);
+
+    float z_min() const { return zlo; }
+    float z_max() const { return zhi; }
+
+    void slice_layer(float z, stl_layer &layer) const;
+    void slice(const stl_slice_params &params,
+               std::vector<stl_layer> &layers) const;
+
+private:
+    void build(const stl &mesh, const stl_transform *placement);
+
+    const stl_vertex        *vertices;
+    const v_indices_struct  *indices;
+    int                      num_facets;
+    std::vector<stl_vertex>  placed;
+    bool                     mirrored;
+
+    float                    zlo;
+    float                    zhi;
+    float                    bucket_height;
+    int                      num_buckets;
+    std::vector<int>         bucket_start;
+    std::vector<int>         bucket_facets;
+
+    stl_slicer(const stl_slicer &);
+    stl_slicer &operator=(const stl_slicer &);
+};
+
+#endif // SLICE_H
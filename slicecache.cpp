@@ -0,0 +1,203 @@
+#include <string.h>
+#include "slicecache.h"
+#include "parallel.h"
+
+using namespace std;
+
+/* Facets looked at to tell whether a mesh changed since it was hashed. */
+#define SLICE_CACHE_SAMPLES 64
+
+/* FNV-1a over evenly spread facets; cheap next to hash_facets(), and any
+   transform of the whole mesh moves every one of them. */
+static uint64_t stl_slice_cache_sample(const stl &mesh)
+{
+  uint64_t hash = 14695981039346656037ULL;
+  int      n = mesh.stats.number_of_facets;
+  int      count = STL_MIN(n, SLICE_CACHE_SAMPLES);
+  int      i;
+  size_t   b;
+
+  for(i = 0; i < count; i++)
+    {
+      stl_facet            facet = mesh.get_facet((int) ((int64_t) i * n / count));
+      const unsigned char *bytes = (const unsigned char *) facet.vertex;
+
+      for(b = 0; b < sizeof(facet.vertex); b++)
+        {
+          hash = (hash ^ bytes[b]) * 1099511628211ULL;
+        }
+    }
+  return hash;
+}
+
+bool stl_slice_cache::key_less::operator()(const key &a, const key &b) const
+{
+  int i;
+
+  if(a.mesh != b.mesh)
+    {
+      return a.mesh < b.mesh;
+    }
+  for(i = 0; i < 9; i++)
+    {
+      if(a.m[i] != b.m[i])
+        {
+          return a.m[i] < b.m[i];
+        }
+    }
+  if(a.tz != b.tz)
+    {
+      return a.tz < b.tz;
+    }
+  return a.z < b.z;
+}
+
+stl_slice_cache::stl_slice_cache(size_t byte_budget)
+  : hits(0), misses(0), budget(byte_budget), used(0)
+{
+}
+
+void stl_slice_cache::set_budget(size_t byte_budget)
+{
+  budget = byte_budget;
+  evict();
+}
+
+void stl_slice_cache::clear()
+{
+  lru.clear();
+  index.clear();
+  memos.clear();
+  used = 0;
+}
+
+void stl_slice_cache::forget(const stl &mesh)
+{
+  memos.erase(&mesh);
+}
+
+uint64_t stl_slice_cache::mesh_hash(const stl &mesh)
+{
+  mesh_memo &memo = memos[&mesh];
+  uint64_t   sample = stl_slice_cache_sample(mesh);
+
+  if(memo.facets == mesh.facet_start && memo.indices == mesh.v_indices
+     && memo.vertices == mesh.v_shared
+     && memo.number_of_facets == mesh.stats.number_of_facets
+     && memo.shared_vertices == mesh.stats.shared_vertices
+     && memo.sample == sample && memo.hash != 0)
+    {
+      return memo.hash;
+    }
+  memo.facets = mesh.facet_start;
+  memo.indices = mesh.v_indices;
+  memo.vertices = mesh.v_shared;
+  memo.number_of_facets = mesh.stats.number_of_facets;
+  memo.shared_vertices = mesh.stats.shared_vertices;
+  memo.sample = sample;
+  memo.hash = mesh.hash_facets();
+  return memo.hash;
+}
+
+void stl_slice_cache::insert(const key &id, const stl_layer &layer)
+{
+  size_t bytes = stl_layer_bytes(layer) + sizeof(entry);
+
+  if(bytes > budget)
+    {
+      return;
+    }
+  lru.push_front(entry());
+  lru.front().id = id;
+  lru.front().layer = layer;
+  lru.front().bytes = bytes;
+  index[id] = lru.begin();
+  used += bytes;
+  evict();
+}
+
+void stl_slice_cache::evict()
+{
+  while(used > budget && !lru.empty())
+    {
+      used -= lru.back().bytes;
+      index.erase(lru.back().id);
+      lru.pop_back();
+    }
+}
+
+void stl_slice_cache::slice(const stl &mesh, const stl_transform &placement,
+                            const stl_slice_params &params,
+                            vector<stl_layer> &layers)
+{
+  int            count = stl_slice_layer_count(&params);
+  float          dx = placement.t[0];
+  float          dy = placement.t[1];
+  stl_transform  local = placement;
+  vector<key>    ids(count);
+  vector<int>    missing;
+  key            id;
+  int            i;
+
+  id.mesh = mesh_hash(mesh);
+  memcpy(id.m, placement.m, sizeof(id.m));
+  id.tz = placement.t[2];
+  local.t[0] = 0.0;
+  local.t[1] = 0.0;
+
+  layers.resize(count);
+  for(i = 0; i < count; i++)
+    {
+      entry_map::iterator found;
+
+      id.z = stl_slice_layer_z(&params, i);
+      ids[i] = id;
+      found = index.find(id);
+      if(found == index.end())
+        {
+          missing.push_back(i);
+          continue;
+        }
+      lru.splice(lru.begin(), lru, found->second);
+      layers[i] = found->second->layer;
+      hits++;
+    }
+
+  if(!missing.empty())
+    {
+      stl_slicer slicer(mesh, local);
+
+      stl_parallel_for((int) missing.size(), 1, [&](int begin, int end)
+        {
+          for(int m = begin; m < end; m++)
+            {
+              slicer.slice_layer(ids[missing[m]].z, layers[missing[m]]);
+            }
+        });
+      for(i = 0; i < (int) missing.size(); i++)
+        {
+          insert(ids[missing[i]], layers[missing[i]]);
+        }
+      misses += missing.size();
+    }
+
+  if(dx != 0.0 || dy != 0.0)
+    {
+      stl_parallel_for(count, 16, [&](int begin, int end)
+        {
+          for(int l = begin; l < end; l++)
+            {
+              vector<stl_contour> &contours = layers[l].contours;
+              for(size_t c = 0; c < contours.size(); c++)
+                {
+                  vector<stl_point2> &points = contours[c].points;
+                  for(size_t p = 0; p < points.size(); p++)
+                    {
+                      points[p].x += dx;
+                      points[p].y += dy;
+                    }
+                }
+            }
+        });
+    }
+}
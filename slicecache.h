@@ -0,0 +1,95 @@
+#ifndef SLICECACHE_H
+#define SLICECACHE_H
+
+#include <stdint.h>
+#include <list>
+#include <map>
+#include <vector>
+#include "slice.h"
+
+/* Remembers sliced layers between runs so that small edits reslice in
+ * milliseconds.  A layer is keyed by the mesh contents, the linear part
+ * and z offset of the placement, and the height of the cut; contours are
+ * kept without the XY offset, so moving a part on the plate only shifts
+ * the cached contours, and changing the Z range or layer height only cuts
+ * the layers whose planes moved.
+ *
+ * Entries are evicted least recently used first once the cached layers
+ * exceed the byte budget.  The cache itself is not thread safe; the cuts
+ * it has to make run on the thread pool.
+ *
+ * The mesh hash is worked out once per mesh and kept while the mesh's
+ * buffers, counts and a fixed sample of its facets stay the same, which
+ * catches reloads and whole-mesh transforms.  Edits that move only a few
+ * facets in place (check_facets_nearby(), direct writes) may not show
+ * there; call forget() on the mesh after them.
+ */
+class stl_slice_cache
+{
+public:
+    stl_slice_cache(size_t byte_budget);
+
+    void slice(const stl &mesh, const stl_transform &placement,
+               const stl_slice_params &params, std::vector<stl_layer> &layers);
+
+    void   set_budget(size_t byte_budget);
+    void   clear();
+    void   forget(const stl &mesh);
+    size_t bytes() const { return used; }
+
+    int    hits;
+    int    misses;
+
+private:
+    typedef struct
+    {
+        uint64_t mesh;
+        float    m[9];
+        float    tz;
+        float    z;
+    }key;
+
+    struct key_less
+    {
+        bool operator()(const key &a, const key &b) const;
+    };
+
+    struct entry
+    {
+        key       id;
+        stl_layer layer;
+        size_t    bytes;
+    };
+
+    typedef std::list<entry>                                 entry_list;
+    typedef std::map<key, entry_list::iterator, key_less>    entry_map;
+
+    /* The hash of a mesh seen before, with what it was taken from. */
+    struct mesh_memo
+    {
+        const stl_facet        *facets;
+        const v_indices_struct *indices;
+        const stl_vertex       *vertices;
+        int                     number_of_facets;
+        int                     shared_vertices;
+        uint64_t                sample;
+        uint64_t                hash;
+    };
+
+    typedef std::map<const stl *, mesh_memo>                 memo_map;
+
+    void     insert(const key &id, const stl_layer &layer);
+    void     evict();
+    uint64_t mesh_hash(const stl &mesh);
+
+    size_t      budget;
+    size_t      used;
+    entry_list  lru;
+    entry_map   index;
+    memo_map    memos;
+
+    stl_slice_cache(const stl_slice_cache &);
+    stl_slice_cache &operator=(const stl_slice_cache &);
+};
+
+#endif // SLICECACHE_H
@@ -0,0 +1,64 @@
+#include <stdlib.h>
+#include <utility>
+#include "snapshot.h"
+
+stl_snapshot::stl_snapshot()
+    : data(NULL)
+{
+}
+
+stl_snapshot::stl_snapshot(const stl_snapshot &other)
+    : data(other.data)
+{
+    if(data != NULL)
+        data->refs.ref();
+}
+
+stl_snapshot &stl_snapshot::operator=(const stl_snapshot &other)
+{
+    if(other.data != NULL)
+        other.data->refs.ref();
+    release();
+    data = other.data;
+    return *this;
+}
+
+stl_snapshot::~stl_snapshot()
+{
+    release();
+}
+
+void stl_snapshot::release()
+{
+    if(data != NULL && !data->refs.deref())
+      {
+        data->mesh.close();
+        delete data;
+      }
+    data = NULL;
+}
+
+stl_snapshot stl_snapshot::freeze(stl *mesh)
+{
+    stl_snapshot snapshot;
+
+    snapshot.data = new shared;
+    snapshot.data->refs.store(1);
+
+    /* The file is never part of a finished mesh, and neither the edge
+       list nor the edge hash open_merge() keeps is of use to a mesh that
+       can't change, so they are released here rather than carried. */
+    if(mesh->fp != NULL)
+        fclose(mesh->fp);
+    mesh->fp = NULL;
+    free(mesh->edge_start);
+    mesh->edge_start = NULL;
+    mesh->free_edge_hash();
+    snapshot.data->mesh = std::move(*mesh);
+    return snapshot;
+}
+
+void stl_snapshot::copy_to(stl *mesh) const
+{
+    *mesh = data->mesh.clone();
+}
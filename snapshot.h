@@ -0,0 +1,56 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <QtCore/QAtomicInt>
+#include "stl.h"
+
+/* A frozen mesh shared by reference count.  freeze() takes over the
+ * buffers of a loaded (and repaired) mesh without copying them and
+ * leaves the source empty; from then on nothing can change the data, so
+ * any number of threads may slice, hash, analyse or export it through
+ * mesh() at the same time without locking.  Copies of a snapshot share
+ * the same data, and the buffers are freed with the last copy.
+ *
+ * The count is atomic, so handles can be copied and dropped on any
+ * thread; a single handle object must still not be assigned from two
+ * threads at once.
+ */
+class stl_snapshot
+{
+public:
+    stl_snapshot();
+    stl_snapshot(const stl_snapshot &other);
+    stl_snapshot &operator=(const stl_snapshot &other);
+    ~stl_snapshot();
+
+    static stl_snapshot freeze(stl *mesh);
+
+    bool is_null() const { return data == NULL; }
+
+    /* Everything that takes a const stl & (stl_slicer, stl_bvh, the
+       hashes, ...) works on this directly, and so do the writers and
+       stats_out(): mesh().write_binary(...) needs no copy_to(). */
+    const stl &mesh() const { return data->mesh; }
+
+    const stl_stats        &stats() const     { return data->mesh.stats; }
+    const stl_facet        *facets() const    { return data->mesh.facet_start; }
+    const stl_neighbors    *neighbors() const { return data->mesh.neighbors_start; }
+    const v_indices_struct *indices() const   { return data->mesh.v_indices; }
+    const stl_vertex       *vertices() const  { return data->mesh.v_shared; }
+
+    /* A private, writable deep copy for whoever has to modify the mesh. */
+    void copy_to(stl *mesh) const;
+
+private:
+    struct shared
+    {
+        QAtomicInt refs;
+        stl        mesh;
+    };
+
+    void release();
+
+    shared *data;
+};
+
+#endif // SNAPSHOT_H
@@ -22,6 +22,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <limits.h>
 #include <sstream>
 #include "stl.h"
 
@@ -33,14 +34,79 @@ using namespace std;
 #define SEEK_END 2
 #endif
 
+/* Progress callbacks are invoked once per this many facets. */
+#define STL_PROGRESS_STRIDE 65536
+
+/* ... and once per this many bytes while an ASCII file's lines are
+   counted, which takes about as long as parsing them afterwards. */
+#define STL_PROGRESS_BYTES  (1 << 22)
+#define STL_ASCII_COUNT_SPAN 0.5
+
+/* Maps the 0..1 progress of one stage of load() onto its share of the
+ * whole load.
+ */
+typedef struct
+{
+  stl_progress_fn  progress;
+  void            *user_data;
+  float            base;
+  float            span;
+}stl_load_stage;
+
 static void stl_put_little_int(FILE *fp, int value);
 static void stl_put_little_float(FILE *fp, float value_in);
-static void stl_initialize(stl *stl, char *file);
-static void stl_allocate(stl *stl);
-static void stl_read(stl *stl, int first_facet, int first);
-static void stl_reallocate(stl *stl);
+static stl_status stl_initialize(stl *stl, char *file,
+                                 stl_progress_fn progress, void *user_data);
+static stl_status stl_allocate(stl *stl);
+static stl_status stl_read(stl *stl, int first_facet, int first,
+                           stl_progress_fn progress, void *user_data);
+static stl_status stl_reallocate(stl *stl);
+static void stl_exit_on_error(stl_status status, const char *function,
+                              char *file);
+static int stl_report_progress(stl_progress_fn progress, void *user_data,
+                               int done, int total);
+static int stl_load_stage_progress(float fraction, void *user_data);
 static int stl_get_little_int(FILE *fp);
 static float stl_get_little_float(FILE *fp);
+static stl_status stl_initialize_facet_check_exact(stl *stl);
+static void stl_load_edge_exact(stl *stl, stl_hash_edge *edge,
+                                stl_vertex *a, stl_vertex *b);
+typedef void (*stl_match_function)(stl *stl, stl_hash_edge *edge_a,
+                                   stl_hash_edge *edge_b);
+
+static stl_status insert_hash_edge(stl *stl, stl_hash_edge edge,
+                                   stl_match_function match_neighbors);
+static int stl_get_hash_for_edge(int M, stl_hash_edge *edge);
+static int stl_compare_function(stl_hash_edge *edge_a, stl_hash_edge *edge_b);
+static void stl_match_neighbors_exact(stl *stl,
+                                      stl_hash_edge *edge_a, stl_hash_edge *edge_b);
+static void stl_record_neighbors(stl *stl,
+                                 stl_hash_edge *edge_a, stl_hash_edge *edge_b);
+static void stl_free_edges(stl *stl);
+static void stl_reset(stl *stl);
+static stl_status stl_allocate_edge_hash(stl *stl);
+static int stl_walk_fan(stl *stl, int first_facet, int j, int id);
+static stl_status stl_initialize_facet_check_nearby(stl *stl);
+static int stl_load_edge_nearby(stl *stl, stl_hash_edge *edge,
+                                stl_vertex *a, stl_vertex *b, float tolerance);
+static void stl_match_neighbors_nearby(stl *stl,
+                                       stl_hash_edge *edge_a, stl_hash_edge *edge_b);
+static void stl_which_vertices_to_change(stl *stl, stl_hash_edge *edge_a,
+                                         stl_hash_edge *edge_b, int *facet1,
+                                         int *vertex1, int *facet2,
+                                         int *vertex2,
+                                         stl_vertex *new_vertex1,
+                                         stl_vertex *new_vertex2);
+static void stl_change_vertices(stl *stl, int facet_num, int vnot,
+                                stl_vertex new_vertex);
+static int stl_bridge_degenerate(stl *stl, int facet);
+static void stl_add_facet(stl *stl, const stl_facet *new_facet);
+static double stl_part_volume(stl *stl, const int *facets, int count);
+static void stl_reverse_facet(stl *stl, int facet_num);
+static int stl_check_normal_vector(stl *stl, int facet_num, int normal_fix_flag);
+static void stl_drop_shared(stl *stl);
+static void stl_count_connections(stl *stl);
+static stl_status stl_merge_topology(stl *stl, int first_facet);
 
 void stl::print_edges(FILE *file)
 {
@@ -59,7 +125,7 @@ void stl::print_edges(FILE *file)
 }
 
 
-void stl::stats_out(FILE *file, char *input_file)
+void stl::stats_out(FILE *file, char *input_file) const
 {
   fprintf(file, "\n\
 ================= Results produced by ADMesh version 0.95 ================\n");
@@ -129,7 +195,7 @@ Backwards edges       : %5d\n", stats.backwards_edges);
 Normals fixed         : %5d\n", stats.normals_fixed);
 }
 
-void stl::write_ascii(char *file, char *label)
+void stl::write_ascii(char *file, char *label) const
 {
   int       i;
   FILE      *fp;
@@ -153,19 +219,20 @@ void stl::write_ascii(char *file, char *label)
   
   for(i = 0; i < stats.number_of_facets; i++)
     {
+      stl_facet facet = get_facet(i);
       fprintf(fp, "  facet normal % .8E % .8E % .8E\n",
-              facet_start[i].normal.x, facet_start[i].normal.y,
-              facet_start[i].normal.z);
+              facet.normal.x, facet.normal.y,
+              facet.normal.z);
       fprintf(fp, "    outer loop\n");
       fprintf(fp, "      vertex % .8E % .8E % .8E\n",
-              facet_start[i].vertex[0].x, facet_start[i].vertex[0].y,
-              facet_start[i].vertex[0].z);
+              facet.vertex[0].x, facet.vertex[0].y,
+              facet.vertex[0].z);
       fprintf(fp, "      vertex % .8E % .8E % .8E\n",
-              facet_start[i].vertex[1].x, facet_start[i].vertex[1].y,
-              facet_start[i].vertex[1].z);
+              facet.vertex[1].x, facet.vertex[1].y,
+              facet.vertex[1].z);
       fprintf(fp, "      vertex % .8E % .8E % .8E\n",
-              facet_start[i].vertex[2].x, facet_start[i].vertex[2].y,
-              facet_start[i].vertex[2].z);
+              facet.vertex[2].x, facet.vertex[2].y,
+              facet.vertex[2].z);
       fprintf(fp, "    endloop\n");
       fprintf(fp, "  endfacet\n");
     }
@@ -244,7 +311,7 @@ static void stl_put_little_float(FILE *fp, float value_in)
 }
 
 
-void stl::write_binary(char *file, char *label)
+void stl::write_binary(char *file, char *label) const
 {
   FILE      *fp;
   int       i;
@@ -273,20 +340,21 @@ void stl::write_binary(char *file, char *label)
   
   for(i = 0; i < stats.number_of_facets; i++)
     {
-      stl_put_little_float(fp, facet_start[i].normal.x);
-      stl_put_little_float(fp, facet_start[i].normal.y);
-      stl_put_little_float(fp, facet_start[i].normal.z);
-      stl_put_little_float(fp, facet_start[i].vertex[0].x);
-      stl_put_little_float(fp, facet_start[i].vertex[0].y);
-      stl_put_little_float(fp, facet_start[i].vertex[0].z);
-      stl_put_little_float(fp, facet_start[i].vertex[1].x);
-      stl_put_little_float(fp, facet_start[i].vertex[1].y);
-      stl_put_little_float(fp, facet_start[i].vertex[1].z);
-      stl_put_little_float(fp, facet_start[i].vertex[2].x);
-      stl_put_little_float(fp, facet_start[i].vertex[2].y);
-      stl_put_little_float(fp, facet_start[i].vertex[2].z);
-      fputc(facet_start[i].extra[0], fp);
-      fputc(facet_start[i].extra[1], fp);
+      stl_facet facet = get_facet(i);
+      stl_put_little_float(fp, facet.normal.x);
+      stl_put_little_float(fp, facet.normal.y);
+      stl_put_little_float(fp, facet.normal.z);
+      stl_put_little_float(fp, facet.vertex[0].x);
+      stl_put_little_float(fp, facet.vertex[0].y);
+      stl_put_little_float(fp, facet.vertex[0].z);
+      stl_put_little_float(fp, facet.vertex[1].x);
+      stl_put_little_float(fp, facet.vertex[1].y);
+      stl_put_little_float(fp, facet.vertex[1].z);
+      stl_put_little_float(fp, facet.vertex[2].x);
+      stl_put_little_float(fp, facet.vertex[2].y);
+      stl_put_little_float(fp, facet.vertex[2].z);
+      fputc(facet.extra[0], fp);
+      fputc(facet.extra[1], fp);
     }
   
   fclose(fp);
@@ -466,10 +534,146 @@ void stl::write_dxf(char *file, char *label)
 
 void stl::open(char *file)
 {
-  stl_initialize(this, file);
-  stl_allocate(this);
-  stl_read(this, 0, 1);
+  stl_exit_on_error(open(file, NULL, NULL), "stl_initialize", file);
+}
+
+stl_status stl::open(char *file, stl_progress_fn progress, void *user_data)
+{
+  stl_load_stage stage;
+  stl_status     status;
+
+  close();
+  stl_reset(this);
+  status = stl_initialize(this, file, progress, user_data);
+  if(status != STL_OK)
+    {
+      return status;
+    }
+  /* An ASCII file has already been read once to count its lines. */
+  if(progress != NULL && stats.type == ascii)
+    {
+      stage.progress = progress;
+      stage.user_data = user_data;
+      stage.base = STL_ASCII_COUNT_SPAN;
+      stage.span = 1.0 - STL_ASCII_COUNT_SPAN;
+      progress = stl_load_stage_progress;
+      user_data = &stage;
+    }
+  status = stl_allocate(this);
+  if(status == STL_OK)
+    {
+      status = stl_read(this, 0, 1, progress, user_data);
+    }
   fclose(fp);
+  fp = NULL;
+  if(status != STL_OK)
+    {
+      close();
+    }
+  return status;
+}
+
+/* Parse the file and build the neighbor and shared vertex tables, which is
+ * everything needed before the mesh can be sliced or exported.  Progress
+ * is reported across all three stages.  On failure or cancellation the
+ * mesh is left empty.
+ */
+stl_status stl::load(char *file, stl_progress_fn progress, void *user_data)
+{
+  stl_load_stage stage;
+  stl_status     status;
+
+  stage.progress = progress;
+  stage.user_data = user_data;
+
+  stage.base = 0.0;
+  stage.span = 0.7;
+  status = open(file, progress ? stl_load_stage_progress : NULL, &stage);
+  if(status != STL_OK)
+    {
+      return status;
+    }
+
+  /* Zero-area facets only confuse the edge matching and everything
+     after it. */
+  remove_degenerate_facets(0.0);
+
+  stage.base = 0.7;
+  stage.span = 0.2;
+  status = check_facets_exact(progress ? stl_load_stage_progress : NULL,
+                              &stage);
+  if(status == STL_OK)
+    {
+      stage.base = 0.9;
+      stage.span = 0.1;
+      status = generate_shared_vertices(progress ? stl_load_stage_progress
+                                                 : NULL, &stage);
+    }
+  if(status != STL_OK)
+    {
+      close();
+      return status;
+    }
+
+  if(progress != NULL)
+    {
+      progress(1.0, user_data);
+    }
+  return STL_OK;
+}
+
+static int stl_load_stage_progress(float fraction, void *user_data)
+{
+  stl_load_stage *stage = (stl_load_stage *) user_data;
+
+  return stage->progress(stage->base + fraction * stage->span,
+                         stage->user_data);
+}
+
+static int stl_report_progress(stl_progress_fn progress, void *user_data,
+                               int done, int total)
+{
+  if(progress == NULL)
+    {
+      return 1;
+    }
+  return progress(total > 0 ? (float) done / total : 1.0, user_data);
+}
+
+/* Keeps the old print-and-exit behaviour for the void entry points. */
+static void stl_exit_on_error(stl_status status, const char *function,
+                              char *file)
+{
+  char *error_msg;
+
+  switch(status)
+    {
+    case STL_OK:
+      return;
+    case STL_ERR_OPEN:
+      error_msg =
+        (char *) malloc(81 + strlen(file)); /* Allow 80 chars+file size for message */
+      sprintf(error_msg, "%s: Couldn't open %s for reading", function, file);
+      perror(error_msg);
+      free(error_msg);
+      break;
+    case STL_ERR_SIZE:
+      fprintf(stderr, "The file %s has the wrong size.\n", file);
+      break;
+    case STL_ERR_MEMORY:
+      perror(function);
+      break;
+    case STL_ERR_READ:
+      fprintf(stderr, "%s: Couldn't read facets from %s\n", function, file);
+      break;
+    case STL_ERR_WRITE:
+      fprintf(stderr, "%s: Couldn't write %s\n", function, file);
+      break;
+    case STL_CANCELLED:
+      fprintf(stderr, "%s: Cancelled while reading %s\n", function, file);
+      break;
+    }
+  exit(1);
 }
 
 static int stl_get_little_int(FILE *fp)
@@ -498,56 +702,35 @@ static float stl_get_little_float(FILE *fp)
 }
 
 
-static void stl_initialize(stl* stl, char *file)
+static stl_status stl_initialize(stl* stl, char *file,
+                                 stl_progress_fn progress, void *user_data)
 {
-  ulong           file_size;
+  stl_off_t      file_size;
+  stl_off_t      i;
   int            header_num_facets;
   int            num_facets;
-  uint            i, j;
+  uint           j;
   unsigned char  chtest[128];
   int            num_lines = 1;
-  char           *error_msg;
-
-  stl->stats.degenerate_facets = 0;
-  stl->stats.edges_fixed  = 0;
-  stl->stats.facets_added = 0;
-  stl->stats.facets_removed = 0;
-  stl->stats.facets_reversed = 0;
-  stl->stats.normals_fixed = 0;
-  stl->stats.number_of_parts = 0;
-  stl->stats.original_num_facets = 0;
-  stl->stats.number_of_facets = 0;
-  stl->stats.volume = -1.0;
-
-  stl->neighbors_start = NULL;
-  stl->facet_start = NULL;
-  stl->v_indices = NULL;
-  stl->v_shared = NULL;
 
-
-  /* Open the file */
+  /* Open the file; the facets are added to those already there, which
+     open() has cleared and open_merge() keeps. */
   stl->fp = fopen(file, "r");
   if(stl->fp == NULL)
     {
-      error_msg =
-        (char *) malloc(81 + strlen(file)); /* Allow 80 chars+file size for message */
-      sprintf(error_msg, "stl_initialize: Couldn't open %s for reading",
-              file);
-      perror(error_msg);
-      free(error_msg);
-      exit(1);
+      return STL_ERR_OPEN;
     }
   /* Find size of file */
-  fseek(stl->fp, 0, SEEK_END);
-  file_size = ftell(stl->fp);
+  stl_fseek(stl->fp, 0, SEEK_END);
+  file_size = stl_ftell(stl->fp);
 
   /* Check for binary or ASCII file */
   fseek(stl->fp, HEADER_SIZE, SEEK_SET);
   fread(chtest, sizeof(chtest), 1, stl->fp);
   stl->stats.type = ascii;
-  for(i = 0; i < sizeof(chtest); i++)
+  for(j = 0; j < sizeof(chtest); j++)
     {
-      if(chtest[i] > 127)
+      if(chtest[j] > 127)
         {
           stl->stats.type = binary;
           break;
@@ -559,12 +742,15 @@ static void stl_initialize(stl* stl, char *file)
   /* If the .STL file is binary, then do the following */
   if(stl->stats.type == binary)
     {
-      /* Test if the STL file has the right size  */
+      /* Test if the STL file has the right size, and that its facets
+         can be counted in an int; bigger files need stl_indexed_mesh64 */
       if(((file_size - HEADER_SIZE) % SIZEOF_STL_FACET != 0)
-         || (file_size < STL_MIN_FILE_SIZE))
+         || (file_size < STL_MIN_FILE_SIZE)
+         || ((file_size - HEADER_SIZE) / SIZEOF_STL_FACET > INT_MAX))
         {
-          fprintf(stderr, "The file %s has the wrong size.\n", file);
-          exit(1);
+          fclose(stl->fp);
+          stl->fp = NULL;
+          return STL_ERR_SIZE;
         }
       num_facets = (file_size - HEADER_SIZE) / SIZEOF_STL_FACET;
 
@@ -587,6 +773,13 @@ static void stl_initialize(stl* stl, char *file)
       j = 0;
       for(i = 0; i < file_size ; i++)
         {
+          if(progress != NULL && i % STL_PROGRESS_BYTES == 0
+             && !progress(STL_ASCII_COUNT_SPAN * i / file_size, user_data))
+            {
+              fclose(stl->fp);
+              stl->fp = NULL;
+              return STL_CANCELLED;
+            }
           j++;
           if(getc(stl->fp) == '\n')
             {
@@ -600,57 +793,219 @@ static void stl_initialize(stl* stl, char *file)
       rewind(stl->fp);
 
       /* Get the header */
-      for(i = 0;
-          (i < 80) && (stl->stats.header[i] = getc(stl->fp)) != '\n'; i++);
-      stl->stats.header[i] = '\0'; /* Lose the '\n' */
+      for(j = 0;
+          (j < 80) && (stl->stats.header[j] = getc(stl->fp)) != '\n'; j++);
+      stl->stats.header[j] = '\0'; /* Lose the '\n' */
       stl->stats.header[80] = '\0';
 
       num_facets = num_lines / ASCII_LINES_PER_FACET;
     }
   stl->stats.number_of_facets += num_facets;
   stl->stats.original_num_facets = stl->stats.number_of_facets;
+  return STL_OK;
 }
 
-static void stl_allocate(stl* stl)
+static stl_status stl_allocate(stl* stl)
 {
   /*  Allocate memory for the entire .STL file */
   stl->facet_start = (stl_facet*) calloc(stl->stats.number_of_facets,
                             sizeof(stl_facet));
-  if(stl->facet_start == NULL) perror("stl_initialize");
+  if(stl->facet_start == NULL) return STL_ERR_MEMORY;
   stl->stats.facets_malloced = stl->stats.number_of_facets;
 
   /* Allocate memory for the neighbors list */
   stl->neighbors_start =
     (stl_neighbors*) calloc(stl->stats.number_of_facets, sizeof(stl_neighbors));
-  if(stl->facet_start == NULL) perror("stl_initialize");
+  if(stl->neighbors_start == NULL) return STL_ERR_MEMORY;
+  return STL_OK;
 }
 
+/* Appends the facets of another file.  If the mesh already has its
+ * shared vertices (and so its neighbors), only the new facets' edges and
+ * corners are matched: their edges go into the hash of open edges, which
+ * is built from the old facets on the first merge and then kept, and
+ * their corners take the shared vertex of any old facet around them
+ * through the neighbors just made.  The facet, neighbor and index arrays
+ * grow geometrically, so adding a part costs time in proportion to the
+ * part, not the plate.  Passes that renumber facets or rewrite neighbors
+ * drop the kept hash with free_edge_hash().
+ */
 void stl::open_merge(char *file)
 {
-  int first_facet;
+  int        first_facet;
+  int        incremental;
+  stl_status status;
 
+  incremental = v_indices != NULL;
   first_facet = stats.number_of_facets;
-  stl_initialize(this, file);
-  stl_reallocate(this);
-  stl_read(this, first_facet, 0);
+  status = stl_initialize(this, file, NULL, NULL);
+  if(status == STL_OK)
+    {
+      status = stl_reallocate(this);
+      if(status == STL_OK)
+        {
+          status = stl_read(this, first_facet, first_facet == 0, NULL, NULL);
+        }
+    }
+  if(fp != NULL)
+    {
+      fclose(fp);
+      fp = NULL;
+    }
+  if(status == STL_OK && incremental)
+    {
+      status = stl_merge_topology(this, first_facet);
+    }
+  stl_exit_on_error(status, "stl_open_merge", file);
+}
+
+static stl_status stl_merge_topology(stl *stl, int first_facet)
+{
+  stl_hash_edge     edge;
+  v_indices_struct *indices;
+  stl_vertex       *grown;
+  stl_status        status;
+  int               i;
+  int               j;
+  int               id;
+
+  if(stl->heads == NULL)
+    {
+      /* Only the unmatched edges stay in the hash, so the open edges
+         of the old facets are all it needs. */
+      stl->stats.malloced = 0;
+      stl->stats.freed = 0;
+      stl->stats.collisions = 0;
+      status = stl_allocate_edge_hash(stl);
+      if(status != STL_OK)
+        {
+          return status;
+        }
+      for(i = 0; i < first_facet; i++)
+        {
+          for(j = 0; j < 3; j++)
+            {
+              if(stl->neighbors_start[i].neighbor[j] != -1)
+                {
+                  continue;
+                }
+              edge.facet_number = i;
+              edge.which_edge = j;
+              stl_load_edge_exact(stl, &edge, &stl->facet_start[i].vertex[j],
+                                  &stl->facet_start[i].vertex[(j + 1) % 3]);
+              status = insert_hash_edge(stl, edge, stl_match_neighbors_exact);
+              if(status != STL_OK)
+                {
+                  stl_free_edges(stl);
+                  return status;
+                }
+            }
+        }
+    }
+
+  for(i = first_facet; i < stl->stats.number_of_facets; i++)
+    {
+      stl->neighbors_start[i].neighbor[0] = -1;
+      stl->neighbors_start[i].neighbor[1] = -1;
+      stl->neighbors_start[i].neighbor[2] = -1;
+    }
+  for(i = first_facet; i < stl->stats.number_of_facets; i++)
+    {
+      for(j = 0; j < 3; j++)
+        {
+          edge.facet_number = i;
+          edge.which_edge = j;
+          stl_load_edge_exact(stl, &edge, &stl->facet_start[i].vertex[j],
+                              &stl->facet_start[i].vertex[(j + 1) % 3]);
+          status = insert_hash_edge(stl, edge, stl_match_neighbors_exact);
+          if(status != STL_OK)
+            {
+              stl_free_edges(stl);
+              return status;
+            }
+        }
+    }
+
+  /* Same capacity as the facets; usually a no-op. */
+  indices = (v_indices_struct*) realloc(stl->v_indices,
+              stl->stats.facets_malloced * sizeof(v_indices_struct));
+  if(indices == NULL)
+    {
+      return STL_ERR_MEMORY;
+    }
+  stl->v_indices = indices;
+  for(i = first_facet; i < stl->stats.number_of_facets; i++)
+    {
+      stl->v_indices[i].vertex[0] = -1;
+      stl->v_indices[i].vertex[1] = -1;
+      stl->v_indices[i].vertex[2] = -1;
+    }
+  for(i = first_facet; i < stl->stats.number_of_facets; i++)
+    {
+      for(j = 0; j < 3; j++)
+        {
+          if(stl->v_indices[i].vertex[j] != -1)
+            {
+              continue;
+            }
+          id = stl_walk_fan(stl, i, j, -1);
+          if(id == -1)
+            {
+              if(stl->stats.shared_vertices == stl->stats.shared_malloced)
+                {
+                  stl->stats.shared_malloced +=
+                    STL_MAX(1024, stl->stats.shared_malloced / 2);
+                  grown = (stl_vertex*) realloc(stl->v_shared,
+                            stl->stats.shared_malloced * sizeof(stl_vertex));
+                  if(grown == NULL)
+                    {
+                      return STL_ERR_MEMORY;
+                    }
+                  stl->v_shared = grown;
+                }
+              id = stl->stats.shared_vertices++;
+              stl->v_shared[id] = stl->facet_start[i].vertex[j];
+            }
+          stl_walk_fan(stl, i, j, id);
+        }
+    }
+  return STL_OK;
 }
 
-static void stl_reallocate(stl* stl)
+static stl_status stl_reallocate(stl* stl)
 {
+  stl_facet     *facets;
+  stl_neighbors *neighbors;
+  int            capacity;
+
+  /* Grow by half again at least, so a run of merges copies each facet
+     a bounded number of times. */
+  if(stl->stats.number_of_facets <= stl->stats.facets_malloced
+     && stl->facet_start != NULL)
+    {
+      return STL_OK;
+    }
+  capacity = STL_MAX(stl->stats.number_of_facets,
+                     stl->stats.facets_malloced + stl->stats.facets_malloced / 2);
+
   /*  Reallocate more memory for the .STL file(s) */
-  stl->facet_start = (stl_facet*) realloc(stl->facet_start, stl->stats.number_of_facets *
+  facets = (stl_facet*) realloc(stl->facet_start, capacity *
                              sizeof(stl_facet));
-  if(stl->facet_start == NULL) perror("stl_initialize");
-  stl->stats.facets_malloced = stl->stats.number_of_facets;
+  if(facets == NULL) return STL_ERR_MEMORY;
+  stl->facet_start = facets;
 
   /* Reallocate more memory for the neighbors list */
-  stl->neighbors_start =
-    (stl_neighbors*)realloc(stl->neighbors_start, stl->stats.number_of_facets *
+  neighbors =
+    (stl_neighbors*)realloc(stl->neighbors_start, capacity *
             sizeof(stl_neighbors));
-  if(stl->facet_start == NULL) perror("stl_initialize");
+  if(neighbors == NULL) return STL_ERR_MEMORY;
+  stl->neighbors_start = neighbors;
+  stl->stats.facets_malloced = capacity;
+  return STL_OK;
 }
 
-static void stl_read(stl* stl, int first_facet, int first)
+static stl_status stl_read(stl* stl, int first_facet, int first,
+                           stl_progress_fn progress, void *user_data)
 {
   stl_facet facet;
   int   i;
@@ -673,6 +1028,12 @@ static void stl_read(stl* stl, int first_facet, int first)
 
   for(i = first_facet; i < stl->stats.number_of_facets; i++)
     {
+      if((i - first_facet) % STL_PROGRESS_STRIDE == 0
+         && !stl_report_progress(progress, user_data, i - first_facet,
+                                 stl->stats.number_of_facets - first_facet))
+        {
+          return STL_CANCELLED;
+        }
       if(stl->stats.type == binary)
         /* Read a single facet from a binary .STL file */
         {
@@ -690,12 +1051,27 @@ static void stl_read(stl* stl, int first_facet, int first)
           facet.vertex[2].z = stl_get_little_float(stl->fp);
           facet.extra[0] = fgetc(stl->fp);
           facet.extra[1] = fgetc(stl->fp);
+          if(feof(stl->fp))
+            {
+              return STL_ERR_READ;
+            }
         }
       else
         /* Read a single facet from an ASCII .STL file */
         {
-          fscanf(stl->fp, "%*s %*s %f %f %f\n", &facet.normal.x,
-                 &facet.normal.y, &facet.normal.z);
+          /* The facet count was estimated from the line count, so a
+             short read here is the end of the solid, not an error. */
+          if(fscanf(stl->fp, "%*s %*s %f %f %f\n", &facet.normal.x,
+                    &facet.normal.y, &facet.normal.z) != 3)
+            {
+              if(i == first_facet)
+                {
+                  return STL_ERR_READ;
+                }
+              stl->stats.number_of_facets = i;
+              stl->stats.original_num_facets = i;
+              break;
+            }
           fscanf(stl->fp, "%*s %*s");
           fscanf(stl->fp, "%*s %f %f %f\n", &facet.vertex[0].x,
                  &facet.vertex[0].y,  &facet.vertex[0].z);
@@ -760,11 +1136,120 @@ static void stl_read(stl* stl, int first_facet, int first)
     sqrt(stl->stats.size.x * stl->stats.size.x +
          stl->stats.size.y * stl->stats.size.y +
          stl->stats.size.z * stl->stats.size.z);
+  stl_report_progress(progress, user_data, 1, 1);
+  return STL_OK;
+}
+
+
+static void stl_reset(stl *stl)
+{
+  memset(&stl->stats, 0, sizeof(stl->stats));
+  stl->stats.volume = -1.0;
+  stl->fp = NULL;
+  stl->facet_start = NULL;
+  stl->edge_start = NULL;
+  stl->heads = NULL;
+  stl->tail = NULL;
+  stl->M = 0;
+  stl->neighbors_start = NULL;
+  stl->v_indices = NULL;
+  stl->v_shared = NULL;
+}
+
+/* Moves everything from one mesh into another, leaving the source
+   empty.  to must not own anything. */
+static void stl_take(stl *to, stl *from)
+{
+  to->stats = from->stats;
+  to->fp = from->fp;
+  to->facet_start = from->facet_start;
+  to->edge_start = from->edge_start;
+  to->heads = from->heads;
+  to->tail = from->tail;
+  to->M = from->M;
+  to->neighbors_start = from->neighbors_start;
+  to->v_indices = from->v_indices;
+  to->v_shared = from->v_shared;
+  stl_reset(from);
+}
+
+static void *stl_duplicate(const void *source, size_t size)
+{
+  void *copy;
+
+  if(source == NULL)
+    {
+      return NULL;
+    }
+  copy = malloc(size > 0 ? size : 1);
+  if(copy == NULL)
+    {
+      perror("stl_clone");
+      exit(1);
+    }
+  memcpy(copy, source, size);
+  return copy;
+}
+
+stl::stl()
+{
+  stl_reset(this);
+}
+
+stl::stl(stl &&other)
+{
+  stl_take(this, &other);
+}
+
+stl &stl::operator=(stl &&other)
+{
+  if(this != &other)
+    {
+      close();
+      stl_take(this, &other);
+    }
+  return *this;
+}
+
+stl::~stl()
+{
+  close();
+}
+
+/* Only the facets, neighbors and shared vertices are copied; the copy's
+   first open_merge() builds its own edge hash from the open edges. */
+stl stl::clone() const
+{
+  stl copy;
+  int facets = stats.number_of_facets;
+
+  copy.stats = stats;
+  copy.M = M;
+  copy.facet_start = (stl_facet *)
+    stl_duplicate(facet_start, facets * sizeof(stl_facet));
+  copy.neighbors_start = (stl_neighbors *)
+    stl_duplicate(neighbors_start, facets * sizeof(stl_neighbors));
+  copy.v_indices = (v_indices_struct *)
+    stl_duplicate(v_indices, facets * sizeof(v_indices_struct));
+  copy.v_shared = (stl_vertex *)
+    stl_duplicate(v_shared, stats.shared_vertices * sizeof(stl_vertex));
+  copy.stats.facets_malloced = facets;
+  copy.stats.shared_malloced = stats.shared_vertices;
+  return copy;
 }
 
+void stl::free_edge_hash()
+{
+  if(heads != NULL)
+    {
+      stl_free_edges(this);
+    }
+}
 
 void stl::close()
 {
+    if(heads != NULL)
+        stl_free_edges(this);
     if(neighbors_start != NULL)
         free(neighbors_start);
     if(facet_start != NULL)
@@ -773,84 +1258,941 @@ void stl::close()
         free(v_indices);
     if(v_shared != NULL)
         free(v_shared);
+    neighbors_start = NULL;
+    facet_start = NULL;
+    v_indices = NULL;
+    v_shared = NULL;
 }
 
-void stl::generate_shared_vertices()
+void stl::check_facets_exact()
 {
-  int i;
-  int j;
-  int first_facet;
-  int direction;
-  int facet_num;
-  int vnot;
-  int next_edge;
-  int pivot_vertex;
-  int next_facet;
-  int reversed;
-
-  v_indices =
-    (v_indices_struct*) calloc(stats.number_of_facets, sizeof(v_indices_struct));
-  if(v_indices == NULL) perror("stl_generate_shared_vertices");
-  v_shared =
-    (stl_vertex*) calloc((stats.number_of_facets / 2), sizeof(stl_vertex));
-  if(v_shared == NULL) perror("stl_generate_shared_vertices");
-  stats.shared_malloced = stats.number_of_facets / 2;
-  stats.shared_vertices = 0;
+  stl_exit_on_error(check_facets_exact(NULL, NULL), "stl_check_facets_exact",
+                    NULL);
+}
 
-  for(i = 0; i < stats.number_of_facets; i++)
+stl_status stl::check_facets_exact(stl_progress_fn progress, void *user_data)
+{
+  /* This function builds the neighbors list.  No modifications are made
+   *  to any of the facets.  The edges are said to match only if all six
+   *  floats of the first edge matches all six floats of the second edge.
+   */
+  stl_hash_edge  edge;
+  stl_facet      facet;
+  stl_status     status;
+  int            i;
+  int            j;
+
+  /* Matching rewrites facets in place, so an indexed import is
+     expanded first. */
+  status = expand_facets();
+  if(status != STL_OK)
     {
-      v_indices[i].vertex[0] = -1;
-      v_indices[i].vertex[1] = -1;
-      v_indices[i].vertex[2] = -1;
+      return status;
     }
+  stats.connected_edges = 0;
+  stats.connected_facets_1_edge = 0;
+  stats.connected_facets_2_edge = 0;
+  stats.connected_facets_3_edge = 0;
 
+  if(heads != NULL)
+    {
+      stl_free_edges(this);
+    }
+  status = stl_initialize_facet_check_exact(this);
+  if(status != STL_OK)
+    {
+      return status;
+    }
 
   for(i = 0; i < stats.number_of_facets; i++)
     {
-      first_facet = i;
+      if(i % STL_PROGRESS_STRIDE == 0
+         && !stl_report_progress(progress, user_data, i,
+                                 stats.number_of_facets))
+        {
+          stl_free_edges(this);
+          return STL_CANCELLED;
+        }
+      facet = facet_start[i];
       for(j = 0; j < 3; j++)
         {
-          if(v_indices[i].vertex[j] != -1)
-            {
-              continue;
-            }
-          if(stats.shared_vertices == stats.shared_malloced)
+          edge.facet_number = i;
+          edge.which_edge = j;
+          stl_load_edge_exact(this, &edge, &facet.vertex[j],
+                              &facet.vertex[(j + 1) % 3]);
+
+          status = insert_hash_edge(this, edge, stl_match_neighbors_exact);
+          if(status != STL_OK)
             {
-              stats.shared_malloced += 1024;
-              v_shared = (stl_vertex*) realloc(v_shared,
-                           stats.shared_malloced * sizeof(stl_vertex));
-              if(v_shared == NULL) perror("stl_generate_shared_vertices");
+              stl_free_edges(this);
+              return status;
             }
+        }
+    }
+  stl_free_edges(this);
+  stl_report_progress(progress, user_data, 1, 1);
+  return STL_OK;
+}
 
-          v_shared[stats.shared_vertices] =
-            facet_start[i].vertex[j];
+static void stl_load_edge_exact(stl *stl, stl_hash_edge *edge,
+                                stl_vertex *a, stl_vertex *b)
+{
+  float diff_x;
+  float diff_y;
+  float diff_z;
+  float max_diff;
 
-          direction = 0;
-          reversed = 0;
-          facet_num = i;
-          vnot = (j + 2) % 3;
+  diff_x = ABS(a->x - b->x);
+  diff_y = ABS(a->y - b->y);
+  diff_z = ABS(a->z - b->z);
+  max_diff = STL_MAX(diff_x, diff_y);
+  max_diff = STL_MAX(diff_z, max_diff);
+  stl->stats.shortest_edge = STL_MIN(max_diff, stl->stats.shortest_edge);
 
-          for(;;)
-            {
-              if(vnot > 2)
-                {
-                  if(direction == 0)
-                    {
-                      pivot_vertex = (vnot + 2) % 3;
-                      next_edge = pivot_vertex;
-                      direction = 1;
-                    }
-                  else
-                    {
-                      pivot_vertex = (vnot + 1) % 3;
-                      next_edge = vnot % 3;
-                      direction = 0;
-                    }
-                }
-              else
-                {
-                  if(direction == 0)
-                    {
+  if(diff_x == max_diff)
+    {
+      if(a->x > b->x)
+        {
+          memcpy(&edge->key[0], a, sizeof(stl_vertex));
+          memcpy(&edge->key[3], b, sizeof(stl_vertex));
+        }
+      else
+        {
+          memcpy(&edge->key[0], b, sizeof(stl_vertex));
+          memcpy(&edge->key[3], a, sizeof(stl_vertex));
+          edge->which_edge += 3; /* this edge is loaded backwards */
+        }
+    }
+  else if(diff_y == max_diff)
+    {
+      if(a->y > b->y)
+        {
+          memcpy(&edge->key[0], a, sizeof(stl_vertex));
+          memcpy(&edge->key[3], b, sizeof(stl_vertex));
+        }
+      else
+        {
+          memcpy(&edge->key[0], b, sizeof(stl_vertex));
+          memcpy(&edge->key[3], a, sizeof(stl_vertex));
+          edge->which_edge += 3; /* this edge is loaded backwards */
+        }
+    }
+  else
+    {
+      if(a->z > b->z)
+        {
+          memcpy(&edge->key[0], a, sizeof(stl_vertex));
+          memcpy(&edge->key[3], b, sizeof(stl_vertex));
+        }
+      else
+        {
+          memcpy(&edge->key[0], b, sizeof(stl_vertex));
+          memcpy(&edge->key[3], a, sizeof(stl_vertex));
+          edge->which_edge += 3; /* this edge is loaded backwards */
+        }
+    }
+}
+
+static stl_status stl_initialize_facet_check_exact(stl *stl)
+{
+  int i;
+
+  stl->stats.malloced = 0;
+  stl->stats.freed = 0;
+  stl->stats.collisions = 0;
+
+  for(i = 0; i < stl->stats.number_of_facets ; i++)
+    {
+      /* initialize neighbors list to -1 to mark unconnected edges */
+      stl->neighbors_start[i].neighbor[0] = -1;
+      stl->neighbors_start[i].neighbor[1] = -1;
+      stl->neighbors_start[i].neighbor[2] = -1;
+    }
+  return stl_allocate_edge_hash(stl);
+}
+
+/* Leaves heads and tail NULL if either can't be had. */
+static stl_status stl_allocate_edge_hash(stl *stl)
+{
+  int i;
+
+  stl->M = 81397;
+
+  stl->heads = (stl_hash_edge**) calloc(stl->M, sizeof(*stl->heads));
+  stl->tail = (stl_hash_edge*) malloc(sizeof(stl_hash_edge));
+  if(stl->heads == NULL || stl->tail == NULL)
+    {
+      free(stl->heads);
+      free(stl->tail);
+      stl->heads = NULL;
+      stl->tail = NULL;
+      return STL_ERR_MEMORY;
+    }
+
+  stl->tail->next = stl->tail;
+
+  for(i = 0; i < stl->M; i++)
+    {
+      stl->heads[i] = stl->tail;
+    }
+  return STL_OK;
+}
+
+/* The edge is left out of the hash if no room can be had for it. */
+static stl_status insert_hash_edge(stl *stl, stl_hash_edge edge,
+                                   stl_match_function match_neighbors)
+{
+  stl_hash_edge *link;
+  stl_hash_edge *new_edge;
+  stl_hash_edge *temp;
+  int            chain_number;
+
+  chain_number = stl_get_hash_for_edge(stl->M, &edge);
+
+  link = stl->heads[chain_number];
+
+  if(link == stl->tail)
+    {
+      /* This list doesn't have any edges currently in it.  Add this one. */
+      new_edge = (stl_hash_edge*) malloc(sizeof(stl_hash_edge));
+      if(new_edge == NULL) return STL_ERR_MEMORY;
+      stl->stats.malloced++;
+      *new_edge = edge;
+      new_edge->next = stl->tail;
+      stl->heads[chain_number] = new_edge;
+      return STL_OK;
+    }
+  else if(!stl_compare_function(&edge, link))
+    {
+      /* This is a match.  Record result in neighbors list. */
+      match_neighbors(stl, &edge, link);
+      /* Delete the matched edge from the list. */
+      stl->heads[chain_number] = link->next;
+      free(link);
+      stl->stats.freed++;
+      return STL_OK;
+    }
+  else
+    {
+      /* Continue through the rest of the list */
+      for(;;)
+        {
+          if(link->next == stl->tail)
+            {
+              /* This is the last item in the list. Insert a new edge. */
+              new_edge = (stl_hash_edge*) malloc(sizeof(stl_hash_edge));
+              if(new_edge == NULL) return STL_ERR_MEMORY;
+              stl->stats.malloced++;
+              *new_edge = edge;
+              new_edge->next = stl->tail;
+              link->next = new_edge;
+              stl->stats.collisions++;
+              return STL_OK;
+            }
+          else if(!stl_compare_function(&edge, link->next))
+            {
+              /* This is a match.  Record result in neighbors list. */
+              match_neighbors(stl, &edge, link->next);
+
+              /* Delete the matched edge from the list. */
+              temp = link->next;
+              link->next = link->next->next;
+              free(temp);
+              stl->stats.freed++;
+              return STL_OK;
+            }
+          else
+            {
+              /* This is not a match.  Go to the next link */
+              link = link->next;
+              stl->stats.collisions++;
+            }
+        }
+    }
+}
+
+static int stl_get_hash_for_edge(int M, stl_hash_edge *edge)
+{
+  return ((edge->key[0] / 23 + edge->key[1] / 19 + edge->key[2] / 17
+           + edge->key[3] /13  + edge->key[4] / 11 + edge->key[5] / 7 ) % M);
+}
+
+static int stl_compare_function(stl_hash_edge *edge_a, stl_hash_edge *edge_b)
+{
+  if(edge_a->facet_number == edge_b->facet_number)
+    {
+      return 1;			/* Don't match edges of the same facet */
+    }
+  else
+    {
+      return memcmp(edge_a->key, edge_b->key, SIZEOF_EDGE_SORT);
+    }
+}
+
+static void stl_match_neighbors_exact(stl *stl,
+                                      stl_hash_edge *edge_a, stl_hash_edge *edge_b)
+{
+  stl_record_neighbors(stl, edge_a, edge_b);
+}
+
+static void stl_record_neighbors(stl *stl,
+                                 stl_hash_edge *edge_a, stl_hash_edge *edge_b)
+{
+  int i;
+  int j;
+
+  /* Facet a's neighbor is facet b */
+  stl->neighbors_start[edge_a->facet_number].neighbor[edge_a->which_edge % 3] =
+    edge_b->facet_number;	/* sets the .neighbor part */
+
+  stl->neighbors_start[edge_a->facet_number].
+    which_vertex_not[edge_a->which_edge % 3] =
+      (edge_b->which_edge + 2) % 3; /* sets the .which_vertex_not part */
+
+  /* Facet b's neighbor is facet a */
+  stl->neighbors_start[edge_b->facet_number].neighbor[edge_b->which_edge % 3] =
+    edge_a->facet_number;	/* sets the .neighbor part */
+
+  stl->neighbors_start[edge_b->facet_number].
+    which_vertex_not[edge_b->which_edge % 3] =
+      (edge_a->which_edge + 2) % 3; /* sets the .which_vertex_not part */
+
+  if(   ((edge_a->which_edge < 3) && (edge_b->which_edge < 3))
+     || ((edge_a->which_edge > 2) && (edge_b->which_edge > 2)))
+    {
+      /* these facets are oriented in opposite directions.  */
+      /*  their normals are probably messed up. */
+      stl->neighbors_start[edge_a->facet_number].
+        which_vertex_not[edge_a->which_edge % 3] += 3;
+      stl->neighbors_start[edge_b->facet_number].
+        which_vertex_not[edge_b->which_edge % 3] += 3;
+    }
+
+  /* Count successful connects */
+  /* Total connects */
+  stl->stats.connected_edges += 2;
+  /* Count individual connects */
+  i = ((stl->neighbors_start[edge_a->facet_number].neighbor[0] == -1) +
+       (stl->neighbors_start[edge_a->facet_number].neighbor[1] == -1) +
+       (stl->neighbors_start[edge_a->facet_number].neighbor[2] == -1));
+  j = ((stl->neighbors_start[edge_b->facet_number].neighbor[0] == -1) +
+       (stl->neighbors_start[edge_b->facet_number].neighbor[1] == -1) +
+       (stl->neighbors_start[edge_b->facet_number].neighbor[2] == -1));
+  if(i == 2)
+    {
+      stl->stats.connected_facets_1_edge +=1;
+    }
+  else if(i == 1)
+    {
+      stl->stats.connected_facets_2_edge +=1;
+    }
+  else
+    {
+      stl->stats.connected_facets_3_edge +=1;
+    }
+  if(j == 2)
+    {
+      stl->stats.connected_facets_1_edge +=1;
+    }
+  else if(j == 1)
+    {
+      stl->stats.connected_facets_2_edge +=1;
+    }
+  else
+    {
+      stl->stats.connected_facets_3_edge +=1;
+    }
+}
+
+static void stl_free_edges(stl *stl)
+{
+  int i;
+  stl_hash_edge *temp;
+
+  if(stl->stats.malloced != stl->stats.freed)
+    {
+      for(i = 0; i < stl->M; i++)
+        {
+          for(temp = stl->heads[i]; stl->heads[i] != stl->tail;
+              temp = stl->heads[i])
+            {
+              stl->heads[i] = stl->heads[i]->next;
+              free(temp);
+              stl->stats.freed++;
+            }
+        }
+    }
+  free(stl->heads);
+  free(stl->tail);
+  stl->heads = NULL;
+  stl->tail = NULL;
+}
+
+void stl::check_facets_nearby(float tolerance)
+{
+  /* Like check_facets_exact(), but only for the edges still open and
+   * with the corners rounded down to a grid of the given spacing.  Edges
+   * that match there become neighbors, and the corners of one side are
+   * moved onto the other's, along with every facet around them, so the
+   * two really are equal afterwards.
+   */
+  stl_hash_edge  edge;
+  stl_facet      facet;
+  int            edges_fixed = stats.edges_fixed;
+  int            i;
+  int            j;
+
+  if(facet_start == NULL || tolerance <= 0.0
+     || stats.connected_facets_3_edge == stats.number_of_facets)
+    {
+      /* No need to check any further.  All facets are connected */
+      return;
+    }
+
+  free_edge_hash();
+  stl_exit_on_error(stl_initialize_facet_check_nearby(this),
+                    "stl_check_facets_nearby", NULL);
+
+  for(i = 0; i < stats.number_of_facets; i++)
+    {
+      facet = facet_start[i];
+      for(j = 0; j < 3; j++)
+        {
+          if(neighbors_start[i].neighbor[j] != -1)
+            {
+              continue;
+            }
+          edge.facet_number = i;
+          edge.which_edge = j;
+          if(stl_load_edge_nearby(this, &edge, &facet.vertex[j],
+                                  &facet.vertex[(j + 1) % 3], tolerance))
+            {
+              /* only insert edges that have different keys */
+              stl_exit_on_error(insert_hash_edge(this, edge,
+                                                 stl_match_neighbors_nearby),
+                                "stl_check_facets_nearby", NULL);
+            }
+        }
+    }
+
+  stl_free_edges(this);
+  if(stats.edges_fixed != edges_fixed)
+    {
+      stl_drop_shared(this);
+    }
+}
+
+static stl_status stl_initialize_facet_check_nearby(stl *stl)
+{
+  stl->stats.malloced = 0;
+  stl->stats.freed = 0;
+  stl->stats.collisions = 0;
+
+  return stl_allocate_edge_hash(stl);
+}
+
+/* Keys an edge by the grid cells of its ends; 0 if both ends fall in
+   the same cell, since such an edge can't be matched. */
+static int stl_load_edge_nearby(stl *stl, stl_hash_edge *edge,
+                                stl_vertex *a, stl_vertex *b, float tolerance)
+{
+  unsigned vertex1[3];
+  unsigned vertex2[3];
+
+  vertex1[0] = (unsigned)((a->x - stl->stats.min.x) / tolerance);
+  vertex1[1] = (unsigned)((a->y - stl->stats.min.y) / tolerance);
+  vertex1[2] = (unsigned)((a->z - stl->stats.min.z) / tolerance);
+  vertex2[0] = (unsigned)((b->x - stl->stats.min.x) / tolerance);
+  vertex2[1] = (unsigned)((b->y - stl->stats.min.y) / tolerance);
+  vertex2[2] = (unsigned)((b->z - stl->stats.min.z) / tolerance);
+
+  if(   (vertex1[0] == vertex2[0])
+     && (vertex1[1] == vertex2[1])
+     && (vertex1[2] == vertex2[2]))
+    {
+      /* Both vertices hash to the same value */
+      return 0;
+    }
+
+  if((vertex1[0] > vertex2[0]) ||
+     ((vertex1[0] == vertex2[0]) && (vertex1[1] > vertex2[1])) ||
+     ((vertex1[0] == vertex2[0]) && (vertex1[1] == vertex2[1]) &&
+      (vertex1[2] > vertex2[2])))
+    {
+      memcpy(&edge->key[0], vertex2, sizeof(vertex2));
+      memcpy(&edge->key[3], vertex1, sizeof(vertex1));
+      edge->which_edge += 3; /* this edge is loaded backwards */
+    }
+  else
+    {
+      memcpy(&edge->key[0], vertex1, sizeof(vertex1));
+      memcpy(&edge->key[3], vertex2, sizeof(vertex2));
+    }
+  return 1;
+}
+
+static void stl_match_neighbors_nearby(stl *stl,
+                                       stl_hash_edge *edge_a, stl_hash_edge *edge_b)
+{
+  int        facet1;
+  int        facet2;
+  int        vertex1;
+  int        vertex2;
+  int        vnot1;
+  int        vnot2;
+  stl_vertex new_vertex1;
+  stl_vertex new_vertex2;
+
+  stl_record_neighbors(stl, edge_a, edge_b);
+  stl_which_vertices_to_change(stl, edge_a, edge_b, &facet1, &vertex1,
+                               &facet2, &vertex2, &new_vertex1, &new_vertex2);
+  if(facet1 != -1)
+    {
+      if(facet1 == edge_a->facet_number)
+        {
+          vnot1 = (edge_a->which_edge + 2) % 3;
+        }
+      else
+        {
+          vnot1 = (edge_b->which_edge + 2) % 3;
+        }
+      if(((vnot1 + 2) % 3) == vertex1)
+        {
+          vnot1 += 3;
+        }
+      stl_change_vertices(stl, facet1, vnot1, new_vertex1);
+    }
+  if(facet2 != -1)
+    {
+      if(facet2 == edge_a->facet_number)
+        {
+          vnot2 = (edge_a->which_edge + 2) % 3;
+        }
+      else
+        {
+          vnot2 = (edge_b->which_edge + 2) % 3;
+        }
+      if(((vnot2 + 2) % 3) == vertex2)
+        {
+          vnot2 += 3;
+        }
+      stl_change_vertices(stl, facet2, vnot2, new_vertex2);
+    }
+  stl->stats.edges_fixed += 2;
+}
+
+/* Of each pair of matched corners that differ, picks the one to move: the
+   corner of facet a if neither of its edges there is connected yet, else
+   the corner of facet b.  facet1 or facet2 is -1 if the pair is equal. */
+static void stl_which_vertices_to_change(stl *stl, stl_hash_edge *edge_a,
+                                         stl_hash_edge *edge_b, int *facet1,
+                                         int *vertex1, int *facet2,
+                                         int *vertex2,
+                                         stl_vertex *new_vertex1,
+                                         stl_vertex *new_vertex2)
+{
+  int v1a;                      /* pair 1, facet a */
+  int v1b;                      /* pair 1, facet b */
+  int v2a;                      /* pair 2, facet a */
+  int v2b;                      /* pair 2, facet b */
+
+  /* Find first pair */
+  if(edge_a->which_edge < 3)
+    {
+      v1a = edge_a->which_edge;
+      v2a = (edge_a->which_edge + 1) % 3;
+    }
+  else
+    {
+      v2a = edge_a->which_edge % 3;
+      v1a = (edge_a->which_edge + 1) % 3;
+    }
+  if(edge_b->which_edge < 3)
+    {
+      v1b = edge_b->which_edge;
+      v2b = (edge_b->which_edge + 1) % 3;
+    }
+  else
+    {
+      v2b = edge_b->which_edge % 3;
+      v1b = (edge_b->which_edge + 1) % 3;
+    }
+
+  /* Of the first pair, which vertex, if any, should be changed */
+  if(!memcmp(&stl->facet_start[edge_a->facet_number].vertex[v1a],
+             &stl->facet_start[edge_b->facet_number].vertex[v1b],
+             sizeof(stl_vertex)))
+    {
+      /* These facets are already equal.  No need to change. */
+      *facet1 = -1;
+    }
+  else
+    {
+      if(   (stl->neighbors_start[edge_a->facet_number].neighbor[v1a] == -1)
+         && (stl->neighbors_start[edge_a->facet_number].
+             neighbor[(v1a + 2) % 3] == -1))
+        {
+          /* This vertex has no neighbors.  This is a good one to change */
+          *facet1 = edge_a->facet_number;
+          *vertex1 = v1a;
+          *new_vertex1 = stl->facet_start[edge_b->facet_number].vertex[v1b];
+        }
+      else
+        {
+          *facet1 = edge_b->facet_number;
+          *vertex1 = v1b;
+          *new_vertex1 = stl->facet_start[edge_a->facet_number].vertex[v1a];
+        }
+    }
+
+  /* Of the second pair, which vertex, if any, should be changed */
+  if(!memcmp(&stl->facet_start[edge_a->facet_number].vertex[v2a],
+             &stl->facet_start[edge_b->facet_number].vertex[v2b],
+             sizeof(stl_vertex)))
+    {
+      /* These facets are already equal.  No need to change. */
+      *facet2 = -1;
+    }
+  else
+    {
+      if(   (stl->neighbors_start[edge_a->facet_number].neighbor[v2a] == -1)
+         && (stl->neighbors_start[edge_a->facet_number].
+             neighbor[(v2a + 2) % 3] == -1))
+        {
+          /* This vertex has no neighbors.  This is a good one to change */
+          *facet2 = edge_a->facet_number;
+          *vertex2 = v2a;
+          *new_vertex2 = stl->facet_start[edge_b->facet_number].vertex[v2b];
+        }
+      else
+        {
+          *facet2 = edge_b->facet_number;
+          *vertex2 = v2b;
+          *new_vertex2 = stl->facet_start[edge_a->facet_number].vertex[v2a];
+        }
+    }
+}
+
+/* Moves one corner of facet_num, and the same corner of every facet in
+   its fan, to new_vertex.  The walk gives up after visiting every facet
+   once, which only happens on a broken neighbor list. */
+static void stl_change_vertices(stl *stl, int facet_num, int vnot,
+                                stl_vertex new_vertex)
+{
+  int first_facet;
+  int direction;
+  int next_edge;
+  int pivot_vertex;
+  int steps;
+
+  first_facet = facet_num;
+  direction = 0;
+
+  for(steps = 0; steps < stl->stats.number_of_facets; steps++)
+    {
+      if(vnot > 2)
+        {
+          if(direction == 0)
+            {
+              pivot_vertex = (vnot + 2) % 3;
+              next_edge = pivot_vertex;
+              direction = 1;
+            }
+          else
+            {
+              pivot_vertex = (vnot + 1) % 3;
+              next_edge = vnot % 3;
+              direction = 0;
+            }
+        }
+      else
+        {
+          if(direction == 0)
+            {
+              pivot_vertex = (vnot + 1) % 3;
+              next_edge = vnot;
+            }
+          else
+            {
+              pivot_vertex = (vnot + 2) % 3;
+              next_edge = pivot_vertex;
+            }
+        }
+      stl->facet_start[facet_num].vertex[pivot_vertex] = new_vertex;
+      vnot = stl->neighbors_start[facet_num].which_vertex_not[next_edge];
+      facet_num = stl->neighbors_start[facet_num].neighbor[next_edge];
+
+      if(facet_num == -1 || facet_num == first_facet)
+        {
+          /* The end of an open fan, or back to the beginning of a closed
+             one, which only a Mobius part gives. */
+          break;
+        }
+    }
+}
+
+void stl::remove_unconnected_facets()
+{
+  /* Two kinds of facet go: those check_facets_nearby() collapsed by
+   * moving one corner onto another, and those with no neighbor at all,
+   * which are useless and could be completely wrong.  The two neighbors
+   * across a collapsed facet's remaining edges become each other's, so
+   * no hole opens where it was.  The rest keep their order.
+   */
+  int  *renumber;
+  int   kept = 0;
+  int   degenerate = 0;
+  int   i;
+  int   j;
+
+  if(facet_start == NULL || neighbors_start == NULL)
+    {
+      return;
+    }
+  free_edge_hash();
+  renumber = (int *) malloc(STL_MAX(stats.number_of_facets, 1) * sizeof(int));
+  if(renumber == NULL)
+    {
+      perror("stl_remove_unconnected_facets");
+      exit(1);
+    }
+
+  for(i = 0; i < stats.number_of_facets; i++)
+    {
+      renumber[i] = 0;
+      if(stl_bridge_degenerate(this, i))
+        {
+          renumber[i] = -1;
+          degenerate++;
+        }
+    }
+  for(i = 0; i < stats.number_of_facets; i++)
+    {
+      if(renumber[i] == 0
+         && neighbors_start[i].neighbor[0] == -1
+         && neighbors_start[i].neighbor[1] == -1
+         && neighbors_start[i].neighbor[2] == -1)
+        {
+          renumber[i] = -1;
+        }
+    }
+
+  for(i = 0; i < stats.number_of_facets; i++)
+    {
+      if(renumber[i] == -1)
+        {
+          continue;
+        }
+      renumber[i] = kept;
+      if(kept != i)
+        {
+          facet_start[kept] = facet_start[i];
+          neighbors_start[kept] = neighbors_start[i];
+        }
+      kept++;
+    }
+  for(i = 0; i < kept; i++)
+    {
+      for(j = 0; j < 3; j++)
+        {
+          if(neighbors_start[i].neighbor[j] != -1)
+            {
+              neighbors_start[i].neighbor[j] =
+                renumber[neighbors_start[i].neighbor[j]];
+            }
+        }
+    }
+  free(renumber);
+
+  stats.degenerate_facets += degenerate;
+  stats.facets_removed += stats.number_of_facets - kept;
+  if(kept != stats.number_of_facets)
+    {
+      stats.number_of_facets = kept;
+      stl_count_connections(this);
+      stl_drop_shared(this);
+    }
+}
+
+/* If two corners of the facet are equal, links the neighbors across its
+   other two edges (one edge, walked both ways) to each other, unlinks
+   the neighbor across the collapsed edge and returns 1. */
+static int stl_bridge_degenerate(stl *stl, int facet)
+{
+  stl_vertex    *v = stl->facet_start[facet].vertex;
+  stl_neighbors *n = &stl->neighbors_start[facet];
+  int            edge;
+  int            edge1;
+  int            edge2;
+  int            neighbor1;
+  int            neighbor2;
+  int            neighbor3;
+  int            vnot1;
+  int            vnot2;
+  int            flip;
+
+  for(edge = 0; edge < 3; edge++)
+    {
+      if(!memcmp(&v[edge], &v[(edge + 1) % 3], sizeof(stl_vertex)))
+        {
+          break;
+        }
+    }
+  if(edge == 3)
+    {
+      return 0;
+    }
+  edge1 = (edge + 1) % 3;
+  edge2 = (edge + 2) % 3;
+  neighbor1 = n->neighbor[edge1] == facet ? -1 : n->neighbor[edge1];
+  neighbor2 = n->neighbor[edge2] == facet ? -1 : n->neighbor[edge2];
+  neighbor3 = n->neighbor[edge] == facet ? -1 : n->neighbor[edge];
+  vnot1 = n->which_vertex_not[edge1];
+  vnot2 = n->which_vertex_not[edge2];
+  if(neighbor1 == neighbor2)
+    {
+      /* Both edges lead to the same facet, which can't be its own
+         neighbor. */
+      if(neighbor1 != -1)
+        {
+          stl->neighbors_start[neighbor1].neighbor[(vnot1 + 1) % 3] = -1;
+          stl->neighbors_start[neighbor1].neighbor[(vnot2 + 1) % 3] = -1;
+        }
+      neighbor1 = -1;
+      neighbor2 = -1;
+    }
+
+  /* The two edges are one edge walked both ways, so the neighbors agree
+     with each other exactly when they agree, or disagree, with this
+     facet on both. */
+  flip = (vnot1 > 2) != (vnot2 > 2);
+  if(neighbor1 != -1)
+    {
+      stl->neighbors_start[neighbor1].neighbor[(vnot1 + 1) % 3] = neighbor2;
+      stl->neighbors_start[neighbor1].which_vertex_not[(vnot1 + 1) % 3] =
+        vnot2 % 3 + 3 * flip;
+    }
+  if(neighbor2 != -1)
+    {
+      stl->neighbors_start[neighbor2].neighbor[(vnot2 + 1) % 3] = neighbor1;
+      stl->neighbors_start[neighbor2].which_vertex_not[(vnot2 + 1) % 3] =
+        vnot1 % 3 + 3 * flip;
+    }
+  if(neighbor3 != -1)
+    {
+      stl->neighbors_start[neighbor3].
+        neighbor[(n->which_vertex_not[edge] + 1) % 3] = -1;
+    }
+  n->neighbor[0] = -1;
+  n->neighbor[1] = -1;
+  n->neighbor[2] = -1;
+  return 1;
+}
+
+void stl::fill_holes()
+{
+  /* Every open edge gets a facet spanning it and the next open edge
+   * round one of its corners; the new facets' edges are matched as they
+   * go in, so a hole is closed by a fan that shrinks it one corner at a
+   * time.  New facets are wound to agree with the facets around the
+   * hole and get normals from that winding.
+   */
+  stl_facet     facet;
+  stl_facet     new_facet;
+  int           neighbors_initial[3];
+  stl_hash_edge edge;
+  int           first_facet;
+  int           direction;
+  int           facet_num;
+  int           vnot;
+  int           next_edge;
+  int           pivot_vertex;
+  int           next_facet;
+  int           steps;
+  int           facets_added = stats.facets_added;
+  int           i;
+  int           j;
+  int           k;
+  float         normal[3];
+
+  if(facet_start == NULL || neighbors_start == NULL)
+    {
+      return;
+    }
+  free_edge_hash();
+
+  /* Insert all unconnected edges into hash list */
+  stl_exit_on_error(stl_initialize_facet_check_nearby(this),
+                    "stl_fill_holes", NULL);
+  for(i = 0; i < stats.number_of_facets; i++)
+    {
+      facet = facet_start[i];
+      for(j = 0; j < 3; j++)
+        {
+          if(neighbors_start[i].neighbor[j] != -1)
+            {
+              continue;
+            }
+          edge.facet_number = i;
+          edge.which_edge = j;
+          stl_load_edge_exact(this, &edge, &facet.vertex[j],
+                              &facet.vertex[(j + 1) % 3]);
+
+          stl_exit_on_error(insert_hash_edge(this, edge,
+                                             stl_match_neighbors_exact),
+                            "stl_fill_holes", NULL);
+        }
+    }
+
+  for(i = 0; i < stats.number_of_facets; i++)
+    {
+      facet = facet_start[i];
+      neighbors_initial[0] = neighbors_start[i].neighbor[0];
+      neighbors_initial[1] = neighbors_start[i].neighbor[1];
+      neighbors_initial[2] = neighbors_start[i].neighbor[2];
+      first_facet = i;
+      for(j = 0; j < 3; j++)
+        {
+          if(neighbors_start[i].neighbor[j] != -1)
+            {
+              continue;
+            }
+
+          new_facet.vertex[0] = facet.vertex[(j + 1) % 3];
+          new_facet.vertex[1] = facet.vertex[j];
+          if(neighbors_initial[(j + 2) % 3] == -1)
+            {
+              direction = 1;
+            }
+          else
+            {
+              direction = 0;
+            }
+
+          facet_num = i;
+          vnot = (j + 2) % 3;
+
+          for(steps = 0; steps < stats.number_of_facets; steps++)
+            {
+              if(vnot > 2)
+                {
+                  if(direction == 0)
+                    {
+                      pivot_vertex = (vnot + 2) % 3;
+                      next_edge = pivot_vertex;
+                      direction = 1;
+                    }
+                  else
+                    {
+                      pivot_vertex = (vnot + 1) % 3;
+                      next_edge = vnot % 3;
+                      direction = 0;
+                    }
+                }
+              else
+                {
+                  if(direction == 0)
+                    {
                       pivot_vertex = (vnot + 1) % 3;
                       next_edge = vnot;
                     }
@@ -860,41 +2202,631 @@ void stl::generate_shared_vertices()
                       next_edge = pivot_vertex;
                     }
                 }
-              v_indices[facet_num].vertex[pivot_vertex] =
-                stats.shared_vertices;
-
               next_facet = neighbors_start[facet_num].neighbor[next_edge];
+
               if(next_facet == -1)
                 {
-                  if(reversed)
+                  new_facet.vertex[2] = facet_start[facet_num].vertex[vnot % 3];
+                  if(   !memcmp(&new_facet.vertex[2], &new_facet.vertex[0],
+                                sizeof(stl_vertex))
+                     || !memcmp(&new_facet.vertex[2], &new_facet.vertex[1],
+                                sizeof(stl_vertex)))
                     {
+                      /* A crack two edges wide; a facet across it would
+                         have no area. */
                       break;
                     }
-                  else
+                  calculate_normal(normal, &new_facet);
+                  normalize_vector(normal);
+                  new_facet.normal.x = normal[0];
+                  new_facet.normal.y = normal[1];
+                  new_facet.normal.z = normal[2];
+                  new_facet.extra[0] = 0;
+                  new_facet.extra[1] = 0;
+                  stl_add_facet(this, &new_facet);
+                  for(k = 0; k < 3; k++)
                     {
-                      direction = 1;
-                      vnot = (j + 1) % 3;
-                      reversed = 1;
-                      facet_num = first_facet;
+                      edge.facet_number = stats.number_of_facets - 1;
+                      edge.which_edge = k;
+                      stl_load_edge_exact(this, &edge, &new_facet.vertex[k],
+                                          &new_facet.vertex[(k + 1) % 3]);
+
+                      stl_exit_on_error(insert_hash_edge(this, edge,
+                                                         stl_match_neighbors_exact),
+                                        "stl_fill_holes", NULL);
                     }
+                  break;
                 }
-              else if(next_facet != first_facet)
+              else
                 {
-                  vnot = neighbors_start[facet_num].
-                    which_vertex_not[next_edge];
+                  vnot = neighbors_start[facet_num].which_vertex_not[next_edge];
                   facet_num = next_facet;
                 }
-              else
+
+              if(facet_num == first_facet)
                 {
+                  /* back to the beginning: probably a Mobius part */
                   break;
                 }
             }
+        }
+    }
+
+  stl_free_edges(this);
+  if(stats.facets_added != facets_added)
+    {
+      stl_drop_shared(this);
+    }
+}
+
+/* Appends a facet with every edge open. */
+static void stl_add_facet(stl *stl, const stl_facet *new_facet)
+{
+  stl->stats.number_of_facets += 1;
+  if(stl_reallocate(stl) != STL_OK)
+    {
+      perror("stl_add_facet");
+      exit(1);
+    }
+  stl->stats.facets_added += 1;
+  stl->facet_start[stl->stats.number_of_facets - 1] = *new_facet;
+  stl->neighbors_start[stl->stats.number_of_facets - 1].neighbor[0] = -1;
+  stl->neighbors_start[stl->stats.number_of_facets - 1].neighbor[1] = -1;
+  stl->neighbors_start[stl->stats.number_of_facets - 1].neighbor[2] = -1;
+}
+
+void stl::fix_normal_directions()
+{
+  /* Walks each part breadth first from its lowest numbered facet and
+   * turns over every neighbor that runs a shared edge the same way as
+   * the facet it was reached from.  The first facet of a part is turned
+   * over if its stored normal points the other way; then a closed part
+   * that comes out with a negative volume is inside out and is turned
+   * over whole.  An edge that still disagrees belongs to a part that
+   * can't be oriented, a Mobius strip say, and is left so.
+   */
+  char *done;
+  char *flipped;
+  int  *part;
+  int   count;
+  int   head;
+  int   closed;
+  int   first;
+  int   i;
+  int   j;
+
+  stats.number_of_parts = 0;
+  if(facet_start == NULL || neighbors_start == NULL)
+    {
+      return;
+    }
+  done = (char *) calloc(STL_MAX(stats.number_of_facets, 1), sizeof(char));
+  flipped = (char *) calloc(STL_MAX(stats.number_of_facets, 1), sizeof(char));
+  part = (int *) malloc(STL_MAX(stats.number_of_facets, 1) * sizeof(int));
+  if(done == NULL || flipped == NULL || part == NULL)
+    {
+      perror("stl_fix_normal_directions");
+      exit(1);
+    }
+
+  for(first = 0; first < stats.number_of_facets; first++)
+    {
+      if(done[first])
+        {
+          continue;
+        }
+      if(stl_check_normal_vector(this, first, 0) == 2)
+        {
+          stl_reverse_facet(this, first);
+          flipped[first] ^= 1;
+        }
+      done[first] = 1;
+      part[0] = first;
+      count = 1;
+      closed = 1;
+
+      for(head = 0; head < count; head++)
+        {
+          int facet_num = part[head];
+          for(j = 0; j < 3; j++)
+            {
+              int other = neighbors_start[facet_num].neighbor[j];
+              if(other == -1 || other == facet_num)
+                {
+                  closed = 0;
+                  continue;
+                }
+              if(done[other])
+                {
+                  continue;
+                }
+              if(neighbors_start[facet_num].which_vertex_not[j] > 2)
+                {
+                  stl_reverse_facet(this, other);
+                  flipped[other] ^= 1;
+                }
+              done[other] = 1;
+              part[count++] = other;
+            }
+        }
+
+      if(closed && stl_part_volume(this, part, count) < 0.0)
+        {
+          for(i = 0; i < count; i++)
+            {
+              stl_reverse_facet(this, part[i]);
+              flipped[part[i]] ^= 1;
+            }
+        }
+      stats.number_of_parts += 1;
+    }
+
+  for(i = 0; i < stats.number_of_facets; i++)
+    {
+      stats.facets_reversed += flipped[i];
+      if(flipped[i] && v_indices != NULL)
+        {
+          /* Turning a facet over swaps its first two corners; the
+             indexed form follows along. */
+          int swap = v_indices[i].vertex[0];
+          v_indices[i].vertex[0] = v_indices[i].vertex[1];
+          v_indices[i].vertex[1] = swap;
+        }
+    }
+  free(done);
+  free(flipped);
+  free(part);
+}
+
+/* Signed volume of the given facets, as calculate_volume() sums it. */
+static double stl_part_volume(stl *stl, const int *facets, int count)
+{
+  stl_vertex origin = stl->facet_start[facets[0]].vertex[0];
+  double     volume = 0.0;
+  int        i;
+
+  for(i = 0; i < count; i++)
+    {
+      const stl_vertex *v = stl->facet_start[facets[i]].vertex;
+      double ax = (double) v[0].x - origin.x;
+      double ay = (double) v[0].y - origin.y;
+      double az = (double) v[0].z - origin.z;
+      double bx = (double) v[1].x - origin.x;
+      double by = (double) v[1].y - origin.y;
+      double bz = (double) v[1].z - origin.z;
+      double cx = (double) v[2].x - origin.x;
+      double cy = (double) v[2].y - origin.y;
+      double cz = (double) v[2].z - origin.z;
+
+      volume += ax * (by * cz - bz * cy) - ay * (bx * cz - bz * cx)
+                + az * (bx * cy - by * cx);
+    }
+  return volume / 6.0;
+}
+
+/* Turns a facet over by swapping its first two corners, which swaps
+   its second and third edges; the stored normal is negated and the
+   neighbor list on both sides of every edge is kept up to date. */
+static void stl_reverse_facet(stl *stl, int facet_num)
+{
+  stl_facet  *facet = &stl->facet_start[facet_num];
+  stl_vertex  tmp_vertex;
+  int         neighbor[3];
+  int         vnot[3];
+
+  neighbor[0] = stl->neighbors_start[facet_num].neighbor[0];
+  neighbor[1] = stl->neighbors_start[facet_num].neighbor[1];
+  neighbor[2] = stl->neighbors_start[facet_num].neighbor[2];
+  vnot[0] = stl->neighbors_start[facet_num].which_vertex_not[0];
+  vnot[1] = stl->neighbors_start[facet_num].which_vertex_not[1];
+  vnot[2] = stl->neighbors_start[facet_num].which_vertex_not[2];
+
+  /* reverse the facet */
+  tmp_vertex = facet->vertex[0];
+  facet->vertex[0] = facet->vertex[1];
+  facet->vertex[1] = tmp_vertex;
+  facet->normal.x = -facet->normal.x;
+  facet->normal.y = -facet->normal.y;
+  facet->normal.z = -facet->normal.z;
+
+  /* fix the vnots of the neighboring facets: the corner each of them
+     doesn't share moves from 2, 0, 1 to 2, 1, 0, and every shared edge
+     now runs the other way */
+  if(neighbor[0] != -1)
+    {
+      stl->neighbors_start[neighbor[0]].which_vertex_not[(vnot[0] + 1) % 3] =
+        (stl->neighbors_start[neighbor[0]].
+         which_vertex_not[(vnot[0] + 1) % 3] + 3) % 6;
+    }
+  if(neighbor[1] != -1)
+    {
+      stl->neighbors_start[neighbor[1]].which_vertex_not[(vnot[1] + 1) % 3] =
+        (stl->neighbors_start[neighbor[1]].
+         which_vertex_not[(vnot[1] + 1) % 3] + 4) % 6;
+    }
+  if(neighbor[2] != -1)
+    {
+      stl->neighbors_start[neighbor[2]].which_vertex_not[(vnot[2] + 1) % 3] =
+        (stl->neighbors_start[neighbor[2]].
+         which_vertex_not[(vnot[2] + 1) % 3] + 2) % 6;
+    }
+
+  /* swap the neighbors of the facet that is being reversed */
+  stl->neighbors_start[facet_num].neighbor[1] = neighbor[2];
+  stl->neighbors_start[facet_num].neighbor[2] = neighbor[1];
+
+  /* swap the vnots of the facet that is being reversed, and flip them */
+  stl->neighbors_start[facet_num].which_vertex_not[0] = (vnot[0] + 3) % 6;
+  stl->neighbors_start[facet_num].which_vertex_not[1] = (vnot[2] + 3) % 6;
+  stl->neighbors_start[facet_num].which_vertex_not[2] = (vnot[1] + 3) % 6;
+}
+
+void stl::fix_normal_values()
+{
+  int i;
+
+  if(facet_start == NULL)
+    {
+      return;
+    }
+  for(i = 0; i < stats.number_of_facets; i++)
+    {
+      stl_check_normal_vector(this, i, 1);
+    }
+}
+
+static int stl_check_normal_vector(stl *stl, int facet_num, int normal_fix_flag)
+{
+  /* Returns 0 if the normal is within tolerance */
+  /* Returns 1 if the normal is not within tolerance, but direction is OK */
+  /* Returns 2 if the normal is not within tolerance and backwards */
+  /* Returns 4 if the status is unknown. */
+  float      normal[3];
+  float      test_norm[3];
+  stl_facet *facet;
+  int        result;
+
+  facet = &stl->facet_start[facet_num];
+
+  stl->calculate_normal(normal, facet);
+  stl->normalize_vector(normal);
+
+  if(   (ABS(normal[0] - facet->normal.x) < 0.001)
+     && (ABS(normal[1] - facet->normal.y) < 0.001)
+     && (ABS(normal[2] - facet->normal.z) < 0.001))
+    {
+      /* It is not really necessary to change the values here */
+      /* but just for consistency, I will. */
+      facet->normal.x = normal[0];
+      facet->normal.y = normal[1];
+      facet->normal.z = normal[2];
+      return 0;
+    }
+
+  test_norm[0] = facet->normal.x;
+  test_norm[1] = facet->normal.y;
+  test_norm[2] = facet->normal.z;
+
+  stl->normalize_vector(test_norm);
+  if(   (ABS(normal[0] - test_norm[0]) < 0.001)
+     && (ABS(normal[1] - test_norm[1]) < 0.001)
+     && (ABS(normal[2] - test_norm[2]) < 0.001))
+    {
+      result = 1;
+    }
+  else if(   (ABS(normal[0] + test_norm[0]) < 0.001)
+          && (ABS(normal[1] + test_norm[1]) < 0.001)
+          && (ABS(normal[2] + test_norm[2]) < 0.001))
+    {
+      /* Facet is backwards. */
+      result = 2;
+    }
+  else
+    {
+      result = 4;
+    }
+  if(normal_fix_flag)
+    {
+      facet->normal.x = normal[0];
+      facet->normal.y = normal[1];
+      facet->normal.z = normal[2];
+      stl->stats.normals_fixed += 1;
+    }
+  return result;
+}
+
+/* Snapping corners or adding facets leaves the indexed form behind;
+   generate_shared_vertices() builds it again. */
+static void stl_drop_shared(stl *stl)
+{
+  free(stl->v_indices);
+  free(stl->v_shared);
+  stl->v_indices = NULL;
+  stl->v_shared = NULL;
+  stl->stats.shared_vertices = 0;
+  stl->stats.shared_malloced = 0;
+}
+
+/* Recounts the connection statistics from the neighbor list, for the
+   passes that remove facets. */
+static void stl_count_connections(stl *stl)
+{
+  int i;
+  int open;
+
+  stl->stats.connected_edges = 0;
+  stl->stats.connected_facets_1_edge = 0;
+  stl->stats.connected_facets_2_edge = 0;
+  stl->stats.connected_facets_3_edge = 0;
+  for(i = 0; i < stl->stats.number_of_facets; i++)
+    {
+      open = (stl->neighbors_start[i].neighbor[0] == -1)
+             + (stl->neighbors_start[i].neighbor[1] == -1)
+             + (stl->neighbors_start[i].neighbor[2] == -1);
+      stl->stats.connected_edges += 3 - open;
+      if(open <= 2)
+        {
+          stl->stats.connected_facets_1_edge += 1;
+        }
+      if(open <= 1)
+        {
+          stl->stats.connected_facets_2_edge += 1;
+        }
+      if(open == 0)
+        {
+          stl->stats.connected_facets_3_edge += 1;
+        }
+    }
+}
+
+void stl::generate_shared_vertices()
+{
+  stl_status status;
+
+  status = generate_shared_vertices(NULL, NULL);
+  if(status != STL_OK)
+    {
+      perror("stl_generate_shared_vertices");
+    }
+}
+
+stl_status stl::generate_shared_vertices(stl_progress_fn progress,
+                                         void *user_data)
+{
+  int i;
+  int j;
+  stl_vertex *grown;
+
+  free(v_indices);
+  free(v_shared);
+  v_indices =
+    (v_indices_struct*) calloc(stats.number_of_facets, sizeof(v_indices_struct));
+  v_shared =
+    (stl_vertex*) calloc((stats.number_of_facets / 2), sizeof(stl_vertex));
+  if(v_indices == NULL || v_shared == NULL)
+    {
+      free(v_indices);
+      free(v_shared);
+      v_indices = NULL;
+      v_shared = NULL;
+      return STL_ERR_MEMORY;
+    }
+  stats.shared_malloced = stats.number_of_facets / 2;
+  stats.shared_vertices = 0;
+
+  for(i = 0; i < stats.number_of_facets; i++)
+    {
+      v_indices[i].vertex[0] = -1;
+      v_indices[i].vertex[1] = -1;
+      v_indices[i].vertex[2] = -1;
+    }
+
+
+  for(i = 0; i < stats.number_of_facets; i++)
+    {
+      if(i % STL_PROGRESS_STRIDE == 0
+         && !stl_report_progress(progress, user_data, i,
+                                 stats.number_of_facets))
+        {
+          free(v_indices);
+          free(v_shared);
+          v_indices = NULL;
+          v_shared = NULL;
+          return STL_CANCELLED;
+        }
+      for(j = 0; j < 3; j++)
+        {
+          if(v_indices[i].vertex[j] != -1)
+            {
+              continue;
+            }
+          if(stats.shared_vertices == stats.shared_malloced)
+            {
+              stats.shared_malloced += 1024;
+              grown = (stl_vertex*) realloc(v_shared,
+                        stats.shared_malloced * sizeof(stl_vertex));
+              if(grown == NULL)
+                {
+                  free(v_indices);
+                  free(v_shared);
+                  v_indices = NULL;
+                  v_shared = NULL;
+                  return STL_ERR_MEMORY;
+                }
+              v_shared = grown;
+            }
+
+          v_shared[stats.shared_vertices] =
+            facet_start[i].vertex[j];
+          stl_walk_fan(this, i, j, stats.shared_vertices);
           stats.shared_vertices += 1;
         }
     }
+  stl_report_progress(progress, user_data, 1, 1);
+  return STL_OK;
+}
+
+/* Walks the fan of facets around corner j of first_facet through the
+ * neighbor list, both ways round if the fan is open.  With id >= 0 the
+ * corner is set to shared vertex id in every facet of the fan; either
+ * way the first shared vertex already set on the way is returned, or -1.
+ */
+static int stl_walk_fan(stl *stl, int first_facet, int j, int id)
+{
+  int direction = 0;
+  int reversed = 0;
+  int facet_num = first_facet;
+  int vnot = (j + 2) % 3;
+  int next_edge;
+  int pivot_vertex;
+  int next_facet;
+  int found = -1;
+
+  for(;;)
+    {
+      if(vnot > 2)
+        {
+          if(direction == 0)
+            {
+              pivot_vertex = (vnot + 2) % 3;
+              next_edge = pivot_vertex;
+              direction = 1;
+            }
+          else
+            {
+              pivot_vertex = (vnot + 1) % 3;
+              next_edge = vnot % 3;
+              direction = 0;
+            }
+        }
+      else
+        {
+          if(direction == 0)
+            {
+              pivot_vertex = (vnot + 1) % 3;
+              next_edge = vnot;
+            }
+          else
+            {
+              pivot_vertex = (vnot + 2) % 3;
+              next_edge = pivot_vertex;
+            }
+        }
+      if(found == -1)
+        {
+          found = stl->v_indices[facet_num].vertex[pivot_vertex];
+        }
+      if(id >= 0)
+        {
+          stl->v_indices[facet_num].vertex[pivot_vertex] = id;
+        }
+
+      next_facet = stl->neighbors_start[facet_num].neighbor[next_edge];
+      if(next_facet == -1)
+        {
+          if(reversed)
+            {
+              break;
+            }
+          else
+            {
+              direction = 1;
+              vnot = (j + 1) % 3;
+              reversed = 1;
+              facet_num = first_facet;
+            }
+        }
+      else if(next_facet != first_facet)
+        {
+          vnot = stl->neighbors_start[facet_num].which_vertex_not[next_edge];
+          facet_num = next_facet;
+        }
+      else
+        {
+          break;
+        }
+    }
+  return found;
+}
+
+void stl::calculate_normal(float normal[], const stl_facet *facet) const
+{
+  float v1[3];
+  float v2[3];
+
+  v1[0] = facet->vertex[1].x - facet->vertex[0].x;
+  v1[1] = facet->vertex[1].y - facet->vertex[0].y;
+  v1[2] = facet->vertex[1].z - facet->vertex[0].z;
+  v2[0] = facet->vertex[2].x - facet->vertex[0].x;
+  v2[1] = facet->vertex[2].y - facet->vertex[0].y;
+  v2[2] = facet->vertex[2].z - facet->vertex[0].z;
+
+  normal[0] = (float)((double)v1[1] * (double)v2[2])
+    - ((double)v1[2] * (double)v2[1]);
+  normal[1] = (float)((double)v1[2] * (double)v2[0])
+    - ((double)v1[0] * (double)v2[2]);
+  normal[2] = (float)((double)v1[0] * (double)v2[1])
+    - ((double)v1[1] * (double)v2[0]);
+}
+
+void stl::normalize_vector(float v[]) const
+{
+  double length;
+  double factor;
+  float  min_normal_length;
+
+  length = sqrt((double)v[0] * (double)v[0] + (double)v[1] * (double)v[1]
+                + (double)v[2] * (double)v[2]);
+  min_normal_length = 0.000000000001;
+  if(length < min_normal_length)
+    {
+      v[0] = 0.0;
+      v[1] = 0.0;
+      v[2] = 0.0;
+      return;
+    }
+  factor = 1.0 / length;
+  v[0] *= factor;
+  v[1] *= factor;
+  v[2] *= factor;
+}
+
+void stl::calculate_volume()
+{
+  /* Sum the signed volumes of the tetrahedra between each facet and a
+     point of the mesh, which keeps the terms small.  An inside-out mesh
+     comes out negative; its facets are left as they are and the size is
+     reported. */
+  stl_vertex origin;
+  double     volume = 0.0;
+  int        i;
+
+  if(stats.number_of_facets == 0)
+    {
+      stats.volume = 0.0;
+      return;
+    }
+  origin = facet_start[0].vertex[0];
+  for(i = 0; i < stats.number_of_facets; i++)
+    {
+      const stl_vertex *v = facet_start[i].vertex;
+      double ax = (double) v[0].x - origin.x;
+      double ay = (double) v[0].y - origin.y;
+      double az = (double) v[0].z - origin.z;
+      double bx = (double) v[1].x - origin.x;
+      double by = (double) v[1].y - origin.y;
+      double bz = (double) v[1].z - origin.z;
+      double cx = (double) v[2].x - origin.x;
+      double cy = (double) v[2].y - origin.y;
+      double cz = (double) v[2].z - origin.z;
+
+      volume += ax * (by * cz - bz * cy) - ay * (bx * cz - bz * cx)
+                + az * (bx * cy - by * cx);
+    }
+  stats.volume = fabs(volume) / 6.0;
 }
 
-void stl::write_off(char *file)
+void stl::write_off(char *file) const
 {
   char      *error_msg;
   ofstream  outfile;
@@ -916,7 +2848,7 @@ void stl::write_off(char *file)
   outfile.close();
 }
 
-void stl::write_off(ostream& stream)
+void stl::write_off(ostream& stream) const
 {
     stream << "OFF\n";
     stream << stats.shared_vertices << " " << stats.number_of_facets << " 0" << endl;
@@ -927,8 +2859,6 @@ void stl::write_off(ostream& stream)
       }
     for(int i = 0; i < stats.number_of_facets; i++)
       {
-        fprintf(fp, "\t3 %d %d %d\n", v_indices[i].vertex[0],
-                v_indices[i].vertex[1], v_indices[i].vertex[2]);
         stream << "\t3 " << v_indices[i].vertex[0] << " " << v_indices[i].vertex[1] << " " << v_indices[i].vertex[2] << endl;
       }
 }
@@ -18,7 +18,11 @@
  *  Questions, comments, suggestions, etc to <amartin@engr.csulb.edu>
  */
 
+#ifndef STL_H
+#define STL_H
+
 #include <stdio.h>
+#include <stdint.h>
 #include <iostream>
 #include <fstream>
 #include "cgaldefs.h"
@@ -36,6 +40,19 @@ using namespace std;
 #define ASCII_LINES_PER_FACET  7
 #define SIZEOF_EDGE_SORT       24
 
+/* File offsets are 64 bits wide everywhere, so files past 2 GB can be
+   sized even where long is 32 bits. */
+#ifdef _WIN32
+typedef __int64 stl_off_t;
+#define stl_fseek _fseeki64
+#define stl_ftell _ftelli64
+#else
+#include <sys/types.h>
+typedef off_t stl_off_t;
+#define stl_fseek fseeko
+#define stl_ftell ftello
+#endif
+
 typedef struct 
 {
   float x;
@@ -77,16 +94,25 @@ typedef struct stl_hash_edge
   struct stl_hash_edge  *next;
 }stl_hash_edge;
 
-typedef struct
+/* The topology records take their index type as a parameter.  The stl
+ * class uses the compact 32-bit records; stl_indexed_mesh<int64_t>
+ * (indexmesh.h) uses 64-bit ones to load and check meshes past 2^31
+ * facets, which nothing else here takes.
+ */
+template <typename Index>
+struct stl_neighbors_t
 {
-  int   neighbor[3];
+  Index neighbor[3];
   char  which_vertex_not[3];
-}stl_neighbors;
+};
+typedef stl_neighbors_t<int> stl_neighbors;
 
-typedef struct
+template <typename Index>
+struct v_indices_t
 {
-  int   vertex[3];
-}v_indices_struct;
+  Index vertex[3];
+};
+typedef v_indices_t<int> v_indices_struct;
 
 typedef struct
 {
@@ -124,9 +150,40 @@ typedef struct
   int           shared_malloced;
 }stl_stats;
 
+/* Result of the status-returning load paths.  The legacy entry points
+ * (open(char *) and friends) still print a message and exit on failure.
+ */
+typedef enum
+{
+  STL_OK = 0,
+  STL_ERR_OPEN,         /* the file could not be opened */
+  STL_ERR_SIZE,         /* a binary file whose size doesn't fit its facets */
+  STL_ERR_MEMORY,       /* an allocation failed */
+  STL_ERR_READ,         /* the file ended early or could not be parsed */
+  STL_ERR_WRITE,        /* an output file could not be written */
+  STL_CANCELLED         /* the progress callback asked to stop */
+}stl_status;
+
+/* Called periodically with the completed fraction (0.0 - 1.0) of the
+ * running operation.  Return nonzero to continue, zero to cancel.
+ */
+typedef int (*stl_progress_fn)(float fraction, void *user_data);
+
+/* A mesh owns its buffers: they are freed by close() or on destruction,
+ * whichever comes first.  Meshes are move-only so that handing one to the
+ * next stage never copies or double frees anything; clone() makes the
+ * deep copy when one is really wanted.
+ */
 class stl
 {
 public:
+    stl();
+    stl(stl &&other);
+    stl &operator=(stl &&other);
+    ~stl();
+
+    stl clone() const;
+
     FILE          *fp;
     stl_facet     *facet_start;
     stl_edge      *edge_start;
@@ -139,14 +196,47 @@ public:
     stl_stats     stats;
 
     void open(char *file);
+    stl_status open(char *file, stl_progress_fn progress, void *user_data);
+    stl_status load(char *file, stl_progress_fn progress, void *user_data);
+
+    /* Indexed imports: v_shared and v_indices are filled straight from
+     * the file, polygons are split into fans, and no welding is done.
+     * facet_start stays NULL until expand_facets() builds it, which
+     * check_facets_exact() does itself.  Passes that only read facets,
+     * the STL writers among them, go through get_facet(), which falls
+     * back to the indexed form with normals from the winding.
+     */
+    stl_status open_obj(char *file, stl_progress_fn progress, void *user_data);
+    stl_status open_ply(char *file, stl_progress_fn progress, void *user_data);
+    stl_status expand_facets();
+    stl_facet get_facet(int i) const;
     void close();
-    void stats_out(FILE *file, char *input_file);
+    void stats_out(FILE *file, char *input_file) const;
     void print_edges(FILE *file);
     void print_neighbors(char *file);
-    void write_ascii(char *file, char *label);
-    void write_binary(char *file, char *label);
+    void write_ascii(char *file, char *label) const;
+    void write_binary(char *file, char *label) const;
     void check_facets_exact();
+    stl_status check_facets_exact(stl_progress_fn progress, void *user_data);
+    /* Repairs, in the order ADMesh runs them, all after
+     * check_facets_exact().  check_facets_nearby() joins open edges whose
+     * ends fall in the same cells of a grid of the given spacing, moving
+     * corners to match; remove_unconnected_facets() drops the facets
+     * that collapsed and those with no neighbor at all; fill_holes()
+     * closes what is still open with new facets; fix_normal_directions()
+     * turns facets over until every part agrees with itself and closed
+     * parts face out; fix_normal_values() sets the normals from the
+     * winding.  A pass that moves corners or adds or removes facets frees
+     * v_shared/v_indices, which generate_shared_vertices() rebuilds.
+     */
     void check_facets_nearby(float tolerance);
+    /* Drops facets with two corners, or a corner and the opposite edge,
+     * within tolerance of each other (0: only exact repeats and exactly
+     * collinear corners), keeping the rest in order.  Counts them in
+     * stats.degenerate_facets and returns how many went.  Run it before
+     * check_facets_exact(); the neighbor list is not renumbered.
+     */
+    int remove_degenerate_facets(float tolerance);
     void remove_unconnected_facets();
     void write_vertex(int facet, int vertex);
     void write_facet(char *label, int facet);
@@ -167,14 +257,53 @@ public:
     void mirror_yz();
     void mirror_xz();
     void open_merge(char *file);
+    /* Drops the hash of open edges open_merge() keeps between merges.
+     * It holds facet numbers, so every pass that renumbers facets or
+     * rewrites neighbors_start calls this; the next merge rebuilds it.
+     */
+    void free_edge_hash();
     void generate_shared_vertices();
-    void write_off(char *file);
-    void write_off(ostream& stream);
+    stl_status generate_shared_vertices(stl_progress_fn progress, void *user_data);
+    /* Sorts the facets along a Morton curve through their centroids and
+     * renumbers v_shared in order of first use, remapping neighbors_start
+     * and v_indices to match, so that every later pass walks memory
+     * mostly in order.  Works before or after check_facets_exact() and
+     * generate_shared_vertices(); ties keep their file order.
+     */
+    void reorder_facets();
+    void write_off(char *file) const;
+    void write_off(ostream& stream) const;
     void write_dxf(char *file, char *label);
     void write_vrml(char *file);
-    void calculate_normal(float normal[], stl_facet *facet);
-    void normalize_vector(float v[]);
+    /* Indexed binary exports from v_shared/v_indices.  write_compact()
+     * rounds vertices to a grid of the given spacing (precision <= 0
+     * picks 2^-20 of each side of the bounding box), then stores them and
+     * the facet indices as zigzag varint deltas; open_compact() reads it
+     * back into v_shared/v_indices like the other indexed imports.
+     */
+    void write_ply(char *file, char *label) const;
+    void write_compact(char *file, float precision) const;
+    stl_status open_compact(char *file, stl_progress_fn progress,
+                            void *user_data);
+    void calculate_normal(float normal[], const stl_facet *facet) const;
+    void normalize_vector(float v[]) const;
     void calculate_volume();
 
+    /* Content hashes for result caches and duplicate detection.
+     * hash_facets() covers the normal and vertices of every facet in file
+     * order.  hash_canonical() covers the geometry only: it doesn't change
+     * when facets are reordered, a facet starts at another corner or the
+     * shared vertices are renumbered.  Both are the same on every machine
+     * and for any thread count.
+     */
+    uint64_t hash_facets() const;
+    uint64_t hash_canonical() const;
+
     Polyhedron to_polyhedron();
+
+private:
+    stl(const stl &);
+    stl &operator=(const stl &);
 };
+
+#endif // STL_H
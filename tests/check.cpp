@@ -0,0 +1,52 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "check.h"
+
+using namespace std;
+
+static int failures = 0;
+
+bool check_report(bool ok, const char *text, const char *file, int line)
+{
+  if(!ok)
+    {
+      fprintf(stderr, "%s:%d: check failed: %s\n", file, line, text);
+      failures++;
+    }
+  return ok;
+}
+
+int check_failures()
+{
+  return failures;
+}
+
+string check_temp_file(const char *name)
+{
+  const char *dir = getenv("TMPDIR");
+
+  return string(dir != NULL && *dir != '\0' ? dir : "/tmp") + "/" + name;
+}
+
+bool check_mesh_from_obj(stl *mesh, const char *obj)
+{
+  string      file = check_temp_file("sliceomatic_test.obj");
+  FILE       *fp;
+  stl_status  status;
+
+  fp = fopen(file.c_str(), "w");
+  if(fp == NULL)
+    {
+      return false;
+    }
+  fputs(obj, fp);
+  fclose(fp);
+
+  status = mesh->open_obj((char *) file.c_str(), NULL, NULL);
+  remove(file.c_str());
+  if(status != STL_OK)
+    {
+      return false;
+    }
+  return mesh->check_facets_exact(NULL, NULL) == STL_OK;
+}
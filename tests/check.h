@@ -0,0 +1,25 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <string>
+#include "stl.h"
+
+/* Minimal checks for the regression tests.  A failed CHECK prints the
+ * condition and where it is and counts as a failure; the test carries
+ * on, so one run shows everything that broke.
+ */
+#define CHECK(cond) check_report((cond), #cond, __FILE__, __LINE__)
+
+bool check_report(bool ok, const char *text, const char *file, int line);
+int  check_failures();
+
+/* A scratch file of the given name in $TMPDIR, or /tmp. */
+std::string check_temp_file(const char *name);
+
+/* Loads a mesh written as OBJ text ("v x y z" and "f a b c" lines) and
+ * builds its facets and neighbors, so tests can state small meshes
+ * inline.  Returns false if the text doesn't load.
+ */
+bool check_mesh_from_obj(stl *mesh, const char *obj);
+
+#endif // CHECK_H
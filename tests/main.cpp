@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <string.h>
+#include "check.h"
+
+/* Regression test driver.  Runs every test, or only those named on the
+ * command line, and exits nonzero if any check failed.
+ *
+ *   tests [name ...]
+ */
+
+void test_intersect_coplanar();
+void test_intersect_crossing();
+void test_compact_round_trip();
+void test_simplify_tolerance();
+void test_simplify_contact();
+
+typedef struct
+{
+  const char *name;
+  void      (*run)();
+}test_entry;
+
+static const test_entry tests[] =
+{
+  {"intersect_coplanar", test_intersect_coplanar},
+  {"intersect_crossing", test_intersect_crossing},
+  {"compact_round_trip", test_compact_round_trip},
+  {"simplify_tolerance", test_simplify_tolerance},
+  {"simplify_contact", test_simplify_contact}
+};
+
+static bool test_selected(const char *name, int argc, char **argv)
+{
+  int i;
+
+  if(argc < 2)
+    {
+      return true;
+    }
+  for(i = 1; i < argc; i++)
+    {
+      if(strcmp(argv[i], name) == 0)
+        {
+          return true;
+        }
+    }
+  return false;
+}
+
+int main(int argc, char **argv)
+{
+  size_t i;
+  int    before;
+
+  for(i = 0; i < sizeof(tests) / sizeof(tests[0]); i++)
+    {
+      if(!test_selected(tests[i].name, argc, argv))
+        {
+          continue;
+        }
+      before = check_failures();
+      tests[i].run();
+      printf("%-24s %s\n", tests[i].name,
+             check_failures() == before ? "ok" : "FAILED");
+      fflush(stdout);
+    }
+
+  if(check_failures() != 0)
+    {
+      printf("%d checks failed\n", check_failures());
+      return 1;
+    }
+  return 0;
+}
@@ -0,0 +1,80 @@
+#include <math.h>
+#include <stdio.h>
+#include <string>
+#include "check.h"
+#include "meshgen.h"
+
+using namespace std;
+
+/* Writes mesh with write_compact() at the given precision, reads it back
+   and checks that the facets are the same and no vertex moved further
+   than half a step of the grid it was rounded to. */
+static void compact_round_trip(stl &mesh, float precision)
+{
+  string file = check_temp_file("sliceomatic_test.somq");
+  stl    copy;
+  float  step[3];
+  int    i;
+  int    k;
+
+  mesh.write_compact((char *) file.c_str(), precision);
+  if(!CHECK(copy.open_compact((char *) file.c_str(), NULL, NULL) == STL_OK))
+    {
+      remove(file.c_str());
+      return;
+    }
+  remove(file.c_str());
+  if(!CHECK(copy.stats.number_of_facets == mesh.stats.number_of_facets)
+     || !CHECK(copy.stats.shared_vertices == mesh.stats.shared_vertices))
+    {
+      return;
+    }
+
+  step[0] = precision > 0.0 ? precision : mesh.stats.size.x / 1048576.0;
+  step[1] = precision > 0.0 ? precision : mesh.stats.size.y / 1048576.0;
+  step[2] = precision > 0.0 ? precision : mesh.stats.size.z / 1048576.0;
+  for(i = 0; i < mesh.stats.number_of_facets; i++)
+    {
+      for(k = 0; k < 3; k++)
+        {
+          CHECK(copy.v_indices[i].vertex[k] == mesh.v_indices[i].vertex[k]);
+        }
+    }
+  for(i = 0; i < mesh.stats.shared_vertices; i++)
+    {
+      const float *a = &mesh.v_shared[i].x;
+      const float *b = &copy.v_shared[i].x;
+      for(k = 0; k < 3; k++)
+        {
+          /* Half a step, and the float rounding of the result. */
+          float bound = step[k] / 2 + fabs(a[k]) * 1e-6;
+          if(!CHECK(fabs(a[k] - b[k]) <= bound))
+            {
+              return;
+            }
+        }
+    }
+
+  /* The indices survive exactly, so the copy is still closed. */
+  CHECK(copy.check_facets_exact(NULL, NULL) == STL_OK);
+  CHECK(copy.stats.connected_facets_3_edge == copy.stats.number_of_facets);
+}
+
+void test_compact_round_trip()
+{
+  string file = check_temp_file("sliceomatic_test.stl");
+  stl    mesh;
+
+  meshgen_generate(&mesh, meshgen_torus, 20000);
+  mesh.write_binary((char *) file.c_str(), mesh.stats.header);
+  mesh.close();
+  if(!CHECK(mesh.load((char *) file.c_str(), NULL, NULL) == STL_OK))
+    {
+      remove(file.c_str());
+      return;
+    }
+  remove(file.c_str());
+
+  compact_round_trip(mesh, 0.001f);
+  compact_round_trip(mesh, 0.0f);
+}
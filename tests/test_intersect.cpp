@@ -0,0 +1,127 @@
+#include <math.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "check.h"
+#include "intersect.h"
+
+using namespace std;
+
+static void obj_vertex(string &obj, double x, double y, double z)
+{
+  char line[128];
+
+  snprintf(line, sizeof(line), "v %.9g %.9g %.9g\n", x, y, z);
+  obj += line;
+}
+
+static void obj_face(string &obj, int a, int b, int c)
+{
+  char line[64];
+
+  snprintf(line, sizeof(line), "f %d %d %d\n", a, b, c);
+  obj += line;
+}
+
+/* Places a point of the z = 0 plane on a tilted plane well away from
+   the origin, rounding to float as any exported file would. */
+static void sheet_point(double u, double v, double p[3])
+{
+  const double a = 0.3;
+  const double b = 0.7;
+  const double c = 1.1;
+  double       y = v * cos(a);
+  double       z = v * sin(a);
+  double       x = u * cos(b) + z * sin(b);
+
+  z = -u * sin(b) + z * cos(b);
+  p[0] = (float) (x * cos(c) - y * sin(c) + 12.345);
+  p[1] = (float) (x * sin(c) + y * cos(c) - 3.21);
+  p[2] = (float) (z + 7.7);
+}
+
+/* A flat face as CAD exports tessellate it: a tilted sheet of squares,
+   each cut into a fan around its centre.  After rounding the corners
+   are only nearly coplanar, and neighbouring facets that merely touch
+   must not be taken for crossing ones. */
+void test_intersect_coplanar()
+{
+  const int              side = 24;
+  string                 obj;
+  stl                    mesh;
+  vector<stl_facet_pair> pairs;
+  double                 p[3];
+  int                    i;
+  int                    j;
+  int                    k;
+
+  for(j = 0; j <= side; j++)
+    {
+      for(i = 0; i <= side; i++)
+        {
+          sheet_point(i, j, p);
+          obj_vertex(obj, p[0], p[1], p[2]);
+        }
+    }
+  for(j = 0; j < side; j++)
+    {
+      for(i = 0; i < side; i++)
+        {
+          int corner[4];
+          int centre = (side + 1) * (side + 1) + j * side + i + 1;
+
+          corner[0] = j * (side + 1) + i + 1;
+          corner[1] = corner[0] + 1;
+          corner[2] = corner[1] + side + 1;
+          corner[3] = corner[0] + side + 1;
+          for(k = 0; k < 4; k++)
+            {
+              obj_face(obj, centre, corner[k], corner[(k + 1) % 4]);
+            }
+        }
+    }
+  for(j = 0; j < side; j++)
+    {
+      for(i = 0; i < side; i++)
+        {
+          sheet_point(i + 0.5, j + 0.5, p);
+          obj_vertex(obj, p[0], p[1], p[2]);
+        }
+    }
+
+  if(!CHECK(check_mesh_from_obj(&mesh, obj.c_str())))
+    {
+      return;
+    }
+  stl_find_self_intersections(mesh, pairs);
+  CHECK(pairs.empty());
+}
+
+/* A tall thin tetrahedron standing through the base of a larger one:
+   each of its three sides crosses that base, and nothing else meets. */
+void test_intersect_crossing()
+{
+  static const char obj[] =
+    "v 0 0 0\n" "v 2 0 0\n" "v 0 2 0\n" "v 0 0 2\n"
+    "f 1 3 2\n" "f 1 2 4\n" "f 1 4 3\n" "f 2 3 4\n"
+    "v 0.5 0.5 -1\n" "v 0.7 0.5 -1\n" "v 0.5 0.7 -1\n" "v 0.55 0.55 0.5\n"
+    "f 5 7 6\n" "f 5 6 8\n" "f 6 7 8\n" "f 7 5 8\n";
+  stl                    mesh;
+  vector<stl_facet_pair> pairs;
+  int                    i;
+
+  if(!CHECK(check_mesh_from_obj(&mesh, obj)))
+    {
+      return;
+    }
+  stl_find_self_intersections(mesh, pairs);
+  if(!CHECK(pairs.size() == 3))
+    {
+      return;
+    }
+  for(i = 0; i < 3; i++)
+    {
+      CHECK(pairs[i].facet_a == 0);
+      CHECK(pairs[i].facet_b == 5 + i);
+    }
+}
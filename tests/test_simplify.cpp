@@ -0,0 +1,132 @@
+#include <math.h>
+#include "check.h"
+#include "simplify.h"
+
+/* Distance from p to the segment a-b. */
+static double segment_distance(const stl_point2 &p, const stl_point2 &a,
+                               const stl_point2 &b)
+{
+  double dx = b.x - a.x;
+  double dy = b.y - a.y;
+  double length2 = dx * dx + dy * dy;
+  double t = 0.0;
+
+  if(length2 > 0.0)
+    {
+      t = ((p.x - a.x) * dx + (p.y - a.y) * dy) / length2;
+      t = STL_MAX(0.0, STL_MIN(t, 1.0));
+    }
+  dx = a.x + t * dx - p.x;
+  dy = a.y + t * dy - p.y;
+  return sqrt(dx * dx + dy * dy);
+}
+
+static double outline_distance(const stl_point2 &p, const stl_contour &c)
+{
+  double best = HUGE_VAL;
+  size_t n = c.points.size();
+  size_t i;
+
+  for(i = 0; i + 1 < n + (c.closed ? 1 : 0); i++)
+    {
+      best = STL_MIN(best, segment_distance(p, c.points[i],
+                                            c.points[(i + 1) % n]));
+    }
+  return best;
+}
+
+static bool same_point(const stl_point2 &a, const stl_point2 &b)
+{
+  return a.x == b.x && a.y == b.y;
+}
+
+/* A finely sampled circle and an open arc: both lose most of their
+   points, keep only original ones (and the arc its ends), and no
+   original point is further than the tolerance from the result. */
+void test_simplify_tolerance()
+{
+  const float tolerance = 0.05f;
+  stl_layer   layer;
+  stl_layer   original;
+  double      area;
+  size_t      c;
+  size_t      i;
+  size_t      j;
+
+  layer.z = 0.0;
+  layer.contours.resize(2);
+  layer.contours[0].closed = true;
+  layer.contours[1].closed = false;
+  for(i = 0; i < 720; i++)
+    {
+      stl_point2 p;
+      p.x = (float) (10.0 * cos(2 * M_PI * i / 720));
+      p.y = (float) (10.0 * sin(2 * M_PI * i / 720));
+      layer.contours[0].points.push_back(p);
+      if(i <= 180)
+        {
+          p.x += 30.0f;
+          layer.contours[1].points.push_back(p);
+        }
+    }
+  stl_layer_measure(layer);
+  original = layer;
+  area = layer.contours[0].area;
+
+  stl_simplify_layer(layer, tolerance);
+
+  for(c = 0; c < 2; c++)
+    {
+      const stl_contour &before = original.contours[c];
+      const stl_contour &after = layer.contours[c];
+
+      CHECK(after.points.size() >= 3);
+      CHECK(after.points.size() < before.points.size() / 4);
+      for(i = 0, j = 0; i < after.points.size(); i++)
+        {
+          while(j < before.points.size()
+                && !same_point(before.points[j], after.points[i]))
+            {
+              j++;
+            }
+          CHECK(j < before.points.size());
+        }
+      for(i = 0; i < before.points.size(); i++)
+        {
+          CHECK(outline_distance(before.points[i], after) <= tolerance * 1.0001);
+        }
+    }
+  CHECK(same_point(layer.contours[1].points.front(),
+                   original.contours[1].points.front()));
+  CHECK(same_point(layer.contours[1].points.back(),
+                   original.contours[1].points.back()));
+  CHECK(fabs(layer.contours[0].area - area) < 2 * M_PI * 10.0 * tolerance);
+}
+
+/* The point at (9.99, 5) is within tolerance of the straight side
+   x = 10, but dropping it would make that side touch the triangle whose
+   corner sits at (10, 5), on the layer's right edge; it has to stay. */
+void test_simplify_contact()
+{
+  static const stl_point2 square[] =
+    {{0, 0}, {10, 0}, {9.99f, 5}, {10, 10}, {0, 10}};
+  static const stl_point2 triangle[] =
+    {{10, 5}, {9.995f, 4}, {9.995f, 6}};
+  stl_layer layer;
+
+  layer.z = 0.0;
+  layer.contours.resize(2);
+  layer.contours[0].closed = true;
+  layer.contours[0].points.assign(square, square + 5);
+  layer.contours[1].closed = true;
+  layer.contours[1].points.assign(triangle, triangle + 3);
+  stl_layer_measure(layer);
+
+  stl_simplify_layer(layer, 0.05f);
+
+  if(CHECK(layer.contours[0].points.size() == 5))
+    {
+      CHECK(same_point(layer.contours[0].points[2], square[2]));
+    }
+  CHECK(layer.contours[1].points.size() == 3);
+}
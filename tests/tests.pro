@@ -0,0 +1,30 @@
+#-------------------------------------------------
+#
+# Regression tests for libsliceomatic.  Build the library first, then
+# this project from a sibling build directory, and run it:
+#
+#   qmake ../libsliceomatic && make
+#   mkdir tests && cd tests && qmake ../../libsliceomatic/tests && make
+#   ./tests
+#
+#-------------------------------------------------
+
+QT       -= gui
+
+TARGET = tests
+CONFIG   += console c++11
+CONFIG   -= app_bundle
+TEMPLATE = app
+
+INCLUDEPATH += .. ../bench
+LIBS += -L$$OUT_PWD/.. -llibsliceomatic
+
+SOURCES += main.cpp \
+    check.cpp \
+    test_intersect.cpp \
+    test_compact.cpp \
+    test_simplify.cpp \
+    ../bench/meshgen.cpp
+
+HEADERS += check.h \
+    ../bench/meshgen.h